@@ -6,10 +6,19 @@
 #include "neopixel.h"
 #include "nvs_storage.h"
 #include "usb_hid.h"
+#include "status_bin.h"
+#include "lzss.h"
+#include "spool.h"
+#include "keymap.h"
+#include "host_id.h"
 
 #include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "nimble/nimble_port.h"
 #include "nimble/nimble_port_freertos.h"
 #include "host/ble_hs.h"
@@ -27,6 +36,12 @@ static const char *TAG = "ble_server";
 
 #define DEVICE_NAME "ESP32-HID-Typer"
 
+/* Link parameters requested on every connection. The central has the final
+ * say; whatever it settles on is reported in the status JSON. */
+#define PREFERRED_ATT_MTU       517
+#define PREFERRED_TX_OCTETS     251     /* LL data length extension maximum */
+#define PREFERRED_TX_TIME_US    2120    /* 251 octets on the 1M PHY */
+
 static uint8_t s_own_addr_type;
 static uint16_t s_conn_handle = BLE_HS_CONN_HANDLE_NONE;
 static uint16_t s_text_input_val_handle;
@@ -34,7 +49,108 @@ static uint16_t s_status_val_handle;
 static uint16_t s_pin_mgmt_val_handle;
 static uint16_t s_wifi_config_val_handle;
 static uint16_t s_cert_fp_val_handle;
-static bool s_authenticated;
+static uint16_t s_live_keys_val_handle;
+static uint16_t s_status_bin_val_handle;
+static uint16_t s_typing_config_val_handle;
+static volatile bool s_authenticated;
+
+/* Bumped on connect and disconnect so queued commands and late auth results
+ * never apply to a different connection */
+static volatile uint32_t s_session;
+static portMUX_TYPE s_session_mux = portMUX_INITIALIZER_UNLOCKED;
+/* Auth commands queued for this session and not yet verified, under
+ * s_session_mux: while one is pending, a command written right behind it
+ * is queued instead of refused */
+static uint32_t s_auth_queued;
+static uint8_t s_tx_phy;                /* 1 = 1M, 2 = 2M, 3 = Coded */
+static uint16_t s_tx_octets;            /* Negotiated LL payload size */
+
+/* Connection-parameter policy: a short interval while text is arriving or
+ * being typed, a long interval with slave latency once the link is quiet.
+ * Intervals are in 1.25 ms units, the supervision timeout in 10 ms units. */
+#define LINK_POLICY_TICK_MS         1000
+#define LINK_IDLE_AFTER_US          (5 * 1000 * 1000)
+#define LINK_FAST_ITVL_MIN          6       /* 7.5 ms */
+#define LINK_FAST_ITVL_MAX          12      /* 15 ms */
+#define LINK_FAST_LATENCY           0
+#define LINK_IDLE_ITVL_MIN          80      /* 100 ms */
+#define LINK_IDLE_ITVL_MAX          120     /* 150 ms */
+#define LINK_IDLE_LATENCY           4
+#define LINK_SUPERVISION_TIMEOUT    400     /* 4 s */
+
+typedef enum {
+    LINK_MODE_NONE = 0,                 /* Central's parameters, nothing requested */
+    LINK_MODE_FAST,
+    LINK_MODE_IDLE,
+} link_mode_t;
+
+/* Host task only (GAP events, access callbacks and the policy callout) */
+static link_mode_t s_link_mode;         /* Last mode requested */
+static bool s_link_pending;             /* Update procedure in flight */
+static int64_t s_link_activity_us;      /* Last text ingest */
+static uint16_t s_conn_itvl;            /* Current interval, 1.25 ms units */
+static uint16_t s_conn_latency;
+static struct ble_npl_callout s_link_timer;
+
+/* Text input flow control: the client may send up to s_text_rx + credit
+ * bytes in total, where credit is advertised in notifications. A write that
+ * still does not fit is refused with a NACK, and every later write is
+ * refused until the client resends from the NACKed offset (text_resume). */
+static volatile uint32_t s_text_rx;     /* Bytes accepted this connection */
+static bool s_text_nacked;
+
+/* Framed text input: a write starting with FRAME_MARKER carries
+ *   [0x01][flags][job u16][seq u16][crc32 u32][payload]
+ * (little-endian; CRC-32 over the first six header bytes and the payload).
+ * Frames of a job are delivered to the typing queue exactly once and in
+ * sequence order; up to FRAME_REORDER_SLOTS-1 frames after a gap are held
+ * while the missing one is requested again. Job state survives a
+ * reconnect so an interrupted transfer can resume where it stopped.
+ *
+ * With FRAME_FLAG_COMPRESSED the payload continues the job's LZSS stream
+ * (see lzss.h) and is decompressed straight into the typing queue. The
+ * decoder state is only advanced once a frame has been queued, so a NACKed
+ * frame decodes the same when resent. For these frames rx counts
+ * decompressed bytes, which is what the credit window is measured in.
+ *
+ * Each framed job is typed as its own typing engine job (tid); a cancelled
+ * job's remaining frames are acknowledged and dropped. A frame with
+ * FRAME_FLAG_INTERACTIVE is a whole job on its own (seq 0, FRAME_FLAG_LAST,
+ * sent with write-with-response): it is typed on the interactive lane, ahead
+ * of the bulk text, and leaves the job in progress and rx untouched.
+ *
+ * While the flash spool accepts text, bulk text (framed or not) is appended
+ * there instead and typed by the spool's own job; credit is then the free
+ * spool space. A job started that way stays spooled to its end. */
+#define FRAME_MARKER            0x01    /* SOH: never typed, so unambiguous */
+#define FRAME_FLAG_LAST         0x01
+#define FRAME_FLAG_COMPRESSED   0x02
+#define FRAME_FLAG_INTERACTIVE  0x04
+#define FRAME_HEADER_LEN        10
+#define FRAME_CRC_OFFSET        6
+#define FRAME_MAX_PAYLOAD       (512 - FRAME_HEADER_LEN)
+#define FRAME_REORDER_SLOTS     4
+#define FRAME_MAX_PLAIN         1024    /* Decompressed bytes per frame */
+
+typedef struct {
+    bool used;
+    uint8_t flags;
+    uint16_t seq;
+    uint16_t len;
+    uint8_t data[FRAME_MAX_PAYLOAD];
+} frame_slot_t;
+
+static uint16_t s_job_id;
+static uint16_t s_job_tid;              /* Typing engine job, TYPING_JOB_NONE if none */
+static uint16_t s_job_next;             /* Next sequence number to deliver */
+static bool s_job_active;
+static bool s_job_done;
+static bool s_job_spooled;              /* Frames go to the flash spool */
+static bool s_job_dropped;              /* Aborted while spooling: ack and drop */
+static frame_slot_t s_reorder[FRAME_REORDER_SLOTS];
+static lzss_decoder_t s_lzss;           /* Stream state after the last queued frame */
+static lzss_decoder_t s_lzss_scratch;
+static uint8_t s_frame_buf[FRAME_MAX_PAYLOAD];
 
 typedef enum {
     AUTH_ERROR_NONE = 0,
@@ -45,6 +161,91 @@ typedef enum {
 
 static auth_error_state_t s_auth_error = AUTH_ERROR_NONE;
 
+/* Binary status: once the client subscribes, status changes and typing
+ * progress go out as deltas against the last record sent instead of JSON.
+ * s_status_bin_lock keeps deltas computed and sent in the same order. */
+static volatile bool s_status_bin_subscribed;
+static bool s_status_bin_synced;        /* s_status_bin_sent is what the client has */
+static status_bin_t s_status_bin_sent;
+static SemaphoreHandle_t s_status_bin_lock;
+static volatile uint32_t s_progress_current;
+static volatile uint32_t s_progress_total;
+static volatile uint16_t s_progress_tid;
+
+/* Typing progress is coalesced: one notification per s_progress_ms or per
+ * s_progress_chars keys (0 = no key budget), whichever comes first, and
+ * always the final one. While the NimBLE mbuf pool is low, intermediate
+ * updates are skipped so they do not compete with incoming text writes. */
+#define PROGRESS_DEFAULT_MS         100
+#define PROGRESS_DEFAULT_CHARS      64
+#define PROGRESS_MIN_FREE_MBUFS     4
+
+static uint16_t s_progress_ms = PROGRESS_DEFAULT_MS;
+static uint16_t s_progress_chars = PROGRESS_DEFAULT_CHARS;
+/* Typing task only */
+static int64_t s_progress_sent_us;
+static uint32_t s_progress_sent_current;
+static uint16_t s_progress_sent_tid;
+static uint32_t s_progress_deferred;        /* Updates skipped for low mbufs */
+/* A completion the host had no mbufs for waits here and is sent again from
+ * the host task, so the typing task never stalls on it. Only the latest is
+ * kept: it carries the current typing state. */
+static portMUX_TYPE s_progress_final_mux = portMUX_INITIALIZER_UNLOCKED;
+static typing_progress_t s_progress_final;
+static volatile bool s_progress_final_pending;
+
+/* PIN management commands executed by the command worker */
+#define CMD_QUEUE_LEN           4
+#define CMD_TASK_STACK          4096
+#define CMD_TASK_PRIORITY       3
+#define CMD_PIN_LEN             16
+#define CMD_CONFIG_LEN          24
+
+typedef enum {
+    BLE_CMD_AUTH,
+    BLE_CMD_SET_PIN,
+    BLE_CMD_SET_CONFIG,
+    BLE_CMD_GET_LOGS,
+    BLE_CMD_KEY_COMBO,
+} ble_cmd_type_t;
+
+typedef struct {
+    ble_cmd_type_t type;
+    uint32_t session;                   /* s_session when queued */
+    union {
+        struct {
+            char pin[CMD_PIN_LEN];
+        } auth;
+        struct {
+            char old_pin[CMD_PIN_LEN];
+            char new_pin[CMD_PIN_LEN];
+        } set_pin;
+        struct {
+            char key[CMD_CONFIG_LEN];
+            char value[CMD_CONFIG_LEN];
+        } config;
+        struct {
+            uint8_t modifier;
+            uint8_t keycode;
+        } key_combo;
+    };
+} ble_cmd_t;
+
+static QueueHandle_t s_cmd_queue;
+
+/* Live keys: [seq u8] followed by [event u8][usage u8] pairs, applied in
+ * order straight to USB. The sequence number catches lost writes: after a
+ * gap every live key is released, since the lost write may have held the
+ * key-up for something still down. */
+#define LIVE_EVENT_UP           0x00
+#define LIVE_EVENT_DOWN         0x01
+#define LIVE_EVENT_RELEASE      0x02    /* Release every live key */
+#define LIVE_MAX_EVENTS         16
+
+static uint8_t s_live_seq;
+static bool s_live_seq_valid;
+static uint32_t s_live_gaps;
+
 /* Service UUID: 6e400001-b5a3-f393-e0a9-e50e24dcca9e (little-endian) */
 static const ble_uuid128_t svc_uuid =
     BLE_UUID128_INIT(0x9e, 0xca, 0xdc, 0x24, 0x0e, 0xe5, 0xa9, 0xe0,
@@ -75,6 +276,21 @@ static const ble_uuid128_t cert_fp_uuid =
     BLE_UUID128_INIT(0x9e, 0xca, 0xdc, 0x24, 0x0e, 0xe5, 0xa9, 0xe0,
                      0x93, 0xf3, 0xa3, 0xb5, 0x06, 0x00, 0x40, 0x6e);
 
+/* Live Keys: 6e400007-... */
+static const ble_uuid128_t live_keys_uuid =
+    BLE_UUID128_INIT(0x9e, 0xca, 0xdc, 0x24, 0x0e, 0xe5, 0xa9, 0xe0,
+                     0x93, 0xf3, 0xa3, 0xb5, 0x07, 0x00, 0x40, 0x6e);
+
+/* Binary Status: 6e400008-... */
+static const ble_uuid128_t status_bin_uuid =
+    BLE_UUID128_INIT(0x9e, 0xca, 0xdc, 0x24, 0x0e, 0xe5, 0xa9, 0xe0,
+                     0x93, 0xf3, 0xa3, 0xb5, 0x08, 0x00, 0x40, 0x6e);
+
+/* Typing Config: 6e400009-... */
+static const ble_uuid128_t typing_config_uuid =
+    BLE_UUID128_INIT(0x9e, 0xca, 0xdc, 0x24, 0x0e, 0xe5, 0xa9, 0xe0,
+                     0x93, 0xf3, 0xa3, 0xb5, 0x09, 0x00, 0x40, 0x6e);
+
 /* Forward declarations */
 static int text_input_access_cb(uint16_t conn_handle, uint16_t attr_handle,
                                  struct ble_gatt_access_ctxt *ctxt, void *arg);
@@ -86,6 +302,12 @@ static int wifi_config_access_cb(uint16_t conn_handle, uint16_t attr_handle,
                                   struct ble_gatt_access_ctxt *ctxt, void *arg);
 static int cert_fp_access_cb(uint16_t conn_handle, uint16_t attr_handle,
                               struct ble_gatt_access_ctxt *ctxt, void *arg);
+static int live_keys_access_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                struct ble_gatt_access_ctxt *ctxt, void *arg);
+static int status_bin_access_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                 struct ble_gatt_access_ctxt *ctxt, void *arg);
+static int typing_config_access_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                    struct ble_gatt_access_ctxt *ctxt, void *arg);
 static void notify_status_if_connected(void);
 
 static esp_err_t send_key_combo(uint8_t modifier, uint8_t keycode)
@@ -99,16 +321,149 @@ static esp_err_t send_key_combo(uint8_t modifier, uint8_t keycode)
         return err;
     }
 
-    vTaskDelay(pdMS_TO_TICKS(6));
+    /* The report FIFO sends the release one poll after the press */
     return usb_hid_release_keys();
 }
 
+static void reset_text_flow(void)
+{
+    s_text_rx = 0;
+    s_text_nacked = false;
+    /* An unfinished framed job resumes where it stopped, possibly inside an
+     * in-band command; anything else starts over */
+    if (!s_job_active || s_job_done) {
+        typing_engine_reset_input();
+    }
+}
+
+static const char *link_mode_to_string(link_mode_t mode)
+{
+    switch (mode) {
+    case LINK_MODE_FAST:
+        return "fast";
+    case LINK_MODE_IDLE:
+        return "idle";
+    default:
+        return "none";
+    }
+}
+
+static void read_conn_params(void)
+{
+    struct ble_gap_conn_desc desc;
+    if (ble_gap_conn_find(s_conn_handle, &desc) == 0) {
+        s_conn_itvl = desc.conn_itvl;
+        s_conn_latency = desc.conn_latency;
+    }
+}
+
+/* One update procedure at a time; a refused or failed request leaves the
+ * mode unset so the next policy tick retries it */
+static void link_request_mode(link_mode_t mode)
+{
+    if (s_conn_handle == BLE_HS_CONN_HANDLE_NONE) return;
+    if (s_link_pending || mode == s_link_mode) return;
+
+    struct ble_gap_upd_params params = {
+        .itvl_min = mode == LINK_MODE_FAST ? LINK_FAST_ITVL_MIN : LINK_IDLE_ITVL_MIN,
+        .itvl_max = mode == LINK_MODE_FAST ? LINK_FAST_ITVL_MAX : LINK_IDLE_ITVL_MAX,
+        .latency = mode == LINK_MODE_FAST ? LINK_FAST_LATENCY : LINK_IDLE_LATENCY,
+        .supervision_timeout = LINK_SUPERVISION_TIMEOUT,
+    };
+    int rc = ble_gap_update_params(s_conn_handle, &params);
+    if (rc != 0) {
+        ESP_LOGD(TAG, "Connection update (%s) deferred: rc=%d", link_mode_to_string(mode), rc);
+        return;
+    }
+    ESP_LOGI(TAG, "Requesting %s connection parameters", link_mode_to_string(mode));
+    s_link_mode = mode;
+    s_link_pending = true;
+}
+
+static void link_policy_evaluate(void)
+{
+    bool busy = typing_engine_is_typing() ||
+                typing_engine_queue_length() > 0 ||
+                esp_timer_get_time() - s_link_activity_us < LINK_IDLE_AFTER_US;
+    link_request_mode(busy ? LINK_MODE_FAST : LINK_MODE_IDLE);
+}
+
+static void flush_progress_final(void);
+
+static void link_timer_cb(struct ble_npl_event *ev)
+{
+    if (s_conn_handle == BLE_HS_CONN_HANDLE_NONE) return;
+    flush_progress_final();
+    link_policy_evaluate();
+    ble_npl_callout_reset(&s_link_timer, ble_npl_time_ms_to_ticks32(LINK_POLICY_TICK_MS));
+}
+
+/* Text is arriving: switch to the fast interval right away */
+static void note_link_activity(void)
+{
+    s_link_activity_us = esp_timer_get_time();
+    link_request_mode(LINK_MODE_FAST);
+}
+
+/* Leave the first request to the policy tick so it does not collide with
+ * the PHY and data length procedures started on connect */
+static void link_policy_start(void)
+{
+    s_link_mode = LINK_MODE_NONE;
+    s_link_pending = false;
+    s_link_activity_us = esp_timer_get_time();
+    read_conn_params();
+    ble_npl_callout_reset(&s_link_timer, ble_npl_time_ms_to_ticks32(LINK_POLICY_TICK_MS));
+}
+
+/* Bytes of text the client may still send beyond rx */
+static uint32_t text_credit(void)
+{
+    return spool_accepting() ? spool_free() : typing_engine_free_chars();
+}
+
+/* Read rx before credit: a write accepted in between can only make the
+ * advertised limit (rx + credit) smaller, never larger */
+static void notify_text_credit(bool nack)
+{
+    if (s_conn_handle == BLE_HS_CONN_HANDLE_NONE) return;
+
+    uint32_t rx = s_text_rx;
+    uint32_t credit = text_credit();
+    char json[64];
+    int len = snprintf(json, sizeof(json), "{\"%s\":%lu,\"credit\":%lu}",
+                       nack ? "nack" : "rx", (unsigned long)rx, (unsigned long)credit);
+
+    struct os_mbuf *om = ble_hs_mbuf_from_flat(json, len);
+    if (om) {
+        ble_gatts_notify_custom(s_conn_handle, s_status_val_handle, om);
+    }
+}
+
 static void reset_session_auth(void)
 {
     s_authenticated = false;
     s_auth_error = AUTH_ERROR_NONE;
 }
 
+static void reset_live_keys(void)
+{
+    usb_hid_live_release();
+    s_live_seq_valid = false;
+}
+
+/* Start a fresh session; commands still queued for the old one are dropped
+ * and live keys are let go */
+static void begin_session(void)
+{
+    portENTER_CRITICAL(&s_session_mux);
+    s_session++;
+    s_auth_queued = 0;
+    reset_session_auth();
+    portEXIT_CRITICAL(&s_session_mux);
+    reset_live_keys();
+}
+
 static void set_session_auth_result(auth_result_t result)
 {
     switch (result) {
@@ -191,12 +546,383 @@ static const struct ble_gatt_svc_def s_gatt_svcs[] = {
                 .flags = BLE_GATT_CHR_F_READ,
                 .val_handle = &s_cert_fp_val_handle,
             },
+            {
+                /* Live Keys (Write Without Response) */
+                .uuid = &live_keys_uuid.u,
+                .access_cb = live_keys_access_cb,
+                .flags = BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_NO_RSP,
+                .val_handle = &s_live_keys_val_handle,
+            },
+            {
+                /* Binary Status (Read, Notify) */
+                .uuid = &status_bin_uuid.u,
+                .access_cb = status_bin_access_cb,
+                .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+                .val_handle = &s_status_bin_val_handle,
+            },
+            {
+                /* Typing Config (Read) */
+                .uuid = &typing_config_uuid.u,
+                .access_cb = typing_config_access_cb,
+                .flags = BLE_GATT_CHR_F_READ,
+                .val_handle = &s_typing_config_val_handle,
+            },
             { 0 },
         },
     },
     { 0 },
 };
 
+/* Translate an mbuf chain segment by segment, straight from the mbuf data:
+ * one pass to size the write, one to stage it in the typing queue. The
+ * first 'skip' bytes of the chain (a frame header) are left out. */
+static esp_err_t enqueue_mbuf_chain(const struct os_mbuf *om, uint16_t skip, uint16_t job)
+{
+    typing_write_t w;
+    const struct os_mbuf *m;
+    uint16_t off;
+
+    typing_engine_enqueue_begin(&w, job);
+    off = skip;
+    for (m = om; m != NULL; m = SLIST_NEXT(m, om_next)) {
+        if (off >= m->om_len) {
+            off -= m->om_len;
+            continue;
+        }
+        typing_engine_enqueue_measure(&w, (const char *)m->om_data + off, m->om_len - off);
+        off = 0;
+    }
+    esp_err_t err = typing_engine_enqueue_reserve(&w);
+    if (err != ESP_OK) {
+        return err;
+    }
+    off = skip;
+    for (m = om; m != NULL; m = SLIST_NEXT(m, om_next)) {
+        if (off >= m->om_len) {
+            off -= m->om_len;
+            continue;
+        }
+        typing_engine_enqueue_segment(&w, (const char *)m->om_data + off, m->om_len - off);
+        off = 0;
+    }
+    typing_engine_enqueue_commit(&w);
+    return ESP_OK;
+}
+
+/* The same for the flash spool: one append, staged segment by segment and
+ * written to flash by the spool task */
+static esp_err_t spool_mbuf_chain(const struct os_mbuf *om, uint16_t skip)
+{
+    spool_write_t w;
+    uint16_t off = skip;
+
+    esp_err_t err = spool_append_begin(&w, OS_MBUF_PKTLEN(om) - skip);
+    if (err != ESP_OK) {
+        return err;
+    }
+    for (const struct os_mbuf *m = om; m != NULL; m = SLIST_NEXT(m, om_next)) {
+        if (off >= m->om_len) {
+            off -= m->om_len;
+            continue;
+        }
+        spool_append_data(&w, m->om_data + off, m->om_len - off);
+        off = 0;
+    }
+    return spool_append_commit(&w);
+}
+
+static uint32_t mbuf_crc32(const struct os_mbuf *om, uint16_t skip, uint32_t crc)
+{
+    for (const struct os_mbuf *m = om; m != NULL; m = SLIST_NEXT(m, om_next)) {
+        if (skip >= m->om_len) {
+            skip -= m->om_len;
+            continue;
+        }
+        crc = esp_rom_crc32_le(crc, m->om_data + skip, m->om_len - skip);
+        skip = 0;
+    }
+    return crc;
+}
+
+/* Acknowledge the job state together with the flow-control window. 'retx'
+ * names a missing sequence number to resend; a NACK means the next frame
+ * did not fit in the typing queue and must be resent once credit returns. */
+static void notify_frame_state(int retx, bool nack)
+{
+    if (s_conn_handle == BLE_HS_CONN_HANDLE_NONE) return;
+
+    uint32_t rx = s_text_rx;
+    uint32_t credit = text_credit();
+    char json[128];
+    int len = snprintf(json, sizeof(json),
+                       "{\"job\":%u,\"next\":%u,\"done\":%s,\"%s\":%lu,\"credit\":%lu,\"tid\":%u",
+                       s_job_id, s_job_next, s_job_done ? "true" : "false",
+                       nack ? "nack" : "rx", (unsigned long)rx, (unsigned long)credit,
+                       s_job_spooled ? spool_job() : s_job_tid);
+    if (retx >= 0) {
+        len += snprintf(json + len, sizeof(json) - len, ",\"retx\":%d", retx);
+    }
+    len += snprintf(json + len, sizeof(json) - len, "}");
+
+    struct os_mbuf *om = ble_hs_mbuf_from_flat(json, len);
+    if (om) {
+        ble_gatts_notify_custom(s_conn_handle, s_status_val_handle, om);
+    }
+}
+
+static void start_job(uint16_t job)
+{
+    /* An abandoned job still types what it has queued */
+    if (s_job_tid != TYPING_JOB_NONE) {
+        typing_engine_job_close(s_job_tid);
+    }
+    s_job_id = job;
+    s_job_next = 0;
+    s_job_active = true;
+    s_job_done = false;
+    s_job_spooled = spool_accepting();
+    s_job_dropped = false;
+    memset(s_reorder, 0, sizeof(s_reorder));
+    lzss_decoder_reset(&s_lzss);
+    typing_engine_reset_input();
+    /* With the job table full, frames go to the automatic job */
+    s_job_tid = s_job_spooled ? TYPING_JOB_NONE : typing_engine_job_open(TYPING_LANE_BULK);
+    ESP_LOGI(TAG, "Text job %u started (%s %u)", job,
+             s_job_spooled ? "spooled" : "tid", s_job_tid);
+}
+
+/* Account for a frame delivered in order */
+static void advance_job(uint8_t flags, uint32_t rx_len)
+{
+    s_text_rx += rx_len;
+    s_job_next++;
+    s_job_done = (flags & FRAME_FLAG_LAST) != 0;
+    if (s_job_done && s_job_tid != TYPING_JOB_NONE) {
+        typing_engine_job_close(s_job_tid);
+        s_job_tid = TYPING_JOB_NONE;
+    }
+}
+
+/* The job was cancelled; once its queued text is gone the engine no longer
+ * knows it at all */
+static bool job_cancelled(esp_err_t err)
+{
+    return err == ESP_ERR_INVALID_STATE || err == ESP_ERR_NOT_FOUND;
+}
+
+static void inflate_measure(void *ctx, const uint8_t *data, size_t len)
+{
+    typing_engine_enqueue_measure(ctx, (const char *)data, len);
+}
+
+static void inflate_stage(void *ctx, const uint8_t *data, size_t len)
+{
+    typing_engine_enqueue_segment(ctx, (const char *)data, len);
+}
+
+static void inflate_spool(void *ctx, const uint8_t *data, size_t len)
+{
+    spool_append_data(ctx, data, len);
+}
+
+/* Decompress a frame payload into the typing queue: count, measure, then
+ * stage, each pass from a copy of the committed decoder state */
+static esp_err_t enqueue_compressed(const uint8_t *data, uint16_t len, uint32_t *plain_len)
+{
+    typing_write_t w;
+
+    s_lzss_scratch = s_lzss;
+    size_t plain = lzss_decode(&s_lzss_scratch, data, len, NULL, NULL);
+    if (plain > FRAME_MAX_PLAIN) {
+        ESP_LOGW(TAG, "Compressed frame expands to %u bytes", (unsigned)plain);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (s_job_dropped) {
+        s_lzss = s_lzss_scratch;
+        *plain_len = plain;
+        return ESP_OK;
+    }
+
+    if (s_job_spooled) {
+        spool_write_t sw;
+        esp_err_t err = spool_append_begin(&sw, plain);
+        if (err != ESP_OK) {
+            return err;
+        }
+        s_lzss_scratch = s_lzss;
+        lzss_decode(&s_lzss_scratch, data, len, inflate_spool, &sw);
+        err = spool_append_commit(&sw);
+        if (err != ESP_OK) {
+            return err;
+        }
+        s_lzss = s_lzss_scratch;
+        *plain_len = plain;
+        return ESP_OK;
+    }
+
+    typing_engine_enqueue_begin(&w, s_job_tid);
+    s_lzss_scratch = s_lzss;
+    lzss_decode(&s_lzss_scratch, data, len, inflate_measure, &w);
+    esp_err_t err = typing_engine_enqueue_reserve(&w);
+    if (job_cancelled(err)) {
+        /* Dropped, but the stream still moves on */
+        s_lzss = s_lzss_scratch;
+        *plain_len = plain;
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+    s_lzss_scratch = s_lzss;
+    lzss_decode(&s_lzss_scratch, data, len, inflate_stage, &w);
+    typing_engine_enqueue_commit(&w);
+
+    s_lzss = s_lzss_scratch;
+    *plain_len = plain;
+    return ESP_OK;
+}
+
+/* Queue one in-order frame payload; *rx_len receives what it adds to rx */
+static esp_err_t deliver_frame(uint8_t flags, const uint8_t *data, uint16_t len,
+                               uint32_t *rx_len)
+{
+    esp_err_t err;
+
+    if (flags & FRAME_FLAG_COMPRESSED) {
+        err = enqueue_compressed(data, len, rx_len);
+    } else if (s_job_dropped) {
+        *rx_len = len;
+        err = ESP_OK;
+    } else if (s_job_spooled) {
+        *rx_len = len;
+        err = spool_append(data, len);
+    } else {
+        *rx_len = len;
+        err = typing_engine_enqueue(s_job_tid, (const char *)data, len);
+    }
+    return job_cancelled(err) ? ESP_OK : err;
+}
+
+/* Deliver held frames that have become in-order */
+static void drain_reorder_slots(void)
+{
+    while (!s_job_done) {
+        frame_slot_t *slot = &s_reorder[s_job_next % FRAME_REORDER_SLOTS];
+        if (!slot->used || slot->seq != s_job_next) {
+            return;
+        }
+        uint32_t rx_len;
+        if (deliver_frame(slot->flags, slot->data, slot->len, &rx_len) != ESP_OK) {
+            return;     /* Stays held until credit returns */
+        }
+        advance_job(slot->flags, rx_len);
+        slot->used = false;
+    }
+}
+
+static int handle_interactive_frame(const struct os_mbuf *om, uint8_t flags, uint16_t seq)
+{
+    if (seq != 0 || (flags & (FRAME_FLAG_LAST | FRAME_FLAG_COMPRESSED)) != FRAME_FLAG_LAST) {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+
+    uint16_t tid = typing_engine_job_open(TYPING_LANE_INTERACTIVE);
+    if (tid == TYPING_JOB_NONE) {
+        return BLE_ATT_ERR_INSUFFICIENT_RES;
+    }
+    esp_err_t err = enqueue_mbuf_chain(om, FRAME_HEADER_LEN, tid);
+    if (err != ESP_OK) {
+        (void)typing_engine_job_cancel(tid);
+        return BLE_ATT_ERR_INSUFFICIENT_RES;   /* The client retries */
+    }
+    typing_engine_job_close(tid);
+    return 0;
+}
+
+static int handle_text_frame(const struct os_mbuf *om, uint16_t om_len)
+{
+    uint8_t hdr[FRAME_HEADER_LEN];
+
+    if (om_len < FRAME_HEADER_LEN ||
+        os_mbuf_copydata(om, 0, FRAME_HEADER_LEN, hdr) != 0) {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+
+    uint8_t flags = hdr[1];
+    uint16_t job = hdr[2] | (hdr[3] << 8);
+    uint16_t seq = hdr[4] | (hdr[5] << 8);
+    uint32_t crc = hdr[6] | (hdr[7] << 8) | (hdr[8] << 16) | ((uint32_t)hdr[9] << 24);
+    uint16_t payload_len = om_len - FRAME_HEADER_LEN;
+
+    uint32_t calc = esp_rom_crc32_le(0, hdr, FRAME_CRC_OFFSET);
+    calc = mbuf_crc32(om, FRAME_HEADER_LEN, calc);
+    if (calc != crc) {
+        /* The header itself may be damaged, so only ask again if it names
+         * the job in progress */
+        ESP_LOGW(TAG, "Job %u frame %u failed CRC", job, seq);
+        notify_frame_state(s_job_active && job == s_job_id ? seq : -1, false);
+        return 0;
+    }
+
+    if (flags & FRAME_FLAG_INTERACTIVE) {
+        return handle_interactive_frame(om, flags, seq);
+    }
+
+    if (!s_job_active || job != s_job_id) {
+        start_job(job);
+    }
+
+    uint16_t ahead = seq - s_job_next;
+    if (s_job_done || ahead >= 0x8000) {
+        /* Already delivered: acknowledge again, never type twice */
+        notify_frame_state(-1, false);
+        return 0;
+    }
+
+    if (ahead > 0) {
+        if (ahead < FRAME_REORDER_SLOTS) {
+            frame_slot_t *slot = &s_reorder[seq % FRAME_REORDER_SLOTS];
+            slot->used = true;
+            slot->flags = flags;
+            slot->seq = seq;
+            slot->len = payload_len;
+            os_mbuf_copydata(om, FRAME_HEADER_LEN, payload_len, slot->data);
+        }
+        /* Gap before this frame: ask for the first missing one */
+        notify_frame_state(s_job_next, false);
+        return 0;
+    }
+
+    esp_err_t err;
+    uint32_t rx_len = payload_len;
+    if (flags & FRAME_FLAG_COMPRESSED) {
+        os_mbuf_copydata(om, FRAME_HEADER_LEN, payload_len, s_frame_buf);
+        err = deliver_frame(flags, s_frame_buf, payload_len, &rx_len);
+    } else if (s_job_dropped) {
+        err = ESP_OK;
+    } else if (s_job_spooled) {
+        err = spool_mbuf_chain(om, FRAME_HEADER_LEN);
+    } else {
+        err = enqueue_mbuf_chain(om, FRAME_HEADER_LEN, s_job_tid);
+        if (job_cancelled(err)) {
+            err = ESP_OK;
+        }
+    }
+    if (err == ESP_ERR_INVALID_SIZE) {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+    if (err != ESP_OK) {
+        notify_frame_state(seq, true);
+        return BLE_ATT_ERR_INSUFFICIENT_RES;
+    }
+    advance_job(flags, rx_len);
+    drain_reorder_slots();
+    if (s_job_done) {
+        ESP_LOGI(TAG, "Text job %u complete (%u frames)", job, s_job_next);
+    }
+    notify_frame_state(-1, false);
+    return 0;
+}
+
 /* Text Input write */
 static int text_input_access_cb(uint16_t conn_handle, uint16_t attr_handle,
                                  struct ble_gatt_access_ctxt *ctxt, void *arg)
@@ -208,51 +934,123 @@ static int text_input_access_cb(uint16_t conn_handle, uint16_t attr_handle,
     if (om_len == 0) return 0;
     if (om_len > 512) return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
 
-    char buf[513];
-    int rc = ble_hs_mbuf_to_flat(ctxt->om, buf, om_len, NULL);
-    if (rc != 0) return BLE_ATT_ERR_UNLIKELY;
-    buf[om_len] = '\0';
+    note_link_activity();
 
-    ESP_LOGI(TAG, "Text input received (%d bytes)", om_len);
-    typing_engine_enqueue(buf, om_len);
+    if (ctxt->om->om_len > 0 && ctxt->om->om_data[0] == FRAME_MARKER) {
+        if (om_len > FRAME_HEADER_LEN + FRAME_MAX_PAYLOAD) {
+            return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+        }
+        return handle_text_frame(ctxt->om, om_len);
+    }
+
+    if (s_text_nacked) {
+        /* Pipelined behind a refused write: the client resends from there */
+        return BLE_ATT_ERR_INSUFFICIENT_RES;
+    }
+
+    ESP_LOGD(TAG, "Text input received (%d bytes)", om_len);
+    esp_err_t err = spool_accepting() ? spool_mbuf_chain(ctxt->om, 0)
+                                      : enqueue_mbuf_chain(ctxt->om, 0, TYPING_JOB_NONE);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Text input refused at offset %lu", (unsigned long)s_text_rx);
+        s_text_nacked = true;
+        notify_text_credit(true);
+        return BLE_ATT_ERR_INSUFFICIENT_RES;
+    }
+
+    s_text_rx += om_len;
+    notify_text_credit(false);
     return 0;
 }
 
-/* Status read */
+/* Snapshot of everything the status characteristics report */
+static void collect_status(status_bin_t *st)
+{
+    usb_hid_timing_stats_t timing;
+    usb_hid_get_timing_stats(&timing);
+
+    memset(st, 0, sizeof(*st));
+    if (typing_engine_is_typing()) st->flags |= STATUS_BIN_FLAG_TYPING;
+    if (s_authenticated) st->flags |= STATUS_BIN_FLAG_AUTHENTICATED;
+    if (usb_hid_connected()) st->flags |= STATUS_BIN_FLAG_KEYBOARD_CONNECTED;
+    if (auth_is_locked_out()) st->flags |= STATUS_BIN_FLAG_LOCKED_OUT;
+    if (spool_accepting()) st->flags |= STATUS_BIN_FLAG_SPOOLING;
+    st->auth_error = (uint8_t)s_auth_error;
+    st->queue = typing_engine_queue_length();
+    st->eta_ms = typing_engine_eta_ms();
+    st->retry_delay_ms = s_authenticated ? 0 : auth_get_retry_delay_ms();
+    st->rx = s_text_rx;
+    st->credit = text_credit();
+    st->mtu = s_conn_handle != BLE_HS_CONN_HANDLE_NONE ? ble_att_mtu(s_conn_handle) : 0;
+    st->phy = s_tx_phy;
+    st->dle = s_tx_octets;
+    st->link = (uint8_t)s_link_mode;
+    st->itvl_us = (uint32_t)s_conn_itvl * 1250;
+    st->latency = s_conn_latency;
+    st->usb_poll_ms = usb_hid_get_poll_interval_ms();
+    st->jitter_avg_us = timing.samples > 0
+        ? (uint32_t)(timing.total_abs_error_us / timing.samples) : 0;
+    st->jitter_max_us = timing.max_abs_error_us;
+    st->cmdq = s_cmd_queue ? (uint8_t)uxQueueSpacesAvailable(s_cmd_queue) : 0;
+    st->live_gaps = s_live_gaps;
+    st->job = s_job_id;
+    st->next = s_job_next;
+    st->current = s_progress_current;
+    st->total = s_progress_total;
+    st->tid = s_progress_tid;
+    st->spool = spool_pending();
+    st->rate_cpm = typing_engine_rate_cpm();
+    st->gap_us = typing_engine_get_gap_us();
+    st->tokens = typing_engine_get_rate_tokens();
+}
+
+/* Status read (JSON) */
 static int status_access_cb(uint16_t conn_handle, uint16_t attr_handle,
                              struct ble_gatt_access_ctxt *ctxt, void *arg)
 {
     if (ctxt->op != BLE_GATT_ACCESS_OP_READ_CHR) return BLE_ATT_ERR_UNLIKELY;
 
+    status_bin_t st;
+    collect_status(&st);
     const char *auth_error = auth_error_to_string(s_auth_error);
-    uint32_t retry_delay_ms = s_authenticated ? 0 : auth_get_retry_delay_ms();
-    bool locked_out = auth_is_locked_out();
 
-    char json[256];
-    int len;
-    if (auth_error != NULL) {
-        len = snprintf(json, sizeof(json),
-                       "{\"connected\":true,\"typing\":%s,\"queue\":%lu,"
-                       "\"authenticated\":%s,\"keyboard_connected\":%s,\"retry_delay_ms\":%lu,"
-                       "\"locked_out\":%s,\"auth_error\":\"%s\"}",
-                       typing_engine_is_typing() ? "true" : "false",
-                       (unsigned long)typing_engine_queue_length(),
-                       s_authenticated ? "true" : "false",
-                       usb_hid_connected() ? "true" : "false",
-                       (unsigned long)retry_delay_ms,
-                       locked_out ? "true" : "false",
-                       auth_error);
-    } else {
-        len = snprintf(json, sizeof(json),
-                       "{\"connected\":true,\"typing\":%s,\"queue\":%lu,"
+    /* Kept under the 512-byte attribute limit; settings are read from
+     * Typing Config */
+    char json[512];
+    int len = snprintf(json, sizeof(json),
+                       "{\"connected\":true,\"typing\":%s,\"queue\":%lu,\"eta_ms\":%lu,"
                        "\"authenticated\":%s,\"keyboard_connected\":%s,\"retry_delay_ms\":%lu,"
-                       "\"locked_out\":%s}",
-                       typing_engine_is_typing() ? "true" : "false",
-                       (unsigned long)typing_engine_queue_length(),
-                       s_authenticated ? "true" : "false",
-                       usb_hid_connected() ? "true" : "false",
-                       (unsigned long)retry_delay_ms,
-                       locked_out ? "true" : "false");
+                       "\"locked_out\":%s,\"usb_poll_ms\":%u,"
+                       "\"jitter_avg_us\":%lu,\"jitter_max_us\":%lu,"
+                       "\"rx\":%lu,\"credit\":%lu,\"mtu\":%u,\"phy\":%u,\"dle\":%u,"
+                       "\"link\":\"%s\",\"itvl_us\":%lu,\"latency\":%u,"
+                       "\"cmdq\":%u,\"live_gaps\":%lu,\"job\":%u,\"next\":%u,\"tid\":%u,"
+                       "\"compress\":\"lzss\"",
+                       (st.flags & STATUS_BIN_FLAG_TYPING) ? "true" : "false",
+                       (unsigned long)st.queue,
+                       (unsigned long)st.eta_ms,
+                       (st.flags & STATUS_BIN_FLAG_AUTHENTICATED) ? "true" : "false",
+                       (st.flags & STATUS_BIN_FLAG_KEYBOARD_CONNECTED) ? "true" : "false",
+                       (unsigned long)st.retry_delay_ms,
+                       (st.flags & STATUS_BIN_FLAG_LOCKED_OUT) ? "true" : "false",
+                       st.usb_poll_ms,
+                       (unsigned long)st.jitter_avg_us,
+                       (unsigned long)st.jitter_max_us,
+                       (unsigned long)st.rx, (unsigned long)st.credit, st.mtu,
+                       st.phy, st.dle, link_mode_to_string(s_link_mode),
+                       (unsigned long)st.itvl_us, st.latency, st.cmdq,
+                       (unsigned long)st.live_gaps, st.job, st.next, st.tid);
+    if (len > 0 && len < (int)sizeof(json) && spool_available()) {
+        len += snprintf(json + len, sizeof(json) - len, ",\"spool\":%lu,\"spooling\":%s",
+                        (unsigned long)st.spool,
+                        (st.flags & STATUS_BIN_FLAG_SPOOLING) ? "true" : "false");
+    }
+    if (len > 0 && len < (int)sizeof(json)) {
+        if (auth_error != NULL) {
+            len += snprintf(json + len, sizeof(json) - len, ",\"auth_error\":\"%s\"}", auth_error);
+        } else {
+            len += snprintf(json + len, sizeof(json) - len, "}");
+        }
     }
 
     if (len < 0 || len >= (int)sizeof(json)) {
@@ -263,39 +1061,240 @@ static int status_access_cb(uint16_t conn_handle, uint16_t attr_handle,
     return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
 }
 
-/* PIN Management write */
-static int pin_mgmt_access_cb(uint16_t conn_handle, uint16_t attr_handle,
-                               struct ble_gatt_access_ctxt *ctxt, void *arg)
+/* Binary status read: always the full record */
+static int status_bin_access_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                 struct ble_gatt_access_ctxt *ctxt, void *arg)
 {
-    if (ctxt->op != BLE_GATT_ACCESS_OP_WRITE_CHR) return BLE_ATT_ERR_UNLIKELY;
+    if (ctxt->op != BLE_GATT_ACCESS_OP_READ_CHR) return BLE_ATT_ERR_UNLIKELY;
 
-    uint16_t om_len = OS_MBUF_PKTLEN(ctxt->om);
-    if (om_len > 256) return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    status_bin_t st;
+    uint8_t record[STATUS_BIN_MAX_LEN];
+    collect_status(&st);
+    size_t len = status_bin_encode(&st, STATUS_BIN_ALL_FIELDS, record, sizeof(record));
+    if (len == 0) return BLE_ATT_ERR_UNLIKELY;
 
-    char buf[257];
-    int rc = ble_hs_mbuf_to_flat(ctxt->om, buf, om_len, NULL);
-    if (rc != 0) return BLE_ATT_ERR_UNLIKELY;
-    buf[om_len] = '\0';
+    int rc = os_mbuf_append(ctxt->om, record, len);
+    return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
 
-    cJSON *root = cJSON_Parse(buf);
-    if (!root) return BLE_ATT_ERR_UNLIKELY;
+/* Typing Config read (JSON): the settings that shape typing, including
+ * those taken from the current host's profile */
+static int typing_config_access_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                    struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    if (ctxt->op != BLE_GATT_ACCESS_OP_READ_CHR) return BLE_ATT_ERR_UNLIKELY;
+    if (!s_authenticated) return BLE_ATT_ERR_INSUFFICIENT_AUTHEN;
 
-    cJSON *action = cJSON_GetObjectItem(root, "action");
-    if (!action || !cJSON_IsString(action)) {
-        cJSON_Delete(root);
+    char json[512];
+    uint32_t host_fp;
+    host_os_t host_os;
+    int len = snprintf(json, sizeof(json),
+                       "{\"unicode\":\"%s\",\"layout\":\"%s\",\"typing_delay\":%u,"
+                       "\"hold_ms\":%u,\"host_profiles\":%s,\"pacing\":\"%s\","
+                       "\"rate_limit\":%u,\"rate_burst\":%u",
+                       key_stream_unicode_name(typing_engine_get_unicode_method()),
+                       typing_engine_get_layout(), typing_engine_get_delay_ms(),
+                       typing_engine_get_hold_ms(),
+                       host_id_is_enabled() ? "true" : "false",
+                       typing_engine_get_adaptive() ? "adaptive" : "fixed",
+                       typing_engine_get_rate_limit(), typing_engine_get_rate_burst());
+    if (len > 0 && len < (int)sizeof(json) && host_id_current(&host_fp, &host_os)) {
+        len += snprintf(json + len, sizeof(json) - len,
+                        ",\"host\":\"%s\",\"host_id\":\"%08lx\"",
+                        host_id_os_name(host_os), (unsigned long)host_fp);
+    }
+    /* Built-in layouts last, as many whole names as fit */
+    if (len > 0 && len < (int)sizeof(json)) {
+        len += snprintf(json + len, sizeof(json) - len, ",\"layouts\":\"");
+    }
+    for (size_t i = 0; i < KEYMAP_LAYOUT_COUNT && len > 0; i++) {
+        if (len + 1 + strlen(KEYMAP_LAYOUTS[i]->name) + 2 >= sizeof(json)) break;
+        len += snprintf(json + len, sizeof(json) - len, "%s%s", i > 0 ? "," : "",
+                        KEYMAP_LAYOUTS[i]->name);
+    }
+    if (len > 0 && len < (int)sizeof(json)) {
+        len += snprintf(json + len, sizeof(json) - len, "\"}");
+    }
+
+    if (len < 0 || len >= (int)sizeof(json)) {
         return BLE_ATT_ERR_UNLIKELY;
     }
 
-    if (strcmp(action->valuestring, "auth") == 0 ||
-        strcmp(action->valuestring, "verify") == 0) {
-        cJSON *pin = cJSON_GetObjectItem(root, "pin");
-        if (!pin || !cJSON_IsString(pin)) {
-            cJSON_Delete(root);
-            return BLE_ATT_ERR_UNLIKELY;
+    int rc = os_mbuf_append(ctxt->om, json, len);
+    return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
+/* Notify the fields that changed since the last binary record. Called from
+ * the host task, the command worker and the typing task. Returns false if
+ * a record was due but could not be sent. */
+static bool notify_status_bin(void)
+{
+    status_bin_t st;
+    uint8_t record[STATUS_BIN_MAX_LEN];
+
+    if (s_status_bin_lock == NULL) return false;
+    xSemaphoreTake(s_status_bin_lock, portMAX_DELAY);
+    collect_status(&st);
+    uint32_t mask = s_status_bin_synced
+        ? status_bin_diff(&s_status_bin_sent, &st) : STATUS_BIN_ALL_FIELDS;
+    size_t len = mask ? status_bin_encode(&st, mask, record, sizeof(record)) : 0;
+    bool sent = true;
+    if (len > 0 && s_conn_handle != BLE_HS_CONN_HANDLE_NONE) {
+        struct os_mbuf *om = ble_hs_mbuf_from_flat(record, len);
+        /* A lost record would leave the client's copy stale for good, so
+         * the next one goes out in full */
+        sent = om != NULL &&
+            ble_gatts_notify_custom(s_conn_handle, s_status_bin_val_handle, om) == 0;
+        s_status_bin_synced = sent;
+        s_status_bin_sent = st;
+    }
+    xSemaphoreGive(s_status_bin_lock);
+    return sent;
+}
+
+static void reset_status_bin(bool subscribed)
+{
+    if (s_status_bin_lock == NULL) return;
+    xSemaphoreTake(s_status_bin_lock, portMAX_DELAY);
+    s_status_bin_subscribed = subscribed;
+    s_status_bin_synced = false;
+    xSemaphoreGive(s_status_bin_lock);
+}
+
+/* Command worker: PIN management writes that commit to NVS, read the audit
+ * log or wait on USB are parsed in the access callback into a fixed-size
+ * record and executed here, off the NimBLE host task. Each one is answered
+ * with a {"cmd","ok"[,"error"]} status notification. */
+static void execute_set_config(const char *key, const char *value)
+{
+    int value_num = atoi(value);
+    /* Pacing, hold time and Unicode method belong to the host's profile
+     * when one is in effect, and are saved as defaults otherwise */
+    if (strcmp(key, "typing_delay") == 0) {
+        typing_engine_set_delay_ms((uint16_t)value_num);
+        if (host_id_save_profile() == ESP_ERR_INVALID_STATE) {
+            nvs_storage_set_u16("config", "typing_delay", typing_engine_get_delay_ms());
+        }
+    } else if (strcmp(key, "hold_ms") == 0) {
+        if (value_num >= 0 && value_num <= UINT8_MAX) {
+            typing_engine_set_hold_ms((uint8_t)value_num);
+            if (host_id_save_profile() == ESP_ERR_INVALID_STATE) {
+                nvs_storage_set_u8("config", "hold_ms", typing_engine_get_hold_ms());
+            }
+        }
+    } else if (strcmp(key, "rate_limit") == 0) {
+        if (value_num >= 0 && value_num <= UINT16_MAX) {
+            typing_engine_set_rate_limit((uint16_t)value_num, typing_engine_get_rate_burst());
+            nvs_storage_set_u16("config", "rate_limit", typing_engine_get_rate_limit());
+        }
+    } else if (strcmp(key, "rate_burst") == 0) {
+        if (value_num >= 0 && value_num <= UINT16_MAX) {
+            typing_engine_set_rate_limit(typing_engine_get_rate_limit(), (uint16_t)value_num);
+            nvs_storage_set_u16("config", "rate_burst", typing_engine_get_rate_burst());
+        }
+    } else if (strcmp(key, "pacing") == 0) {
+        bool adaptive = strcmp(value, "adaptive") == 0;
+        typing_engine_set_adaptive(adaptive);
+        nvs_storage_set_u8("config", "adaptive", adaptive);
+    } else if (strcmp(key, "host_profiles") == 0) {
+        host_id_set_enabled(value_num != 0);
+        nvs_storage_set_u8("config", "host_profiles", value_num != 0);
+    } else if (strcmp(key, "led_brightness") == 0) {
+        neopixel_set_brightness((uint8_t)value_num);
+        nvs_storage_set_u8("config", "led_brightness", (uint8_t)value_num);
+    } else if (strcmp(key, "batch_keys") == 0) {
+        typing_engine_set_batch_keys((uint8_t)value_num);
+        nvs_storage_set_u8("config", "batch_keys", typing_engine_get_batch_keys());
+    } else if (strcmp(key, "hid_mode") == 0) {
+        typing_hid_mode_t mode = strcmp(value, "nkro") == 0 ? TYPING_HID_NKRO : TYPING_HID_BOOT;
+        typing_engine_set_hid_mode(mode);
+        nvs_storage_set_u8("config", "hid_mode", (uint8_t)mode);
+    } else if (strcmp(key, "usb_poll_ms") == 0) {
+        if (value_num > 0 && value_num <= UINT8_MAX &&
+            usb_hid_set_poll_interval_ms((uint8_t)value_num) == ESP_OK) {
+            nvs_storage_set_u8("config", "usb_poll_ms", (uint8_t)value_num);
+        }
+    } else if (strcmp(key, "progress_ms") == 0) {
+        if (value_num >= 0 && value_num <= UINT16_MAX) {
+            s_progress_ms = (uint16_t)value_num;
+            nvs_storage_set_u16("config", "progress_ms", s_progress_ms);
+        }
+    } else if (strcmp(key, "progress_chars") == 0) {
+        if (value_num >= 0 && value_num <= UINT16_MAX) {
+            s_progress_chars = (uint16_t)value_num;
+            nvs_storage_set_u16("config", "progress_chars", s_progress_chars);
+        }
+    } else if (strcmp(key, "spool") == 0) {
+        spool_set_enabled(value_num != 0);
+        nvs_storage_set_u8("config", "spool", value_num != 0);
+    } else if (strcmp(key, "layout") == 0) {
+        if (typing_engine_set_layout(value) == ESP_OK) {
+            nvs_storage_set_str("config", "layout", value);
+        }
+    } else if (strcmp(key, "unicode") == 0) {
+        key_stream_unicode_t unicode;
+        if (key_stream_unicode_parse(value, &unicode)) {
+            typing_engine_set_unicode_method(unicode);
+            if (host_id_save_profile() == ESP_ERR_INVALID_STATE) {
+                nvs_storage_set_u8("config", "unicode", (uint8_t)unicode);
+            }
+        }
+    }
+}
+
+static void notify_cmd_result(const char *cmd, const char *error)
+{
+    if (s_conn_handle == BLE_HS_CONN_HANDLE_NONE) return;
+
+    char json[80];
+    int len;
+    if (error != NULL) {
+        len = snprintf(json, sizeof(json), "{\"cmd\":\"%s\",\"ok\":false,\"error\":\"%s\"}",
+                       cmd, error);
+    } else {
+        len = snprintf(json, sizeof(json), "{\"cmd\":\"%s\",\"ok\":true}", cmd);
+    }
+
+    struct os_mbuf *om = ble_hs_mbuf_from_flat(json, len);
+    if (om) {
+        ble_gatts_notify_custom(s_conn_handle, s_status_val_handle, om);
+    }
+}
+
+static const char *cmd_type_to_string(ble_cmd_type_t type)
+{
+    switch (type) {
+    case BLE_CMD_AUTH:
+        return "auth";
+    case BLE_CMD_SET_PIN:
+        return "set";
+    case BLE_CMD_SET_CONFIG:
+        return "set_config";
+    case BLE_CMD_GET_LOGS:
+        return "get_logs";
+    case BLE_CMD_KEY_COMBO:
+        return "key_combo";
+    default:
+        return "unknown";
+    }
+}
+
+/* Returns NULL on success or a short error code for the result notification */
+static const char *execute_cmd(const ble_cmd_t *cmd)
+{
+    if (cmd->type == BLE_CMD_AUTH) {
+        auth_result_t result = auth_verify_pin(cmd->auth.pin);
+        bool applied = false;
+
+        /* Only apply the verdict to the session that asked for it */
+        portENTER_CRITICAL(&s_session_mux);
+        if (cmd->session == s_session) {
+            set_session_auth_result(result);
+            if (s_auth_queued > 0) s_auth_queued--;
+            applied = true;
         }
+        portEXIT_CRITICAL(&s_session_mux);
 
-        auth_result_t result = auth_verify_pin(pin->valuestring);
-        set_session_auth_result(result);
         if (result == AUTH_OK) {
             audit_log_event(AUDIT_AUTH_ATTEMPT, "transport=ble result=success");
             ESP_LOGI(TAG, "BLE session authenticated");
@@ -303,68 +1302,38 @@ static int pin_mgmt_access_cb(uint16_t conn_handle, uint16_t attr_handle,
             audit_log_event(AUDIT_AUTH_ATTEMPT, "transport=ble result=fail");
             ESP_LOGW(TAG, "BLE session auth failed: result=%d", (int)result);
         }
-        notify_status_if_connected();
-    } else if (strcmp(action->valuestring, "logout") == 0) {
-        reset_session_auth();
-        notify_status_if_connected();
-        ESP_LOGI(TAG, "BLE session logged out");
-    } else if (strcmp(action->valuestring, "set") == 0) {
-        if (!s_authenticated) {
-            cJSON_Delete(root);
-            return BLE_ATT_ERR_INSUFFICIENT_AUTHEN;
-        }
-
-        cJSON *old_pin = cJSON_GetObjectItem(root, "old");
-        cJSON *new_pin = cJSON_GetObjectItem(root, "new");
-
-        if (old_pin && new_pin && cJSON_IsString(old_pin) && cJSON_IsString(new_pin)) {
-            auth_result_t result = auth_set_pin(old_pin->valuestring, new_pin->valuestring);
-            if (result == AUTH_OK) {
-                /* Update BLE passkey */
-                uint32_t new_passkey = (uint32_t)atoi(new_pin->valuestring);
-                ble_security_set_passkey(new_passkey);
-                audit_log_event(AUDIT_PIN_CHANGE, "transport=ble");
-                ESP_LOGI(TAG, "PIN changed via BLE");
-            } else {
-                audit_log_event(AUDIT_AUTH_ATTEMPT, "transport=ble result=fail action=pin_change");
-                ESP_LOGW(TAG, "PIN change failed: result=%d", (int)result);
-            }
-        }
-    } else if (strcmp(action->valuestring, "set_config") == 0) {
-        if (!s_authenticated) {
-            cJSON_Delete(root);
-            return BLE_ATT_ERR_INSUFFICIENT_AUTHEN;
+        if (!applied) {
+            return "stale";
         }
+        notify_status_if_connected();
+        return result == AUTH_OK ? NULL : auth_error_to_string(s_auth_error);
+    }
 
-        cJSON *key = cJSON_GetObjectItem(root, "key");
-        cJSON *value = cJSON_GetObjectItem(root, "value");
-        if (key && value && cJSON_IsString(key) && cJSON_IsString(value)) {
-            int value_num = atoi(value->valuestring);
-            if (strcmp(key->valuestring, "typing_delay") == 0) {
-                typing_engine_set_delay_ms((uint16_t)value_num);
-                nvs_storage_set_u16("config", "typing_delay", (uint16_t)value_num);
-            } else if (strcmp(key->valuestring, "led_brightness") == 0) {
-                neopixel_set_brightness((uint8_t)value_num);
-                nvs_storage_set_u8("config", "led_brightness", (uint8_t)value_num);
-            }
-        } else {
-            cJSON *delay = cJSON_GetObjectItem(root, "typing_delay");
-            if (delay && cJSON_IsNumber(delay)) {
-                typing_engine_set_delay_ms((uint16_t)delay->valueint);
-                nvs_storage_set_u16("config", "typing_delay", (uint16_t)delay->valueint);
-            }
-            cJSON *brightness = cJSON_GetObjectItem(root, "led_brightness");
-            if (brightness && cJSON_IsNumber(brightness)) {
-                neopixel_set_brightness((uint8_t)brightness->valueint);
-                nvs_storage_set_u8("config", "led_brightness", (uint8_t)brightness->valueint);
-            }
-        }
-    } else if (strcmp(action->valuestring, "get_logs") == 0) {
-        if (!s_authenticated) {
-            cJSON_Delete(root);
-            return BLE_ATT_ERR_INSUFFICIENT_AUTHEN;
+    /* Everything else needs the session to be authenticated by now */
+    if (!s_authenticated) {
+        return "unauthenticated";
+    }
+
+    switch (cmd->type) {
+    case BLE_CMD_SET_PIN: {
+        auth_result_t result = auth_set_pin(cmd->set_pin.old_pin, cmd->set_pin.new_pin);
+        if (result != AUTH_OK) {
+            audit_log_event(AUDIT_AUTH_ATTEMPT, "transport=ble result=fail action=pin_change");
+            ESP_LOGW(TAG, "PIN change failed: result=%d", (int)result);
+            return "rejected";
         }
+        /* Update BLE passkey */
+        ble_security_set_passkey((uint32_t)atoi(cmd->set_pin.new_pin));
+        audit_log_event(AUDIT_PIN_CHANGE, "transport=ble");
+        ESP_LOGI(TAG, "PIN changed via BLE");
+        return NULL;
+    }
+
+    case BLE_CMD_SET_CONFIG:
+        execute_set_config(cmd->config.key, cmd->config.value);
+        return NULL;
 
+    case BLE_CMD_GET_LOGS: {
         /* Send audit log via status notification */
         char log_buf[512];
         size_t log_len = audit_log_get_entries(log_buf, sizeof(log_buf));
@@ -374,40 +1343,269 @@ static int pin_mgmt_access_cb(uint16_t conn_handle, uint16_t attr_handle,
                 ble_gatts_notify_custom(s_conn_handle, s_status_val_handle, om);
             }
         }
-    } else if (strcmp(action->valuestring, "abort") == 0) {
-        if (!s_authenticated) {
-            cJSON_Delete(root);
-            return BLE_ATT_ERR_INSUFFICIENT_AUTHEN;
+        return NULL;
+    }
+
+    case BLE_CMD_KEY_COMBO:
+        if (send_key_combo(cmd->key_combo.modifier, cmd->key_combo.keycode) != ESP_OK) {
+            return "usb_unavailable";
         }
-        typing_engine_abort();
-    } else if (strcmp(action->valuestring, "key_combo") == 0) {
-        if (!s_authenticated) {
-            cJSON_Delete(root);
-            return BLE_ATT_ERR_INSUFFICIENT_AUTHEN;
+        return NULL;
+
+    default:
+        return "unknown";
+    }
+}
+
+static void cmd_worker_task(void *param)
+{
+    ble_cmd_t cmd;
+
+    while (1) {
+        if (xQueueReceive(s_cmd_queue, &cmd, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        if (cmd.session != s_session) {
+            continue;   /* Queued by a connection that has since gone */
         }
+        const char *error = execute_cmd(&cmd);
+        if (cmd.session == s_session) {
+            notify_cmd_result(cmd_type_to_string(cmd.type), error);
+        }
+    }
+}
 
+static int queue_cmd(ble_cmd_t *cmd)
+{
+    cmd->session = s_session;
+    if (xQueueSend(s_cmd_queue, cmd, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Command queue full, refusing %s", cmd_type_to_string(cmd->type));
+        return BLE_ATT_ERR_INSUFFICIENT_RES;
+    }
+    return 0;
+}
+
+static bool copy_json_string(const cJSON *item, char *dst, size_t size)
+{
+    if (!item || !cJSON_IsString(item) || strlen(item->valuestring) >= size) {
+        return false;
+    }
+    strcpy(dst, item->valuestring);
+    return true;
+}
+
+/* Queue legacy {"typing_delay":N,"led_brightness":N} set_config fields as
+ * one key/value record each */
+static int queue_legacy_config(const cJSON *root)
+{
+    static const char *const keys[] = { "typing_delay", "led_brightness" };
+
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        cJSON *item = cJSON_GetObjectItem(root, keys[i]);
+        if (!item || !cJSON_IsNumber(item)) continue;
+
+        ble_cmd_t cmd = { .type = BLE_CMD_SET_CONFIG };
+        strcpy(cmd.config.key, keys[i]);
+        snprintf(cmd.config.value, sizeof(cmd.config.value), "%d", item->valueint);
+        int rc = queue_cmd(&cmd);
+        if (rc != 0) return rc;
+    }
+    return 0;
+}
+
+/* Commands that need an authenticated session are refused inline, as
+ * before they were queued, unless an auth ahead of them may still grant
+ * it; the worker then checks again */
+static bool auth_possible(void)
+{
+    portENTER_CRITICAL(&s_session_mux);
+    bool possible = s_authenticated || s_auth_queued > 0;
+    portEXIT_CRITICAL(&s_session_mux);
+    return possible;
+}
+
+/* Validate a PIN management write and either handle it inline (cheap,
+ * order-sensitive actions) or queue it for the command worker. Malformed
+ * and unauthenticated writes are still refused with an ATT error. */
+static int route_pin_action(const cJSON *root)
+{
+    cJSON *action = cJSON_GetObjectItem(root, "action");
+    if (!action || !cJSON_IsString(action)) {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+
+    ble_cmd_t cmd = { 0 };
+    if (strcmp(action->valuestring, "auth") == 0 ||
+        strcmp(action->valuestring, "verify") == 0) {
+        cmd.type = BLE_CMD_AUTH;
+        if (!copy_json_string(cJSON_GetObjectItem(root, "pin"), cmd.auth.pin,
+                              sizeof(cmd.auth.pin))) {
+            return BLE_ATT_ERR_UNLIKELY;
+        }
+        /* Counted first: the worker may verify it before queue_cmd returns */
+        portENTER_CRITICAL(&s_session_mux);
+        s_auth_queued++;
+        portEXIT_CRITICAL(&s_session_mux);
+        int rc = queue_cmd(&cmd);
+        if (rc != 0) {
+            portENTER_CRITICAL(&s_session_mux);
+            if (s_auth_queued > 0) s_auth_queued--;
+            portEXIT_CRITICAL(&s_session_mux);
+        }
+        return rc;
+    } else if (strcmp(action->valuestring, "logout") == 0) {
+        begin_session();    /* Also drops anything still queued, e.g. an auth */
+        notify_status_if_connected();
+        ESP_LOGI(TAG, "BLE session logged out");
+        return 0;
+    } else if (strcmp(action->valuestring, "set") == 0) {
+        if (!auth_possible()) return BLE_ATT_ERR_INSUFFICIENT_AUTHEN;
+        cmd.type = BLE_CMD_SET_PIN;
+        if (!copy_json_string(cJSON_GetObjectItem(root, "old"), cmd.set_pin.old_pin,
+                              sizeof(cmd.set_pin.old_pin)) ||
+            !copy_json_string(cJSON_GetObjectItem(root, "new"), cmd.set_pin.new_pin,
+                              sizeof(cmd.set_pin.new_pin))) {
+            return 0;   /* Incomplete PIN change requests were always ignored */
+        }
+        return queue_cmd(&cmd);
+    } else if (strcmp(action->valuestring, "set_config") == 0) {
+        if (!auth_possible()) return BLE_ATT_ERR_INSUFFICIENT_AUTHEN;
+        cJSON *key = cJSON_GetObjectItem(root, "key");
+        cJSON *value = cJSON_GetObjectItem(root, "value");
+        if (!key && !value) {
+            return queue_legacy_config(root);
+        }
+        cmd.type = BLE_CMD_SET_CONFIG;
+        if (!copy_json_string(key, cmd.config.key, sizeof(cmd.config.key)) ||
+            !copy_json_string(value, cmd.config.value, sizeof(cmd.config.value))) {
+            return BLE_ATT_ERR_UNLIKELY;
+        }
+        return queue_cmd(&cmd);
+    } else if (strcmp(action->valuestring, "get_logs") == 0) {
+        if (!auth_possible()) return BLE_ATT_ERR_INSUFFICIENT_AUTHEN;
+        cmd.type = BLE_CMD_GET_LOGS;
+        return queue_cmd(&cmd);
+    } else if (strcmp(action->valuestring, "abort") == 0) {
+        if (!s_authenticated) return BLE_ATT_ERR_INSUFFICIENT_AUTHEN;
+        typing_engine_abort();
+        typing_engine_reset_input();
+        spool_discard();
+        if (s_job_active && !s_job_done && s_job_spooled) {
+            s_job_dropped = true;
+        }
+        return 0;
+    } else if (strcmp(action->valuestring, "cancel") == 0) {
+        if (!s_authenticated) return BLE_ATT_ERR_INSUFFICIENT_AUTHEN;
+        cJSON *tid = cJSON_GetObjectItem(root, "tid");
+        if (!tid || !cJSON_IsNumber(tid) || tid->valueint <= TYPING_JOB_NONE ||
+            tid->valueint > UINT16_MAX) {
+            return BLE_ATT_ERR_UNLIKELY;
+        }
+        /* Already finished is not an error: the job is gone either way */
+        (void)typing_engine_job_cancel((uint16_t)tid->valueint);
+        return 0;
+    } else if (strcmp(action->valuestring, "text_resume") == 0) {
+        if (!s_authenticated) return BLE_ATT_ERR_INSUFFICIENT_AUTHEN;
+        s_text_nacked = false;
+        notify_text_credit(false);
+        return 0;
+    } else if (strcmp(action->valuestring, "key_combo") == 0) {
+        if (!auth_possible()) return BLE_ATT_ERR_INSUFFICIENT_AUTHEN;
         cJSON *modifier = cJSON_GetObjectItem(root, "modifier");
         cJSON *keycode = cJSON_GetObjectItem(root, "keycode");
         if (!modifier || !cJSON_IsNumber(modifier) || !keycode || !cJSON_IsNumber(keycode)) {
-            cJSON_Delete(root);
             return BLE_ATT_ERR_UNLIKELY;
         }
 
         int mod = modifier->valueint;
         int key = keycode->valueint;
         if (mod < 0 || mod > 255 || key < 0 || key > 255) {
-            cJSON_Delete(root);
-            return BLE_ATT_ERR_UNLIKELY;
-        }
-
-        esp_err_t combo_err = send_key_combo((uint8_t)mod, (uint8_t)key);
-        if (combo_err != ESP_OK) {
-            cJSON_Delete(root);
             return BLE_ATT_ERR_UNLIKELY;
         }
+        cmd.type = BLE_CMD_KEY_COMBO;
+        cmd.key_combo.modifier = (uint8_t)mod;
+        cmd.key_combo.keycode = (uint8_t)key;
+        return queue_cmd(&cmd);
     }
+    return 0;
+}
+
+/* PIN Management write */
+static int pin_mgmt_access_cb(uint16_t conn_handle, uint16_t attr_handle,
+                               struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    if (ctxt->op != BLE_GATT_ACCESS_OP_WRITE_CHR) return BLE_ATT_ERR_UNLIKELY;
+
+    uint16_t om_len = OS_MBUF_PKTLEN(ctxt->om);
+    if (om_len > 256) return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+
+    char buf[257];
+    int rc = ble_hs_mbuf_to_flat(ctxt->om, buf, om_len, NULL);
+    if (rc != 0) return BLE_ATT_ERR_UNLIKELY;
+    buf[om_len] = '\0';
+
+    cJSON *root = cJSON_Parse(buf);
+    if (!root) return BLE_ATT_ERR_UNLIKELY;
 
+    rc = route_pin_action(root);
     cJSON_Delete(root);
+    return rc;
+}
+
+/* Live Keys write */
+static int live_keys_access_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    if (ctxt->op != BLE_GATT_ACCESS_OP_WRITE_CHR) return BLE_ATT_ERR_UNLIKELY;
+    if (!s_authenticated) return BLE_ATT_ERR_INSUFFICIENT_AUTHEN;
+
+    uint8_t buf[1 + LIVE_MAX_EVENTS * 2];
+    uint16_t om_len = OS_MBUF_PKTLEN(ctxt->om);
+    if (om_len < 1 || om_len > sizeof(buf) || (om_len - 1) % 2 != 0) {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+    if (ble_hs_mbuf_to_flat(ctxt->om, buf, om_len, NULL) != 0) {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+
+    note_link_activity();
+
+    uint8_t seq = buf[0];
+    if (s_live_seq_valid) {
+        if (seq == s_live_seq) {
+            return 0;   /* Duplicate */
+        }
+        if (seq != (uint8_t)(s_live_seq + 1)) {
+            ESP_LOGW(TAG, "Live key gap: expected %u, got %u", (uint8_t)(s_live_seq + 1), seq);
+            s_live_gaps++;
+            usb_hid_live_release();
+        }
+    }
+    s_live_seq = seq;
+    s_live_seq_valid = true;
+
+    for (uint16_t i = 1; i < om_len; i += 2) {
+        esp_err_t err = ESP_OK;
+        switch (buf[i]) {
+        case LIVE_EVENT_DOWN:
+            err = usb_hid_live_key(buf[i + 1], true);
+            break;
+        case LIVE_EVENT_UP:
+            err = usb_hid_live_key(buf[i + 1], false);
+            break;
+        case LIVE_EVENT_RELEASE:
+            usb_hid_live_release();
+            break;
+        default:
+            break;
+        }
+        if (err == ESP_ERR_TIMEOUT) {
+            /* Lane full: dropping a key-up could leave it stuck */
+            ESP_LOGW(TAG, "Live key lane full, releasing all");
+            usb_hid_live_release();
+            return BLE_ATT_ERR_INSUFFICIENT_RES;
+        }
+    }
     return 0;
 }
 
@@ -435,34 +1633,139 @@ static int cert_fp_access_cb(uint16_t conn_handle, uint16_t attr_handle,
     return 0;
 }
 
-/* Typing progress callback — called from typing engine task */
-static void on_typing_progress(uint32_t current, uint32_t total)
+static bool send_progress(const typing_progress_t *progress)
 {
-    if (s_conn_handle == BLE_HS_CONN_HANDLE_NONE) return;
+    if (s_status_bin_subscribed) {
+        return notify_status_bin();
+    }
 
-    bool typing_active = current < total;
-    char json[64];
+    bool typing_active = !progress->done || typing_engine_queue_length() > 0;
+    uint32_t rx = s_text_rx;
+    char json[160];
+    /* Credit rides along so the client's window reopens as typing drains */
     int len = snprintf(json, sizeof(json),
-                       "{\"typing\":%s,\"current\":%lu,\"total\":%lu}",
+                       "{\"typing\":%s,\"current\":%lu,\"total\":%lu,\"eta_ms\":%lu,"
+                       "\"rx\":%lu,\"credit\":%lu,\"tid\":%u%s}",
                        typing_active ? "true" : "false",
-                       (unsigned long)current,
-                       (unsigned long)total);
+                       (unsigned long)progress->typed,
+                       (unsigned long)progress->total,
+                       (unsigned long)typing_engine_eta_ms(),
+                       (unsigned long)rx,
+                       (unsigned long)text_credit(),
+                       progress->job,
+                       progress->cancelled ? ",\"cancelled\":true" : "");
 
     struct os_mbuf *om = ble_hs_mbuf_from_flat(json, len);
-    if (om) {
-        ble_gatts_notify_custom(s_conn_handle, s_status_val_handle, om);
+    return om != NULL && ble_gatts_notify_custom(s_conn_handle, s_status_val_handle, om) == 0;
+}
+
+/* Typing progress callback — called from typing engine task */
+static void on_typing_progress(const typing_progress_t *progress)
+{
+    s_progress_current = progress->typed;
+    s_progress_total = progress->total;
+    s_progress_tid = progress->job;
+    if (s_conn_handle == BLE_HS_CONN_HANDLE_NONE) return;
+
+    bool final = progress->done;
+    int64_t now = esp_timer_get_time();
+    if (!final) {
+        bool due = progress->job != s_progress_sent_tid ||
+                   now - s_progress_sent_us >= (int64_t)s_progress_ms * 1000 ||
+                   (s_progress_chars > 0 &&
+                    progress->typed - s_progress_sent_current >= s_progress_chars);
+        if (!due) return;
+        if (os_msys_num_free() < PROGRESS_MIN_FREE_MBUFS) {
+            s_progress_deferred++;
+            return;
+        }
+    }
+
+    /* The completion event must arrive: if the host is out of mbufs, leave
+     * it to the host task rather than waiting here */
+    bool sent = send_progress(progress);
+    if (final) {
+        portENTER_CRITICAL(&s_progress_final_mux);
+        s_progress_final = *progress;
+        s_progress_final_pending = !sent;
+        portEXIT_CRITICAL(&s_progress_final_mux);
+        if (!sent) {
+            ESP_LOGD(TAG, "Completion notification for job %u deferred", progress->job);
+        }
+    }
+    if (sent) {
+        s_progress_sent_us = now;
+        s_progress_sent_current = progress->typed;
+        s_progress_sent_tid = progress->job;
     }
 
-    /* Notify when typing is complete */
-    if (current >= total) {
+    if (final && typing_engine_queue_length() == 0) {
+        if (s_progress_deferred > 0) {
+            ESP_LOGD(TAG, "%lu progress updates deferred for low mbufs",
+                     (unsigned long)s_progress_deferred);
+            s_progress_deferred = 0;
+        }
         neopixel_set_state(LED_STATE_BLE_CONNECTED);
     }
 }
 
-/* GAP event handler */
+/* Host task: send a deferred completion once mbufs may be free again (a
+ * notification went out, a client subscribed, or the link policy ticked) */
+static void flush_progress_final(void)
+{
+    typing_progress_t progress;
+
+    if (!s_progress_final_pending || s_conn_handle == BLE_HS_CONN_HANDLE_NONE) return;
+    portENTER_CRITICAL(&s_progress_final_mux);
+    progress = s_progress_final;
+    s_progress_final_pending = false;
+    portEXIT_CRITICAL(&s_progress_final_mux);
+
+    if (send_progress(&progress)) return;
+    portENTER_CRITICAL(&s_progress_final_mux);
+    /* Unless the typing task has since stored a newer one */
+    if (!s_progress_final_pending && s_progress_final.job == progress.job) {
+        s_progress_final_pending = true;
+    }
+    portEXIT_CRITICAL(&s_progress_final_mux);
+}
+
+/* Link negotiation */
+static int on_mtu_exchanged(uint16_t conn_handle, const struct ble_gatt_error *error,
+                            uint16_t mtu, void *arg)
+{
+    if (error->status != 0) {
+        ESP_LOGW(TAG, "MTU exchange failed: status=%d", error->status);
+    }
+    return 0;
+}
+
+/* Ask for the fastest link the central will agree to: 2M PHY, full-size
+ * LL packets and a large ATT MTU. Results arrive as GAP events. */
+static void negotiate_link(uint16_t conn_handle)
+{
+    s_tx_phy = BLE_GAP_LE_PHY_1M;
+    s_tx_octets = 27;
+
+    int rc = ble_gap_set_prefered_le_phy(conn_handle, BLE_GAP_LE_PHY_2M_MASK,
+                                         BLE_GAP_LE_PHY_2M_MASK, 0);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "2M PHY request failed: rc=%d", rc);
+    }
+    rc = ble_gap_set_data_len(conn_handle, PREFERRED_TX_OCTETS, PREFERRED_TX_TIME_US);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "Data length request failed: rc=%d", rc);
+    }
+    rc = ble_gattc_exchange_mtu(conn_handle, on_mtu_exchanged, NULL);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "MTU exchange request failed: rc=%d", rc);
+    }
+}
+
 static int gap_event_handler(struct ble_gap_event *event, void *arg);
 static void start_advertising(void);
 
+/* GAP event handler */
 static int gap_event_handler(struct ble_gap_event *event, void *arg)
 {
     /* Delegate security events */
@@ -477,10 +1780,13 @@ static int gap_event_handler(struct ble_gap_event *event, void *arg)
     case BLE_GAP_EVENT_CONNECT:
         if (event->connect.status == 0) {
             s_conn_handle = event->connect.conn_handle;
-            reset_session_auth();
+            begin_session();
+            reset_text_flow();
             neopixel_set_state(LED_STATE_BLE_CONNECTED);
             audit_log_event(AUDIT_BLE_CONNECT, NULL);
             ESP_LOGI(TAG, "BLE connected (handle=%d)", s_conn_handle);
+            negotiate_link(s_conn_handle);
+            link_policy_start();
         } else {
             ESP_LOGW(TAG, "BLE connection failed: status=%d", event->connect.status);
             start_advertising();
@@ -490,7 +1796,12 @@ static int gap_event_handler(struct ble_gap_event *event, void *arg)
     case BLE_GAP_EVENT_DISCONNECT:
         ESP_LOGI(TAG, "BLE disconnected (reason=%d)", event->disconnect.reason);
         s_conn_handle = BLE_HS_CONN_HANDLE_NONE;
-        reset_session_auth();
+        s_progress_final_pending = false;
+        ble_npl_callout_stop(&s_link_timer);
+        s_link_mode = LINK_MODE_NONE;
+        reset_status_bin(false);
+        begin_session();
+        reset_text_flow();
         neopixel_set_state(LED_STATE_OFF);
         audit_log_event(AUDIT_BLE_DISCONNECT, NULL);
         start_advertising();
@@ -500,14 +1811,56 @@ static int gap_event_handler(struct ble_gap_event *event, void *arg)
         start_advertising();
         break;
 
+    case BLE_GAP_EVENT_CONN_UPDATE:
+        s_link_pending = false;
+        if (event->conn_update.status != 0) {
+            ESP_LOGW(TAG, "Connection update failed: status=%d", event->conn_update.status);
+            s_link_mode = LINK_MODE_NONE;
+        }
+        read_conn_params();
+        ESP_LOGI(TAG, "Connection params: interval=%u.%02u ms latency=%u",
+                 s_conn_itvl * 125 / 100, s_conn_itvl * 125 % 100, s_conn_latency);
+        notify_status_if_connected();
+        break;
+
     case BLE_GAP_EVENT_MTU:
         ESP_LOGI(TAG, "MTU updated: conn=%d, mtu=%d",
                  event->mtu.conn_handle, event->mtu.value);
+        notify_status_if_connected();
         break;
 
+    case BLE_GAP_EVENT_PHY_UPDATE_COMPLETE:
+        if (event->phy_updated.status == 0) {
+            s_tx_phy = event->phy_updated.tx_phy;
+        }
+        ESP_LOGI(TAG, "PHY update: status=%d tx=%d rx=%d", event->phy_updated.status,
+                 event->phy_updated.tx_phy, event->phy_updated.rx_phy);
+        notify_status_if_connected();
+        break;
+
+#ifdef BLE_GAP_EVENT_DATA_LEN_CHG
+    case BLE_GAP_EVENT_DATA_LEN_CHG:
+        s_tx_octets = event->data_len_chg.max_tx_octets;
+        ESP_LOGI(TAG, "Data length: tx=%u rx=%u octets",
+                 event->data_len_chg.max_tx_octets, event->data_len_chg.max_rx_octets);
+        notify_status_if_connected();
+        break;
+#endif
+
     case BLE_GAP_EVENT_SUBSCRIBE:
         ESP_LOGI(TAG, "Subscribe event: handle=%d, cur_notify=%d",
                  event->subscribe.attr_handle, event->subscribe.cur_notify);
+        if (event->subscribe.attr_handle == s_status_bin_val_handle) {
+            reset_status_bin(event->subscribe.cur_notify);
+        }
+        flush_progress_final();
+        break;
+
+    case BLE_GAP_EVENT_NOTIFY_TX:
+        /* A notification went out, so its mbufs are back in the pool */
+        if (event->notify_tx.status == 0) {
+            flush_progress_final();
+        }
         break;
 
     default:
@@ -588,6 +1941,8 @@ esp_err_t ble_server_init(void)
 
     /* Set device name */
     ble_svc_gap_device_name_set(DEVICE_NAME);
+    ble_att_set_preferred_mtu(PREFERRED_ATT_MTU);
+    ble_npl_callout_init(&s_link_timer, nimble_port_get_dflt_eventq(), link_timer_cb, NULL);
 
     /* Initialize security */
     ble_security_init();
@@ -622,10 +1977,62 @@ esp_err_t ble_server_init(void)
     if (nvs_storage_get_u16("config", "typing_delay", &delay) == ESP_OK && delay > 0) {
         typing_engine_set_delay_ms(delay);
     }
+    uint8_t hold_ms = 0;
+    if (nvs_storage_get_u8("config", "hold_ms", &hold_ms) == ESP_OK) {
+        typing_engine_set_hold_ms(hold_ms);
+    }
+    uint8_t adaptive = 0;
+    if (nvs_storage_get_u8("config", "adaptive", &adaptive) == ESP_OK) {
+        typing_engine_set_adaptive(adaptive != 0);
+    }
+    uint16_t rate_limit = typing_engine_get_rate_limit();
+    uint16_t rate_burst = typing_engine_get_rate_burst();
+    nvs_storage_get_u16("config", "rate_limit", &rate_limit);
+    nvs_storage_get_u16("config", "rate_burst", &rate_burst);
+    typing_engine_set_rate_limit(rate_limit, rate_burst);
     uint8_t brightness = 0;
     if (nvs_storage_get_u8("config", "led_brightness", &brightness) == ESP_OK && brightness > 0) {
         neopixel_set_brightness(brightness);
     }
+    uint8_t batch_keys = 0;
+    if (nvs_storage_get_u8("config", "batch_keys", &batch_keys) == ESP_OK && batch_keys > 0) {
+        typing_engine_set_batch_keys(batch_keys);
+    }
+    uint8_t hid_mode = 0;
+    if (nvs_storage_get_u8("config", "hid_mode", &hid_mode) == ESP_OK) {
+        typing_engine_set_hid_mode((typing_hid_mode_t)hid_mode);
+    }
+    nvs_storage_get_u16("config", "progress_ms", &s_progress_ms);
+    nvs_storage_get_u16("config", "progress_chars", &s_progress_chars);
+    uint8_t spool = 0;
+    if (nvs_storage_get_u8("config", "spool", &spool) == ESP_OK) {
+        spool_set_enabled(spool != 0);
+    }
+    char layout[CMD_CONFIG_LEN];
+    size_t layout_len = sizeof(layout);
+    if (nvs_storage_get_str("config", "layout", layout, &layout_len) == ESP_OK) {
+        typing_engine_set_layout(layout);
+    }
+    uint8_t unicode = 0;
+    if (nvs_storage_get_u8("config", "unicode", &unicode) == ESP_OK) {
+        typing_engine_set_unicode_method((key_stream_unicode_t)unicode);
+    }
+
+    if (s_status_bin_lock == NULL) {
+        s_status_bin_lock = xSemaphoreCreateMutex();
+        if (s_status_bin_lock == NULL) return ESP_ERR_NO_MEM;
+    }
+
+    /* Start the command worker (kept across BLE restarts) */
+    if (s_cmd_queue == NULL) {
+        s_cmd_queue = xQueueCreate(CMD_QUEUE_LEN, sizeof(ble_cmd_t));
+        if (s_cmd_queue == NULL ||
+            xTaskCreate(cmd_worker_task, "ble_cmd", CMD_TASK_STACK, NULL,
+                        CMD_TASK_PRIORITY, NULL) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to start command worker");
+            return ESP_ERR_NO_MEM;
+        }
+    }
 
     /* Start NimBLE host task */
     nimble_port_freertos_init(nimble_host_task);
@@ -651,6 +2058,10 @@ bool ble_server_is_connected(void)
 static void notify_status_if_connected(void)
 {
     if (s_conn_handle == BLE_HS_CONN_HANDLE_NONE) return;
+    if (s_status_bin_subscribed) {
+        notify_status_bin();
+        return;
+    }
     ble_gatts_chr_updated(s_status_val_handle);
 }
 
@@ -661,5 +2072,12 @@ void ble_server_notify_status(void)
 
 void ble_server_notify_progress(uint32_t current, uint32_t total)
 {
-    on_typing_progress(current, total);
+    typing_progress_t progress = {
+        .job = s_progress_tid,
+        .lane = TYPING_LANE_BULK,
+        .typed = current,
+        .total = total,
+        .done = current >= total,
+    };
+    on_typing_progress(&progress);
 }
@@ -0,0 +1,404 @@
+#include "host_id.h"
+#include "typing_engine.h"
+#include "key_stream.h"
+#include "nvs_storage.h"
+#include "tinyusb.h"
+#include "class/hid/hid_device.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "host_id";
+
+#define NVS_NAMESPACE       "hosts"
+#define PROFILE_VERSION     1
+#define SETTLE_MS           1000    /* Class requests after SET_CONFIGURATION */
+#define TASK_STACK          3072
+#define TASK_PRIORITY       2
+#define FNV_OFFSET          0x811C9DC5u
+#define FNV_PRIME           0x01000193u
+
+/* bmRequestType values of the requests we look at */
+#define REQ_STANDARD_DEVICE_IN      0x80
+#define REQ_STANDARD_DEVICE_OUT     0x00
+#define REQ_CLASS_INTERFACE_IN      0xA1
+#define REQ_CLASS_INTERFACE_OUT     0x21
+#define MS_OS_STRING_INDEX          0xEE
+#define HID_REPORT_TYPE_SHIFT       8
+
+/* Pacing seeded for firmware keyboard drivers, which poll slowly */
+#define BIOS_MIN_DELAY_MS   20
+#define BIOS_MIN_HOLD_MS    10
+
+#define FEAT_SET_IDLE       0x01
+#define FEAT_PROTO_BOOT     0x02
+#define FEAT_PROTO_REPORT   0x04
+#define FEAT_GET_REPORT     0x08
+#define FEAT_LED_REPORT     0x10
+#define FEAT_MS_OS_PROBE    0x20
+#define FEAT_SHORT_STRING   0x40
+/* Depend on what the host has cached or when its input stack attaches,
+ * not on the stack itself: used for the OS guess but not the fingerprint */
+#define FEAT_UNSTABLE       (FEAT_GET_REPORT | FEAT_LED_REPORT | FEAT_MS_OS_PROBE)
+
+/* What one enumeration looked like, accumulated request by request */
+typedef struct {
+    uint16_t device_len;    /* wLength of the first device descriptor request */
+    uint16_t config_first;  /* ... of the first configuration descriptor request */
+    uint16_t config_full;   /* ... of the first one asking for more than the header */
+    uint16_t string_len;    /* ... of the first string descriptor request */
+    uint8_t idle_rate;      /* wValue high byte of the first SET_IDLE */
+    uint8_t flags;          /* FEAT_* */
+    bool configured;        /* SET_CONFIGURATION seen */
+} host_features_t;
+
+typedef struct {
+    uint8_t version;
+    uint8_t unicode;        /* key_stream_unicode_t */
+    uint8_t hold_ms;
+    uint8_t reserved;
+    uint16_t delay_ms;
+} host_profile_t;
+
+/* Recorded from the TinyUSB task */
+static portMUX_TYPE s_features_lock = portMUX_INITIALIZER_UNLOCKED;
+static host_features_t s_features;
+static TaskHandle_t s_task_handle;
+
+/* Everything below changes under s_lock */
+static SemaphoreHandle_t s_lock;
+static bool s_enabled = true;
+static bool s_identified;
+static uint32_t s_fingerprint;
+static host_os_t s_os;
+static host_profile_t s_defaults;   /* Seed for hosts without a profile */
+
+/* TinyUSB reaches these through -Wl,--wrap (see CMakeLists.txt) */
+bool __real_tud_control_xfer(uint8_t rhport, tusb_control_request_t const *request,
+                             void *buffer, uint16_t len);
+bool __real_tud_control_status(uint8_t rhport, tusb_control_request_t const *request);
+uint16_t const *__real_tud_descriptor_string_cb(uint8_t index, uint16_t langid);
+
+static void record_request(const tusb_control_request_t *req)
+{
+    uint8_t desc_type = req->wValue >> 8;
+    bool notify = false;
+
+    portENTER_CRITICAL(&s_features_lock);
+    if (req->bmRequestType == REQ_STANDARD_DEVICE_IN &&
+        req->bRequest == TUSB_REQ_GET_DESCRIPTOR) {
+        if (desc_type == TUSB_DESC_DEVICE) {
+            if (s_features.configured) {
+                /* A new enumeration (re-plug, bus reset or another host) */
+                memset(&s_features, 0, sizeof(s_features));
+            }
+            if (s_features.device_len == 0) {
+                s_features.device_len = req->wLength;
+            }
+        } else if (desc_type == TUSB_DESC_CONFIGURATION) {
+            if (s_features.config_first == 0) {
+                s_features.config_first = req->wLength;
+            }
+            if (s_features.config_full == 0 && req->wLength > TUD_CONFIG_DESC_LEN) {
+                s_features.config_full = req->wLength;
+            }
+        } else if (desc_type == TUSB_DESC_STRING) {
+            if (s_features.string_len == 0) {
+                s_features.string_len = req->wLength;
+            }
+            if (req->wLength <= 4) {
+                s_features.flags |= FEAT_SHORT_STRING;
+            }
+        }
+    } else if (req->bmRequestType == REQ_STANDARD_DEVICE_OUT &&
+               req->bRequest == TUSB_REQ_SET_CONFIGURATION && req->wValue != 0) {
+        s_features.configured = true;
+        notify = true;
+    } else if (req->bmRequestType == REQ_CLASS_INTERFACE_OUT) {
+        if (req->bRequest == HID_REQ_CONTROL_SET_IDLE) {
+            if (!(s_features.flags & FEAT_SET_IDLE)) {
+                s_features.idle_rate = req->wValue >> 8;
+            }
+            s_features.flags |= FEAT_SET_IDLE;
+        } else if (req->bRequest == HID_REQ_CONTROL_SET_PROTOCOL) {
+            s_features.flags |= req->wValue == HID_PROTOCOL_BOOT
+                                ? FEAT_PROTO_BOOT : FEAT_PROTO_REPORT;
+        } else if (req->bRequest == HID_REQ_CONTROL_SET_REPORT &&
+                   (req->wValue >> HID_REPORT_TYPE_SHIFT) == HID_REPORT_TYPE_OUTPUT) {
+            s_features.flags |= FEAT_LED_REPORT;
+        }
+    } else if (req->bmRequestType == REQ_CLASS_INTERFACE_IN &&
+               req->bRequest == HID_REQ_CONTROL_GET_REPORT) {
+        s_features.flags |= FEAT_GET_REPORT;
+    }
+    portEXIT_CRITICAL(&s_features_lock);
+
+    if (notify && s_task_handle != NULL) {
+        xTaskNotifyGive(s_task_handle);
+    }
+}
+
+bool __wrap_tud_control_xfer(uint8_t rhport, tusb_control_request_t const *request,
+                             void *buffer, uint16_t len)
+{
+    record_request(request);
+    return __real_tud_control_xfer(rhport, request, buffer, len);
+}
+
+bool __wrap_tud_control_status(uint8_t rhport, tusb_control_request_t const *request)
+{
+    record_request(request);
+    return __real_tud_control_status(rhport, request);
+}
+
+/* The Microsoft OS string is stalled before any data stage, so it never
+ * reaches tud_control_xfer */
+uint16_t const *__wrap_tud_descriptor_string_cb(uint8_t index, uint16_t langid)
+{
+    if (index == MS_OS_STRING_INDEX) {
+        portENTER_CRITICAL(&s_features_lock);
+        s_features.flags |= FEAT_MS_OS_PROBE;
+        portEXIT_CRITICAL(&s_features_lock);
+    }
+    return __real_tud_descriptor_string_cb(index, langid);
+}
+
+static uint32_t fnv1a(uint32_t hash, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ data[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+static uint32_t fingerprint(const host_features_t *f)
+{
+    /* Serialised field by field: struct padding must not leak in */
+    const uint8_t bytes[] = {
+        f->device_len & 0xFF, f->device_len >> 8,
+        f->config_first & 0xFF, f->config_first >> 8,
+        f->config_full & 0xFF, f->config_full >> 8,
+        f->string_len & 0xFF, f->string_len >> 8,
+        f->idle_rate, f->flags & ~FEAT_UNSTABLE,
+    };
+    return fnv1a(FNV_OFFSET, bytes, sizeof(bytes));
+}
+
+/* Heuristics, strongest evidence first: only firmware drivers switch a
+ * keyboard to the boot protocol; only Windows probes the Microsoft OS
+ * string or asks for 255 bytes of configuration up front; macOS reads
+ * string lengths before the strings; Linux sets the idle rate. */
+static host_os_t guess_os(const host_features_t *f)
+{
+    if (f->flags & FEAT_PROTO_BOOT) {
+        return HOST_OS_BIOS;
+    }
+    if ((f->flags & FEAT_MS_OS_PROBE) || f->config_first == 0xFF) {
+        return HOST_OS_WINDOWS;
+    }
+    if ((f->flags & FEAT_SHORT_STRING) || f->device_len == 8) {
+        return HOST_OS_MACOS;
+    }
+    if (f->flags & FEAT_SET_IDLE) {
+        return HOST_OS_LINUX;
+    }
+    return HOST_OS_UNKNOWN;
+}
+
+static void snapshot(host_profile_t *p)
+{
+    memset(p, 0, sizeof(*p));
+    p->version = PROFILE_VERSION;
+    p->delay_ms = typing_engine_get_delay_ms();
+    p->hold_ms = typing_engine_get_hold_ms();
+    p->unicode = (uint8_t)typing_engine_get_unicode_method();
+}
+
+static void apply(const host_profile_t *p)
+{
+    typing_engine_set_delay_ms(p->delay_ms);
+    typing_engine_set_hold_ms(p->hold_ms);
+    typing_engine_set_unicode_method((key_stream_unicode_t)p->unicode);
+}
+
+static void profile_key(uint32_t fp, char key[16])
+{
+    snprintf(key, 16, "h%08lx", (unsigned long)fp);
+}
+
+/* Saved profile, or the defaults adjusted for the guessed OS */
+static void load_profile(uint32_t fp, host_os_t os, host_profile_t *p)
+{
+    char key[16];
+    size_t len = sizeof(*p);
+
+    profile_key(fp, key);
+    if (nvs_storage_get_blob(NVS_NAMESPACE, key, p, &len) == ESP_OK &&
+        len == sizeof(*p) && p->version == PROFILE_VERSION) {
+        return;
+    }
+
+    *p = s_defaults;
+    if (os == HOST_OS_LINUX && p->unicode == KEY_STREAM_UNICODE_NONE) {
+        /* Ctrl+Shift+U works out of the box under IBus and GTK; the
+         * Windows and macOS methods need the host set up first */
+        p->unicode = KEY_STREAM_UNICODE_LINUX;
+    } else if (os == HOST_OS_BIOS) {
+        if (p->delay_ms < BIOS_MIN_DELAY_MS) p->delay_ms = BIOS_MIN_DELAY_MS;
+        if (p->hold_ms < BIOS_MIN_HOLD_MS) p->hold_ms = BIOS_MIN_HOLD_MS;
+        p->unicode = KEY_STREAM_UNICODE_NONE;
+    }
+}
+
+static void identify(void)
+{
+    host_features_t f;
+    host_profile_t profile;
+
+    portENTER_CRITICAL(&s_features_lock);
+    f = s_features;
+    portEXIT_CRITICAL(&s_features_lock);
+    if (!f.configured) {
+        return;
+    }
+
+    uint32_t fp = fingerprint(&f);
+    host_os_t os = guess_os(&f);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_fingerprint = fp;
+    s_os = os;
+    s_identified = true;
+    if (s_enabled) {
+        load_profile(fp, os, &profile);
+        apply(&profile);
+    }
+    xSemaphoreGive(s_lock);
+
+    ESP_LOGI(TAG, "Host %08lx (%s): dev=%u cfg=%u/%u str=%u idle=%u flags=0x%02x",
+             (unsigned long)fp, host_id_os_name(os), f.device_len, f.config_first,
+             f.config_full, f.string_len, f.idle_rate, f.flags);
+}
+
+static void host_id_task(void *arg)
+{
+    (void)arg;
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        /* Let the class driver finish; a re-enumeration restarts the wait */
+        while (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SETTLE_MS)) > 0) {
+        }
+        identify();
+    }
+}
+
+esp_err_t host_id_init(void)
+{
+    s_lock = xSemaphoreCreateMutex();
+    if (s_lock == NULL) return ESP_ERR_NO_MEM;
+
+    uint8_t enabled = 1;
+    nvs_storage_get_u8("config", "host_profiles", &enabled);
+    s_enabled = enabled != 0;
+    snapshot(&s_defaults);
+
+    if (xTaskCreate(host_id_task, "host_id", TASK_STACK, NULL, TASK_PRIORITY,
+                    &s_task_handle) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* The host may have configured us before the task existed */
+    portENTER_CRITICAL(&s_features_lock);
+    bool configured = s_features.configured;
+    portEXIT_CRITICAL(&s_features_lock);
+    if (configured) {
+        xTaskNotifyGive(s_task_handle);
+    }
+
+    ESP_LOGI(TAG, "Host profiles %s", s_enabled ? "enabled" : "disabled");
+    return ESP_OK;
+}
+
+bool host_id_current(uint32_t *fingerprint, host_os_t *os)
+{
+    if (s_lock == NULL) return false;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool identified = s_identified;
+    if (fingerprint != NULL) *fingerprint = s_fingerprint;
+    if (os != NULL) *os = s_os;
+    xSemaphoreGive(s_lock);
+    return identified;
+}
+
+const char *host_id_os_name(host_os_t os)
+{
+    switch (os) {
+    case HOST_OS_WINDOWS:
+        return "windows";
+    case HOST_OS_LINUX:
+        return "linux";
+    case HOST_OS_MACOS:
+        return "macos";
+    case HOST_OS_BIOS:
+        return "bios";
+    default:
+        return "unknown";
+    }
+}
+
+void host_id_set_enabled(bool enabled)
+{
+    host_profile_t profile;
+
+    if (s_lock == NULL) {
+        s_enabled = enabled;
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (enabled != s_enabled) {
+        s_enabled = enabled;
+        if (!enabled) {
+            apply(&s_defaults);
+        } else if (s_identified) {
+            load_profile(s_fingerprint, s_os, &profile);
+            apply(&profile);
+        }
+    }
+    xSemaphoreGive(s_lock);
+    ESP_LOGI(TAG, "Host profiles %s", enabled ? "enabled" : "disabled");
+}
+
+bool host_id_is_enabled(void)
+{
+    return s_enabled;
+}
+
+esp_err_t host_id_save_profile(void)
+{
+    host_profile_t profile;
+    char key[16];
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+
+    if (s_lock == NULL) return err;
+
+    snapshot(&profile);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_enabled && s_identified) {
+        profile_key(s_fingerprint, key);
+        err = nvs_storage_set_blob(NVS_NAMESPACE, key, &profile, sizeof(profile));
+    } else {
+        /* Settings made with no profile in effect are the new defaults */
+        s_defaults = profile;
+    }
+    xSemaphoreGive(s_lock);
+
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Saved profile for host %08lx", (unsigned long)s_fingerprint);
+    }
+    return err;
+}
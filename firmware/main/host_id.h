@@ -0,0 +1,37 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Host identification: the control requests a host sends while enumerating
+ * the keyboard (descriptor lengths, string probes, SET_IDLE/SET_PROTOCOL)
+ * differ between USB stacks. Shortly after SET_CONFIGURATION they are
+ * reduced to a fingerprint, which selects a typing profile (pacing, key
+ * hold time, Unicode method) kept in the "hosts" NVS namespace. A host seen
+ * for the first time gets a profile seeded from the saved defaults and its
+ * guessed OS. Machines with the same OS and USB stack share a fingerprint,
+ * and so a profile. */
+
+typedef enum {
+    HOST_OS_UNKNOWN = 0,
+    HOST_OS_WINDOWS,
+    HOST_OS_LINUX,
+    HOST_OS_MACOS,
+    HOST_OS_BIOS,           /* Firmware boot keyboard driver */
+} host_os_t;
+
+/* Call once the typing engine settings have been loaded: profiles applied
+ * from here on override them */
+esp_err_t host_id_init(void);
+/* False until the current enumeration has been classified */
+bool host_id_current(uint32_t *fingerprint, host_os_t *os);
+const char *host_id_os_name(host_os_t os);
+/* Profiles are applied and saved only while enabled */
+void host_id_set_enabled(bool enabled);
+bool host_id_is_enabled(void);
+/* Store the typing engine's current pacing, hold time and Unicode method
+ * as the current host's profile. ESP_ERR_INVALID_STATE if no host has been
+ * identified or profiles are disabled: they become the seed for new hosts
+ * and the caller persists them as defaults. */
+esp_err_t host_id_save_profile(void);
@@ -0,0 +1,467 @@
+#include "key_stream.h"
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#define USAGE_LEFT_CTRL     0xE0
+#define USAGE_LEFT_ALT      0xE2
+#define USAGE_RIGHT_GUI     0xE7
+#define USAGE_SPACE         0x2C
+#define USAGE_KP_PLUS       0x57
+#define USAGE_KP_1          0x59    /* KP1-KP9 follow, then KP0 */
+#define USAGE_KP_0          0x62
+#define MAX_WAIT_MS         0xFFFF
+#define UNICODE_BYTES       8       /* Per input byte, see KEY_STREAM_MAX_CHAR_BYTES */
+#define COST_NONE           0xFF
+
+static const char *const UNICODE_NAMES[] = { "none", "linux", "windows", "macos" };
+
+typedef struct {
+    const char *name;
+    uint8_t usage;
+} key_name_t;
+
+/* Named keys for in-band commands. F1-F24 are handled separately. */
+static const key_name_t KEY_NAMES[] = {
+    { "enter", 0x28 }, { "return", 0x28 }, { "esc", 0x29 }, { "escape", 0x29 },
+    { "backspace", 0x2A }, { "bksp", 0x2A }, { "tab", 0x2B }, { "space", 0x2C },
+    { "plus", 0x2E }, { "capslock", 0x39 }, { "prtsc", 0x46 }, { "sysrq", 0x46 },
+    { "scrolllock", 0x47 }, { "pause", 0x48 }, { "insert", 0x49 }, { "ins", 0x49 },
+    { "home", 0x4A }, { "pgup", 0x4B }, { "pageup", 0x4B }, { "delete", 0x4C },
+    { "del", 0x4C }, { "end", 0x4D }, { "pgdn", 0x4E }, { "pagedown", 0x4E },
+    { "right", 0x4F }, { "left", 0x50 }, { "down", 0x51 }, { "up", 0x52 },
+    { "numlock", 0x53 }, { "menu", 0x65 }, { "app", 0x65 },
+    { "ctrl", 0xE0 }, { "control", 0xE0 }, { "shift", 0xE1 }, { "alt", 0xE2 },
+    { "option", 0xE2 }, { "gui", 0xE3 }, { "win", 0xE3 }, { "cmd", 0xE3 },
+    { "meta", 0xE3 }, { "rctrl", 0xE4 }, { "rshift", 0xE5 }, { "ralt", 0xE6 },
+    { "altgr", 0xE6 }, { "rgui", 0xE7 },
+};
+
+size_t key_stream_op_len(uint8_t op)
+{
+    switch (op) {
+    case KEY_STREAM_OP_MOD:
+    case KEY_STREAM_OP_DOWN:
+    case KEY_STREAM_OP_UP:
+        return 2;
+    case KEY_STREAM_OP_DELAY:
+    case KEY_STREAM_OP_JOB:
+        return 3;
+    default:
+        return 1;
+    }
+}
+
+void key_stream_encoder_reset(key_stream_encoder_t *enc, const keymap_layout_t *layout,
+                              key_stream_unicode_t unicode)
+{
+    memset(enc, 0, sizeof(*enc));
+    enc->layout = layout;
+    enc->unicode = unicode;
+}
+
+size_t key_stream_bytes_per_input(const keymap_layout_t *layout, key_stream_unicode_t unicode)
+{
+    if (unicode != KEY_STREAM_UNICODE_NONE && layout->max_char_bytes < UNICODE_BYTES) {
+        return UNICODE_BYTES;
+    }
+    return layout->max_char_bytes;
+}
+
+const char *key_stream_unicode_name(key_stream_unicode_t unicode)
+{
+    return (size_t)unicode < sizeof(UNICODE_NAMES) / sizeof(UNICODE_NAMES[0])
+           ? UNICODE_NAMES[unicode] : "none";
+}
+
+bool key_stream_unicode_parse(const char *name, key_stream_unicode_t *unicode)
+{
+    for (size_t i = 0; i < sizeof(UNICODE_NAMES) / sizeof(UNICODE_NAMES[0]); i++) {
+        if (strcmp(UNICODE_NAMES[i], name) == 0) {
+            *unicode = (key_stream_unicode_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static const keymap_char_t *lookup_key(const key_stream_encoder_t *enc, char ch)
+{
+    if ((uint8_t)ch >= 128) return NULL;  /* Skip non-ASCII */
+    return keymap_lookup(enc->layout, (uint8_t)ch);
+}
+
+static bool is_modifier_usage(uint8_t usage)
+{
+    return usage >= USAGE_LEFT_CTRL && usage <= USAGE_RIGHT_GUI;
+}
+
+/* Parse a key name of the given length into a usage. A single character
+ * names the key that types it on the current layout; *shift receives the
+ * modifier it needs. Characters behind a dead key name no single key. */
+static bool parse_key(const key_stream_encoder_t *enc, const char *name, size_t len,
+                      uint8_t *usage, uint8_t *shift)
+{
+    *shift = 0;
+    if (len == 1) {
+        const keymap_char_t *entry = lookup_key(enc, name[0]);
+        if (entry == NULL || entry->dead.keycode != 0) return false;
+        *usage = entry->key.keycode;
+        *shift = entry->key.modifier;
+        return true;
+    }
+
+    if ((name[0] == 'f' || name[0] == 'F') && len <= 3 && isdigit((unsigned char)name[1])) {
+        int n = name[1] - '0';
+        if (len == 3) {
+            if (!isdigit((unsigned char)name[2])) return false;
+            n = n * 10 + (name[2] - '0');
+        }
+        if (n >= 1 && n <= 12) {
+            *usage = 0x3A + (n - 1);    /* F1-F12 */
+            return true;
+        }
+        if (n >= 13 && n <= 24) {
+            *usage = 0x68 + (n - 13);   /* F13-F24 */
+            return true;
+        }
+        return false;
+    }
+
+    for (size_t i = 0; i < sizeof(KEY_NAMES) / sizeof(KEY_NAMES[0]); i++) {
+        if (strlen(KEY_NAMES[i].name) == len && strncasecmp(KEY_NAMES[i].name, name, len) == 0) {
+            *usage = KEY_NAMES[i].usage;
+            return true;
+        }
+    }
+    return false;
+}
+
+static size_t emit(uint8_t *out, size_t pos, uint8_t byte)
+{
+    if (out) {
+        out[pos] = byte;
+    }
+    return pos + 1;
+}
+
+/* A tap under the key's modifier, switching modifier only when needed */
+static size_t emit_tap(key_stream_encoder_t *enc, uint8_t *out, size_t pos,
+                       const hid_keymap_entry_t *key)
+{
+    if (!enc->synced || key->modifier != enc->modifier) {
+        pos = emit(out, pos, KEY_STREAM_OP_MOD);
+        pos = emit(out, pos, key->modifier);
+        enc->modifier = key->modifier;
+        enc->synced = true;
+    }
+    return emit(out, pos, key->keycode);
+}
+
+static bool parse_wait(const char *text, size_t len, uint16_t *ms)
+{
+    uint32_t value = 0;
+
+    if (len == 0) return false;
+    for (size_t i = 0; i < len; i++) {
+        if (!isdigit((unsigned char)text[i])) return false;
+        value = value * 10 + (text[i] - '0');
+        if (value > MAX_WAIT_MS) value = MAX_WAIT_MS;
+    }
+    *ms = (uint16_t)value;
+    return true;
+}
+
+/* Encode one complete command at out + pos. Returns the new position, or
+ * pos unchanged if the command is not recognised. */
+static size_t encode_command(key_stream_encoder_t *enc, const char *cmd, size_t len,
+                             uint8_t *out, size_t pos, key_stream_size_t *size)
+{
+    uint8_t usage;
+    uint8_t shift;
+
+    if (len > 5 && strncasecmp(cmd, "wait:", 5) == 0) {
+        uint16_t ms;
+        if (!parse_wait(cmd + 5, len - 5, &ms)) return pos;
+        pos = emit(out, pos, KEY_STREAM_OP_DELAY);
+        pos = emit(out, pos, ms & 0xFF);
+        pos = emit(out, pos, ms >> 8);
+        size->delay_ms += ms;
+        return pos;
+    }
+    if (len > 5 && strncasecmp(cmd, "down:", 5) == 0) {
+        if (!parse_key(enc, cmd + 5, len - 5, &usage, &shift)) return pos;
+        pos = emit(out, pos, KEY_STREAM_OP_DOWN);
+        size->keystrokes++;
+        return emit(out, pos, usage);
+    }
+    if (len > 3 && strncasecmp(cmd, "up:", 3) == 0) {
+        if (!parse_key(enc, cmd + 3, len - 3, &usage, &shift)) return pos;
+        pos = emit(out, pos, KEY_STREAM_OP_UP);
+        return emit(out, pos, usage);
+    }
+    if (len == 7 && strncasecmp(cmd, "release", 7) == 0) {
+        return emit(out, pos, KEY_STREAM_OP_RELEASE);
+    }
+
+    /* Chord: '+'-separated modifiers and at most one other key */
+    uint8_t modifiers = 0;
+    uint8_t key = 0;
+    size_t start = 0;
+    while (start < len) {
+        size_t end = start;
+        while (end < len && cmd[end] != '+') end++;
+        if (end == start) {
+            end++;          /* A bare '+' names the plus key */
+        }
+        if (!parse_key(enc, cmd + start, end - start, &usage, &shift)) return pos;
+        if (is_modifier_usage(usage)) {
+            modifiers |= 1 << (usage - USAGE_LEFT_CTRL);
+        } else if (key == 0) {
+            key = usage;
+            modifiers |= shift;
+        } else {
+            return pos;     /* One key per chord */
+        }
+        start = end + 1;
+    }
+
+    if (key == 0) {
+        /* Modifiers alone: press and release them */
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            if (modifiers & (1 << bit)) {
+                pos = emit(out, pos, KEY_STREAM_OP_DOWN);
+                pos = emit(out, pos, USAGE_LEFT_CTRL + bit);
+                size->keystrokes++;
+            }
+        }
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            if (modifiers & (1 << bit)) {
+                pos = emit(out, pos, KEY_STREAM_OP_UP);
+                pos = emit(out, pos, USAGE_LEFT_CTRL + bit);
+            }
+        }
+        return pos;
+    }
+
+    /* The chord's modifier becomes the tap modifier; the next character
+     * switches back with its own OP_MOD */
+    pos = emit(out, pos, KEY_STREAM_OP_MOD);
+    pos = emit(out, pos, modifiers);
+    pos = emit(out, pos, key);
+    enc->modifier = modifiers;
+    enc->synced = true;
+    size->keystrokes++;
+    return pos;
+}
+
+/* Feed one byte of UTF-8; true with *cp set once a character is complete.
+ * Invalid input is dropped: stray continuations, overlong forms, surrogates
+ * and a sequence cut short by a new lead byte. */
+static bool utf8_byte(key_stream_utf8_t *u, uint8_t byte, uint32_t *cp)
+{
+    static const uint32_t MIN_CP[] = { 0, 0, 0x80, 0x800, 0x10000 };
+
+    if (byte < 0x80) {
+        u->need = 0;
+        *cp = byte;
+        return true;
+    }
+    if ((byte & 0xC0) == 0x80) {
+        if (u->need == 0) return false;
+        u->cp = (u->cp << 6) | (byte & 0x3F);
+        if (--u->need > 0) return false;
+        if (u->cp < MIN_CP[u->len] || u->cp > 0x10FFFF ||
+            (u->cp >= 0xD800 && u->cp <= 0xDFFF)) {
+            return false;
+        }
+        *cp = u->cp;
+        return true;
+    }
+
+    if ((byte & 0xE0) == 0xC0) {
+        u->cp = byte & 0x1F;
+        u->len = 2;
+    } else if ((byte & 0xF0) == 0xE0) {
+        u->cp = byte & 0x0F;
+        u->len = 3;
+    } else if ((byte & 0xF8) == 0xF0) {
+        u->cp = byte & 0x07;
+        u->len = 4;
+    } else {
+        u->need = 0;
+        return false;
+    }
+    u->need = u->len - 1;
+    return false;
+}
+
+static uint8_t hex_digits(uint32_t value)
+{
+    uint8_t n = 1;
+    while (value >>= 4) n++;
+    return n;
+}
+
+/* Keystrokes the entry method takes for cp, COST_NONE if it cannot type
+ * it. ASCII always comes from the layout: entering it would break the
+ * bytes-per-input bound. */
+static uint8_t unicode_cost(const key_stream_encoder_t *enc, uint32_t cp)
+{
+    if (cp < 0x80) return COST_NONE;
+
+    switch (enc->unicode) {
+    case KEY_STREAM_UNICODE_LINUX:
+        return 2 + hex_digits(cp);              /* Ctrl+Shift+U, digits, Space */
+    case KEY_STREAM_UNICODE_WINDOWS:
+        return cp > 0xFFFF ? COST_NONE : 2 + hex_digits(cp);   /* Alt, numpad +, digits */
+    case KEY_STREAM_UNICODE_MACOS:
+        return 1 + (cp > 0xFFFF ? 8 : 4);       /* Option, one or two UTF-16 units */
+    default:
+        return COST_NONE;
+    }
+}
+
+/* Key typing a hex digit: the numpad for Windows digits, otherwise the
+ * layout's key for 0-9 and a-f */
+static bool hex_key(const key_stream_encoder_t *enc, uint8_t nibble, hid_keymap_entry_t *key)
+{
+    if (enc->unicode == KEY_STREAM_UNICODE_WINDOWS && nibble < 10) {
+        key->keycode = nibble == 0 ? USAGE_KP_0 : USAGE_KP_1 + nibble - 1;
+        key->modifier = MOD_NONE;
+        return true;
+    }
+    const keymap_char_t *entry = keymap_lookup(enc->layout, "0123456789abcdef"[nibble]);
+    if (entry == NULL || entry->dead.keycode != 0) return false;
+    *key = entry->key;
+    return true;
+}
+
+/* Encode cp through the entry method. Returns pos unchanged if a key it
+ * needs is missing from the layout. */
+static size_t encode_unicode(key_stream_encoder_t *enc, uint32_t cp, uint8_t *out, size_t pos,
+                             key_stream_size_t *size)
+{
+    uint32_t groups[2] = { cp, 0 };
+    uint8_t digits = hex_digits(cp);
+    uint8_t count = 1;
+    hid_keymap_entry_t keys[16];
+    uint8_t n = 0;
+
+    if (enc->unicode == KEY_STREAM_UNICODE_MACOS) {
+        digits = 4;
+        if (cp > 0xFFFF) {
+            groups[0] = 0xD800 + ((cp - 0x10000) >> 10);
+            groups[1] = 0xDC00 + ((cp - 0x10000) & 0x3FF);
+            count = 2;
+        }
+    }
+    for (uint8_t g = 0; g < count; g++) {
+        for (int8_t d = digits - 1; d >= 0; d--) {
+            if (!hex_key(enc, (groups[g] >> (d * 4)) & 0x0F, &keys[n++])) return pos;
+        }
+    }
+
+    if (enc->unicode == KEY_STREAM_UNICODE_LINUX) {
+        const keymap_char_t *u = keymap_lookup(enc->layout, 'u');
+        if (u == NULL || u->dead.keycode != 0) return pos;
+        hid_keymap_entry_t chord = { u->key.keycode, u->key.modifier | MOD_LCTRL | MOD_LSHIFT };
+        pos = emit_tap(enc, out, pos, &chord);
+    } else {
+        pos = emit(out, pos, KEY_STREAM_OP_DOWN);
+        pos = emit(out, pos, USAGE_LEFT_ALT);
+        if (enc->unicode == KEY_STREAM_UNICODE_WINDOWS) {
+            hid_keymap_entry_t plus = { USAGE_KP_PLUS, MOD_NONE };
+            pos = emit_tap(enc, out, pos, &plus);
+        }
+    }
+    for (uint8_t i = 0; i < n; i++) {
+        pos = emit_tap(enc, out, pos, &keys[i]);
+    }
+    if (enc->unicode == KEY_STREAM_UNICODE_LINUX) {
+        hid_keymap_entry_t space = { USAGE_SPACE, MOD_NONE };
+        pos = emit_tap(enc, out, pos, &space);
+    } else {
+        pos = emit(out, pos, KEY_STREAM_OP_UP);
+        pos = emit(out, pos, USAGE_LEFT_ALT);
+    }
+    size->keystrokes += unicode_cost(enc, cp);
+    return pos;
+}
+
+/* Type one character the cheapest way: layout key, dead-key sequence or
+ * the entry method, counted in keystrokes */
+static size_t encode_char(key_stream_encoder_t *enc, uint32_t cp, uint8_t *out, size_t pos,
+                          key_stream_size_t *size)
+{
+    const keymap_char_t *entry = keymap_lookup(enc->layout, cp);
+    uint8_t cost = entry == NULL ? COST_NONE : entry->dead.keycode != 0 ? 2 : 1;
+
+    if (unicode_cost(enc, cp) < cost) {
+        size->chars++;
+        return encode_unicode(enc, cp, out, pos, size);
+    }
+    if (entry == NULL) return pos;
+
+    size->chars++;
+
+    if (entry->dead.keycode != 0) {
+        pos = emit_tap(enc, out, pos, &entry->dead);
+        size->keystrokes++;
+    }
+    pos = emit_tap(enc, out, pos, &entry->key);
+    size->keystrokes++;
+    return pos;
+}
+
+/* Feed one byte of a command; encodes it once the closing DLE arrives */
+static size_t escape_byte(key_stream_encoder_t *enc, char ch, uint8_t *out, size_t pos,
+                          key_stream_size_t *size)
+{
+    key_stream_escape_t *esc = &enc->escape;
+
+    if ((uint8_t)ch != KEY_STREAM_ESC) {
+        if (esc->len < KEY_STREAM_ESC_MAX) {
+            esc->text[esc->len++] = ch;
+        } else {
+            esc->overflow = true;
+        }
+        return pos;
+    }
+
+    if (!esc->overflow) {
+        uint32_t keystrokes = size->keystrokes;
+        pos = encode_command(enc, esc->text, esc->len, out, pos, size);
+        if (size->keystrokes != keystrokes) {
+            size->chars++;
+        }
+    }
+    memset(esc, 0, sizeof(*esc));
+    return pos;
+}
+
+void key_stream_encode_text(key_stream_encoder_t *enc, const char *text, size_t len,
+                            uint8_t *out, key_stream_size_t *size)
+{
+    size_t pos = 0;
+
+    memset(size, 0, sizeof(*size));
+    for (size_t i = 0; i < len; i++) {
+        if (enc->escape.active) {
+            pos = escape_byte(enc, text[i], out, pos, size);
+            continue;
+        }
+        if ((uint8_t)text[i] == KEY_STREAM_ESC) {
+            enc->escape.active = true;
+            enc->utf8.need = 0;
+            continue;
+        }
+
+        uint32_t cp;
+        if (utf8_byte(&enc->utf8, (uint8_t)text[i], &cp)) {
+            pos = encode_char(enc, cp, out, pos, size);
+        }
+    }
+
+    size->bytes = pos;
+}
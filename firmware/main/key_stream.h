@@ -0,0 +1,122 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "keymap.h"
+
+/* Pre-translated HID action stream stored in the typing queue.
+ *
+ * A byte below KEY_STREAM_OP_FIRST is a key tap: press that usage under the
+ * current modifier, then release it. Everything else is an opcode followed
+ * by its operands:
+ *
+ *   OP_MOD m        set the modifier byte for following taps
+ *   OP_DELAY lo hi  pause for a little-endian number of milliseconds
+ *   OP_DOWN k       press and hold usage k
+ *   OP_UP k         release held usage k
+ *   OP_RELEASE      release every held key and clear the modifier
+ *   OP_JOB lo hi    following actions belong to typing job lo | hi << 8
+ */
+#define KEY_STREAM_OP_FIRST     0xF0
+#define KEY_STREAM_OP_MOD       0xF0
+#define KEY_STREAM_OP_DELAY     0xF1
+#define KEY_STREAM_OP_DOWN      0xF2
+#define KEY_STREAM_OP_UP        0xF3
+#define KEY_STREAM_OP_RELEASE   0xF4
+#define KEY_STREAM_OP_JOB       0xF5
+
+/* Largest encoding per input byte. Layout keys take at most a dead key
+ * and the key, each with a modifier change (6 bytes); a Unicode entry
+ * sequence for a two-byte UTF-8 character takes up to 16. The bound for
+ * the layout and method in use (key_stream_bytes_per_input()) is usually
+ * lower. */
+#define KEY_STREAM_MAX_CHAR_BYTES   8
+
+/* How characters missing from the layout are entered on the host:
+ *
+ *   LINUX    Ctrl+Shift+U, hex digits, Space (IBus, GTK)
+ *   WINDOWS  Alt held, numpad +, hex digits (needs the EnableHexNumpad
+ *            registry value; BMP only)
+ *   MACOS    Option held, four hex digits per UTF-16 unit (the Unicode
+ *            Hex Input source)
+ *
+ * Each character takes whichever is fewer keystrokes: its layout key, its
+ * dead-key sequence or the entry method. Without a method, characters
+ * missing from the layout are dropped. */
+typedef enum {
+    KEY_STREAM_UNICODE_NONE = 0,
+    KEY_STREAM_UNICODE_LINUX,
+    KEY_STREAM_UNICODE_WINDOWS,
+    KEY_STREAM_UNICODE_MACOS,
+} key_stream_unicode_t;
+
+/* In-band commands: text between two DLE bytes is a command, not text.
+ *
+ *   ctrl+s, alt+tab, gui   chord: modifiers plus at most one key, tapped
+ *   f5, home, pgdn         named key (see key_stream.c for the list)
+ *   down:ctrl, up:a        press / release and keep the rest of the state
+ *   release                release everything held by down:
+ *   wait:250               pause in milliseconds (max 65535)
+ *
+ * Names are case-insensitive; a single character names the key that types
+ * it, so "ctrl+A" is Ctrl+Shift+A. Unknown or overlong commands are dropped.
+ * A command never encodes to more than 3 bytes per input byte, so the
+ * queue credit bound still holds. DLE inside a UTF-8 sequence drops it. */
+#define KEY_STREAM_ESC              0x10
+#define KEY_STREAM_ESC_MAX          32      /* Longest command text */
+#define KEY_STREAM_MAX_ESC_BYTES    32      /* Largest encoding of one command */
+
+/* Partial command carried across writes, since a chunked upload can split
+ * a command anywhere */
+typedef struct {
+    bool active;            /* Inside a command */
+    bool overflow;          /* Command too long: drop it */
+    uint8_t len;
+    char text[KEY_STREAM_ESC_MAX];
+} key_stream_escape_t;
+
+/* Partial UTF-8 sequence carried across writes */
+typedef struct {
+    uint32_t cp;            /* Bits decoded so far */
+    uint8_t need;           /* Continuation bytes still expected */
+    uint8_t len;            /* Sequence length, to reject overlong forms */
+} key_stream_utf8_t;
+
+/* Translation state within one enqueued write. Each write starts unsynced,
+ * so its first tap always carries an explicit OP_MOD and the stream can be
+ * cut at any write boundary (e.g. on abort) without stale modifier state. */
+typedef struct {
+    const keymap_layout_t *layout;
+    key_stream_unicode_t unicode;
+    uint8_t modifier;       /* Modifier in effect at the end of the stream */
+    bool synced;            /* modifier has been emitted */
+    key_stream_escape_t escape;
+    key_stream_utf8_t utf8;
+} key_stream_encoder_t;
+
+typedef struct {
+    size_t bytes;           /* Encoded stream length */
+    uint32_t keystrokes;    /* Taps and key-downs, i.e. visible key events */
+    uint32_t chars;         /* Characters and commands that typed something */
+    uint32_t delay_ms;      /* Sum of explicit delays */
+} key_stream_size_t;
+
+/* Bytes taken by the opcode at the start of a stream (tap or opcode) */
+size_t key_stream_op_len(uint8_t op);
+
+void key_stream_encoder_reset(key_stream_encoder_t *enc, const keymap_layout_t *layout,
+                              key_stream_unicode_t unicode);
+
+/* Worst-case stream bytes per input byte with this layout and method */
+size_t key_stream_bytes_per_input(const keymap_layout_t *layout, key_stream_unicode_t unicode);
+
+const char *key_stream_unicode_name(key_stream_unicode_t unicode);
+/* false if name is not one of none, linux, windows, macos */
+bool key_stream_unicode_parse(const char *name, key_stream_unicode_t *unicode);
+
+/* Translate text into the action stream and advance the encoder. With
+ * out == NULL only the size is computed; run that on a copy of the encoder
+ * to check for space before encoding for real. */
+void key_stream_encode_text(key_stream_encoder_t *enc, const char *text, size_t len,
+                            uint8_t *out, key_stream_size_t *size);
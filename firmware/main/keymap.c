@@ -0,0 +1,12 @@
+#include "keymap.h"
+#include <string.h>
+
+const keymap_layout_t *keymap_find(const char *name)
+{
+    for (size_t i = 0; i < KEYMAP_LAYOUT_COUNT; i++) {
+        if (strcmp(KEYMAP_LAYOUTS[i]->name, name) == 0) {
+            return KEYMAP_LAYOUTS[i];
+        }
+    }
+    return NULL;
+}
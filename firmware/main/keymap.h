@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MOD_NONE    0x00
+#define MOD_LCTRL   0x01
+#define MOD_LSHIFT  0x02
+#define MOD_LALT    0x04
+#define MOD_LGUI    0x08
+#define MOD_RCTRL   0x10
+#define MOD_RSHIFT  0x20
+#define MOD_RALT    0x40
+#define MOD_RGUI    0x80
+
+typedef struct {
+    uint8_t keycode;
+    uint8_t modifier;
+} hid_keymap_entry_t;
+
+/* How one character is typed: an optional dead key (keycode 0 if none),
+ * then the key itself. AltGr is MOD_RALT. */
+typedef struct {
+    hid_keymap_entry_t dead;
+    hid_keymap_entry_t key;
+} keymap_char_t;
+
+/* Characters are grouped in pages of KEYMAP_PAGE_SIZE codepoints. Page 0
+ * (ASCII) always comes first; a layout has at most KEYMAP_MAX_PAGES, so a
+ * lookup is one index plus a bounded scan. Entries with keycode 0 are
+ * unmapped. */
+#define KEYMAP_PAGE_BITS    7
+#define KEYMAP_PAGE_SIZE    (1 << KEYMAP_PAGE_BITS)
+#define KEYMAP_MAX_PAGES    8
+
+typedef struct {
+    uint16_t page;                  /* Codepoint >> KEYMAP_PAGE_BITS */
+    const keymap_char_t *chars;     /* KEYMAP_PAGE_SIZE entries */
+} keymap_page_t;
+
+typedef struct {
+    const char *name;               /* "us", "de", "us-intl", ... */
+    const char *description;
+    const keymap_page_t *pages;
+    uint8_t page_count;
+    uint8_t max_char_bytes;         /* Worst key stream bytes per input byte */
+} keymap_layout_t;
+
+/* Generated at build time by tools/gen_keymaps.py from the XKB layouts in
+ * CONFIG_HID_TYPER_LAYOUTS; the first one is the default */
+extern const keymap_layout_t *const KEYMAP_LAYOUTS[];
+extern const size_t KEYMAP_LAYOUT_COUNT;
+
+/* NULL if the layout was not built in */
+const keymap_layout_t *keymap_find(const char *name);
+
+/* NULL if the character cannot be typed on this layout */
+static inline const keymap_char_t *keymap_lookup(const keymap_layout_t *layout, uint32_t cp)
+{
+    uint32_t page = cp >> KEYMAP_PAGE_BITS;
+    const keymap_char_t *entry = NULL;
+
+    if (page == 0) {
+        entry = &layout->pages[0].chars[cp];
+    } else {
+        for (uint8_t i = 1; i < layout->page_count; i++) {
+            if (layout->pages[i].page == page) {
+                entry = &layout->pages[i].chars[cp & (KEYMAP_PAGE_SIZE - 1)];
+                break;
+            }
+        }
+    }
+    return entry != NULL && entry->key.keycode != 0 ? entry : NULL;
+}
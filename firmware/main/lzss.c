@@ -0,0 +1,72 @@
+#include "lzss.h"
+#include <string.h>
+
+#define WINDOW_MASK     (LZSS_WINDOW_SIZE - 1)
+#define OUT_CHUNK       64
+
+typedef struct {
+    uint8_t buf[OUT_CHUNK];
+    size_t len;
+    size_t total;
+    lzss_output_fn fn;
+    void *ctx;
+} output_t;
+
+static void put_byte(lzss_decoder_t *dec, output_t *out, uint8_t byte)
+{
+    dec->window[dec->pos] = byte;
+    dec->pos = (dec->pos + 1) & WINDOW_MASK;
+    out->total++;
+    if (out->fn == NULL) return;
+
+    out->buf[out->len++] = byte;
+    if (out->len == OUT_CHUNK) {
+        out->fn(out->ctx, out->buf, out->len);
+        out->len = 0;
+    }
+}
+
+void lzss_decoder_reset(lzss_decoder_t *dec)
+{
+    memset(dec, 0, sizeof(*dec));
+}
+
+size_t lzss_decode(lzss_decoder_t *dec, const uint8_t *in, size_t len,
+                   lzss_output_fn fn, void *ctx)
+{
+    output_t out = { .len = 0, .total = 0, .fn = fn, .ctx = ctx };
+
+    for (size_t i = 0; i < len; i++) {
+        uint8_t byte = in[i];
+
+        if (dec->tokens == 0) {
+            dec->flags = byte;
+            dec->tokens = 8;
+            continue;
+        }
+
+        if (dec->flags & 1) {
+            put_byte(dec, &out, byte);
+        } else if (!dec->have_lo) {
+            dec->ref_lo = byte;
+            dec->have_lo = true;
+            continue;
+        } else {
+            uint16_t dist = (dec->ref_lo | ((byte & 0x03) << 8)) + 1;
+            uint8_t count = (byte >> 2) + LZSS_MIN_MATCH;
+            uint16_t from = (dec->pos - dist) & WINDOW_MASK;
+            for (uint8_t n = 0; n < count; n++) {
+                put_byte(dec, &out, dec->window[from]);
+                from = (from + 1) & WINDOW_MASK;
+            }
+            dec->have_lo = false;
+        }
+        dec->flags >>= 1;
+        dec->tokens--;
+    }
+
+    if (out.fn != NULL && out.len > 0) {
+        out.fn(out.ctx, out.buf, out.len);
+    }
+    return out.total;
+}
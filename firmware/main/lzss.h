@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Streaming LZSS decoder with a 1 KB window.
+ *
+ * The stream is a sequence of groups: a flag byte, then up to eight tokens,
+ * one per flag bit starting at the least significant. A set bit is a
+ * literal byte; a clear bit is a two-byte back-reference
+ *
+ *   [d & 0xFF][(d >> 8) | ((len - LZSS_MIN_MATCH) << 2)]
+ *
+ * copying len bytes that start d + 1 bytes back in the output. Input can be
+ * fed in pieces split anywhere; the decoder state is plain data, so a copy
+ * of it is a checkpoint. */
+#define LZSS_WINDOW_BITS    10
+#define LZSS_WINDOW_SIZE    (1 << LZSS_WINDOW_BITS)
+#define LZSS_MIN_MATCH      3
+#define LZSS_MAX_MATCH      (LZSS_MIN_MATCH + 63)
+
+typedef struct {
+    uint8_t window[LZSS_WINDOW_SIZE];
+    uint16_t pos;           /* Next output position in window */
+    uint8_t flags;          /* Remaining flag bits of the current group */
+    uint8_t tokens;         /* Tokens left in the current group */
+    uint8_t ref_lo;         /* First byte of a split back-reference */
+    bool have_lo;
+} lzss_decoder_t;
+
+/* Receives decoded output in order, in pieces of up to 64 bytes */
+typedef void (*lzss_output_fn)(void *ctx, const uint8_t *data, size_t len);
+
+void lzss_decoder_reset(lzss_decoder_t *dec);
+
+/* Decode len input bytes and return the number of bytes output. With
+ * out == NULL the output is only counted. */
+size_t lzss_decode(lzss_decoder_t *dec, const uint8_t *in, size_t len,
+                   lzss_output_fn out, void *ctx);
@@ -4,6 +4,8 @@
 #include "neopixel.h"
 #include "usb_hid.h"
 #include "typing_engine.h"
+#include "spool.h"
+#include "host_id.h"
 #include "auth.h"
 #include "audit_log.h"
 #include "provisioning.h"
@@ -51,10 +53,16 @@ void app_main(void)
     /* Initialize typing engine */
     ESP_ERROR_CHECK(typing_engine_init());
 
+    /* Initialize flash spool; resumes typing anything left from before */
+    ESP_ERROR_CHECK(spool_init());
+
     neopixel_set_state(LED_STATE_OFF);
 
     /* Initialize BLE server (normal mode) */
     ESP_ERROR_CHECK(ble_server_init());
 
+    /* Identify the USB host; its typing profile overrides the saved config */
+    ESP_ERROR_CHECK(host_id_init());
+
     ESP_LOGI(TAG, "Normal mode initialized");
 }
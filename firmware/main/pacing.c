@@ -0,0 +1,52 @@
+#include "pacing.h"
+
+#define US_PER_S    1000000u
+
+static uint32_t clamp_gap(const pacing_t *p, uint32_t gap_us)
+{
+    if (gap_us < p->min_gap_us) return p->min_gap_us;
+    if (gap_us > p->max_gap_us) return p->max_gap_us;
+    return gap_us;
+}
+
+void pacing_init(pacing_t *p, uint32_t gap_us, uint32_t min_gap_us, uint32_t max_gap_us)
+{
+    p->min_gap_us = min_gap_us;
+    p->max_gap_us = max_gap_us;
+    p->gap_us = clamp_gap(p, gap_us);
+    p->healthy = 0;
+    p->holdoff = 0;
+    p->backoffs = 0;
+}
+
+void pacing_on_report(pacing_t *p, uint32_t latency_us, uint32_t poll_us)
+{
+    if (p->holdoff > 0) {
+        p->holdoff--;
+    }
+    if (latency_us > 2 * poll_us + PACING_SLACK_US) {
+        pacing_on_congestion(p);
+        return;
+    }
+    if (p->holdoff > 0 || ++p->healthy < PACING_WINDOW) {
+        return;
+    }
+
+    /* Additive increase of the rate, i.e. 1 / gap */
+    uint32_t rate = US_PER_S / p->gap_us + PACING_RATE_STEP;
+    p->gap_us = clamp_gap(p, US_PER_S / rate);
+    p->healthy = 0;
+}
+
+void pacing_on_congestion(pacing_t *p)
+{
+    /* The report FIFO runs ahead of the host, so one episode shows up as
+     * several late completions: back off at most once per window */
+    if (p->holdoff > PACING_HOLDOFF - PACING_WINDOW) {
+        return;
+    }
+    p->gap_us = clamp_gap(p, p->gap_us * 2);
+    p->healthy = 0;
+    p->holdoff = PACING_HOLDOFF;
+    p->backoffs++;
+}
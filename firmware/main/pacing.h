@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Adaptive inter-key gap, additive increase / multiplicative decrease on
+ * the key rate.
+ *
+ * Every report the host collects within two polls (plus PACING_SLACK_US)
+ * of being submitted is healthy; after PACING_WINDOW healthy reports in a
+ * row the rate goes up by PACING_RATE_STEP keys per second. A late
+ * completion, a stalled endpoint or a send that had to be retried halves
+ * the rate at once (at most once per PACING_WINDOW reports) and pauses
+ * speed-ups for PACING_HOLDOFF reports, so a host that lags (a VM, a
+ * remote console) is backed off within a report or two while a responsive
+ * one is probed upward slowly. The gap stays within [min_gap_us,
+ * max_gap_us]. */
+#define PACING_WINDOW       16
+#define PACING_HOLDOFF      64
+#define PACING_RATE_STEP    5
+#define PACING_SLACK_US     1000
+
+typedef struct {
+    uint32_t gap_us;
+    uint32_t min_gap_us;
+    uint32_t max_gap_us;
+    uint16_t healthy;       /* Healthy reports since the last change */
+    uint16_t holdoff;       /* Reports left before speeding up again */
+    uint32_t backoffs;
+} pacing_t;
+
+void pacing_init(pacing_t *p, uint32_t gap_us, uint32_t min_gap_us, uint32_t max_gap_us);
+/* A report was collected latency_us after it was submitted */
+void pacing_on_report(pacing_t *p, uint32_t latency_us, uint32_t poll_us);
+/* The host fell behind: a stall or a retried send */
+void pacing_on_congestion(pacing_t *p);
@@ -1,6 +1,8 @@
 #include "serial_cmd.h"
 #include "nvs_storage.h"
 #include "audit_log.h"
+#include "usb_hid.h"
+#include "typing_engine.h"
 #include "esp_log.h"
 #include "esp_system.h"
 #include "freertos/FreeRTOS.h"
@@ -28,6 +30,23 @@ static void cmd_heap(void)
            (unsigned long)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
 }
 
+static void cmd_timing(void)
+{
+    usb_hid_timing_stats_t timing;
+    usb_hid_get_timing_stats(&timing);
+    printf("USB poll interval: %u ms\n", usb_hid_get_poll_interval_ms());
+    printf("Pacing: %s, gap %lu us\n", typing_engine_get_adaptive() ? "adaptive" : "fixed",
+           (unsigned long)typing_engine_get_gap_us());
+    printf("Paced reports: %lu\n", (unsigned long)timing.samples);
+    if (timing.samples == 0) return;
+    printf("Last gap: requested %lu us, measured %lu us\n",
+           (unsigned long)timing.last_requested_us,
+           (unsigned long)timing.last_measured_us);
+    printf("Jitter: avg %lu us, max %lu us\n",
+           (unsigned long)(timing.total_abs_error_us / timing.samples),
+           (unsigned long)timing.max_abs_error_us);
+}
+
 static void cmd_factory_reset(void)
 {
     printf("Factory reset in progress...\n");
@@ -58,6 +77,7 @@ static void cmd_help(void)
     printf("Commands:\n");
     printf("  status           - Show device status\n");
     printf("  heap             - Show heap usage\n");
+    printf("  timing           - Show key pacing jitter\n");
     printf("  factory_reset    - Wipe PIN/WiFi, reboot to provisioning\n");
     printf("  full_reset       - Wipe everything, reboot to provisioning\n");
     printf("  reboot           - Reboot device\n");
@@ -80,6 +100,8 @@ static void process_command(const char *cmd)
         cmd_status();
     } else if (strcmp(buf, "heap") == 0) {
         cmd_heap();
+    } else if (strcmp(buf, "timing") == 0) {
+        cmd_timing();
     } else if (strcmp(buf, "factory_reset") == 0) {
         cmd_factory_reset();
     } else if (strcmp(buf, "full_reset") == 0) {
@@ -0,0 +1,635 @@
+#include "spool.h"
+#include "typing_engine.h"
+#include "key_stream.h"
+#include "spsc_ring.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <string.h>
+
+static const char *TAG = "spool";
+
+#define SECTOR_SIZE         4096
+#define META_SECTORS        2
+#define RECORD_SIZE         16
+#define RECORDS_PER_SECTOR  (SECTOR_SIZE / RECORD_SIZE)
+#define RECORD_MAGIC        0x53504F4Cu     /* CRC seed: "SPOL" */
+#define MIN_DATA_SECTORS    4
+#define READ_WINDOW         (SPOOL_CHUNK * 2)
+#define STAGE_WRITE         256     /* Staged bytes written to flash per step */
+#define INFLIGHT_CHUNKS     64
+#define POLL_MS             50
+#define TASK_STACK          4096
+#define TASK_PRIORITY       3       /* Below the typing task */
+
+typedef struct {
+    uint32_t seq;
+    uint32_t head;
+    uint32_t cursor;
+    uint32_t crc;
+} spool_record_t;
+
+/* A chunk handed to the typing engine: once the drain job has typed
+ * 'keys' keystrokes, everything before log offset 'end' is done */
+typedef struct {
+    uint32_t end;
+    uint32_t keys;
+} inflight_t;
+
+static const esp_partition_t *s_part;
+static uint32_t s_data_size;
+static bool s_enabled;
+
+/* head, cursor, erased_end and the dirty state change under s_state_lock; the
+ * metadata sector is written under s_meta_lock. head counts staged text;
+ * appends are published to the staging ring under the lock too, so a
+ * failed flash write can drop them atomically. */
+static portMUX_TYPE s_state_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_head;
+static uint32_t s_cursor;
+static uint32_t s_epoch;            /* Bumped when staged text is dropped */
+static uint8_t s_stage_buf[SPOOL_STAGE_SIZE];
+static spsc_ring_t s_stage;
+static uint32_t s_erased_end;       /* Appends may go up to here */
+static bool s_dirty;                /* Flash after head is not clean */
+static uint32_t s_skip_to;          /* Where to restart once drained, if dirty */
+static uint32_t s_discard_to;       /* Requested discard point */
+static bool s_discard_req;
+static SemaphoreHandle_t s_meta_lock;
+static uint32_t s_seq;
+static uint8_t s_meta_sector;
+static uint16_t s_meta_slot;
+
+/* Drain task only */
+static TaskHandle_t s_task_handle;
+static uint32_t s_written;          /* End of the text in flash */
+static bool s_save_pending;         /* Record cursor or discard in this pass */
+static bool s_head_save_pending;    /* Record s_written, at most every SPOOL_HEAD_SAVE_MS */
+static TickType_t s_saved_at;
+static uint32_t s_read;             /* Next byte to hand to the typing engine */
+static bool s_read_in_cmd;          /* s_read is inside an in-band command */
+static inflight_t s_inflight[INFLIGHT_CHUNKS];
+static uint8_t s_inflight_first;
+static uint8_t s_inflight_count;
+static uint32_t s_job_keys;         /* Keystrokes queued to the drain job */
+static volatile uint16_t s_job = TYPING_JOB_NONE;
+
+static uint32_t round_up(uint32_t offset)
+{
+    return (offset + SECTOR_SIZE - 1) & ~(uint32_t)(SECTOR_SIZE - 1);
+}
+
+static uint32_t round_down(uint32_t offset)
+{
+    return offset & ~(uint32_t)(SECTOR_SIZE - 1);
+}
+
+static uint32_t data_addr(uint32_t offset)
+{
+    return META_SECTORS * SECTOR_SIZE + offset % s_data_size;
+}
+
+static uint32_t record_crc(const spool_record_t *rec)
+{
+    return esp_rom_crc32_le(RECORD_MAGIC, (const uint8_t *)rec, offsetof(spool_record_t, crc));
+}
+
+static void write_record_locked(uint32_t head, uint32_t cursor)
+{
+    if (s_meta_slot == RECORDS_PER_SECTOR) {
+        s_meta_sector ^= 1;
+        s_meta_slot = 0;
+        esp_err_t err = esp_partition_erase_range(s_part, s_meta_sector * SECTOR_SIZE,
+                                                  SECTOR_SIZE);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Metadata erase failed: %s", esp_err_to_name(err));
+        }
+    }
+
+    spool_record_t rec = { .seq = ++s_seq, .head = head, .cursor = cursor };
+    rec.crc = record_crc(&rec);
+    esp_err_t err = esp_partition_write(s_part,
+                                        s_meta_sector * SECTOR_SIZE + s_meta_slot * RECORD_SIZE,
+                                        &rec, sizeof(rec));
+    s_meta_slot++;
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Metadata write failed: %s", esp_err_to_name(err));
+    }
+}
+
+/* Drain task (and init): head is what is in flash, not what is staged */
+static void save_state(void)
+{
+    xSemaphoreTake(s_meta_lock, portMAX_DELAY);
+    portENTER_CRITICAL(&s_state_lock);
+    uint32_t cursor = s_cursor;
+    portEXIT_CRITICAL(&s_state_lock);
+    if ((int32_t)(cursor - s_written) > 0) {
+        cursor = s_written;     /* Discarded up to text not yet in flash */
+    }
+    write_record_locked(s_written, cursor);
+    xSemaphoreGive(s_meta_lock);
+    s_save_pending = false;
+    s_head_save_pending = false;
+    s_saved_at = xTaskGetTickCount();
+}
+
+/* Find the newest valid record and the sector holding it; false if there
+ * is none */
+static bool load_state(spool_record_t *best, uint8_t *best_sector)
+{
+    spool_record_t recs[16];
+    bool found = false;
+
+    for (uint8_t sector = 0; sector < META_SECTORS; sector++) {
+        for (int i = 0; i < RECORDS_PER_SECTOR; i += 16) {
+            if (esp_partition_read(s_part, sector * SECTOR_SIZE + i * RECORD_SIZE,
+                                   recs, sizeof(recs)) != ESP_OK) {
+                break;
+            }
+            for (int j = 0; j < 16; j++) {
+                if (recs[j].crc != record_crc(&recs[j])) continue;
+                if (!found || (int32_t)(recs[j].seq - best->seq) > 0) {
+                    *best = recs[j];
+                    *best_sector = sector;
+                    found = true;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+/* True if the rest of head's sector still reads as erased */
+static bool tail_erased(uint32_t head)
+{
+    uint8_t buf[64];
+    uint32_t end = round_up(head);
+
+    while (head < end) {
+        uint32_t n = end - head < sizeof(buf) ? end - head : sizeof(buf);
+        if (esp_partition_read(s_part, data_addr(head), buf, n) != ESP_OK) return false;
+        for (uint32_t i = 0; i < n; i++) {
+            if (buf[i] != 0xFF) return false;
+        }
+        head += n;
+    }
+    return true;
+}
+
+static void notify_task(void)
+{
+    if (s_task_handle != NULL) {
+        xTaskNotifyGive(s_task_handle);
+    }
+}
+
+/* Erase the next sector ahead of head if typing has moved past everything
+ * it held. Returns true if there may be more to erase. */
+static bool erase_ahead(void)
+{
+    portENTER_CRITICAL(&s_state_lock);
+    uint32_t end = s_erased_end;
+    uint32_t limit = round_down(s_cursor) + s_data_size;
+    bool dirty = s_dirty;
+    portEXIT_CRITICAL(&s_state_lock);
+
+    if (dirty || end + SECTOR_SIZE > limit) return false;
+    esp_err_t err = esp_partition_erase_range(s_part, data_addr(end), SECTOR_SIZE);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Erase at %lu failed: %s", (unsigned long)end, esp_err_to_name(err));
+        return false;
+    }
+
+    portENTER_CRITICAL(&s_state_lock);
+    s_erased_end = end + SECTOR_SIZE;
+    portEXIT_CRITICAL(&s_state_lock);
+    return true;
+}
+
+/* Forget everything before 'to' and stop the job typing it */
+static void discard_to(uint32_t to)
+{
+    if ((int32_t)(to - s_read) > 0) {
+        s_read = to;
+        s_read_in_cmd = false;
+    }
+    portENTER_CRITICAL(&s_state_lock);
+    if ((int32_t)(to - s_cursor) > 0) {
+        s_cursor = to;
+    }
+    portEXIT_CRITICAL(&s_state_lock);
+
+    s_inflight_count = 0;
+    if (s_job != TYPING_JOB_NONE) {
+        (void)typing_engine_job_cancel(s_job);
+        s_job = TYPING_JOB_NONE;
+    }
+    s_save_pending = true;
+    ESP_LOGI(TAG, "Discarded up to %lu", (unsigned long)to);
+}
+
+/* Pick how much of the window to hand over: up to SPOOL_CHUNK bytes,
+ * ending outside an in-band command and not inside a UTF-8 sequence, so
+ * typing can resume from the cut after a reset. 'last' means the window
+ * ends at head. Returns 0 to wait for more text. */
+static uint32_t choose_cut(const uint8_t *buf, uint32_t n, bool last, bool can_wait,
+                           bool *in_cmd)
+{
+    bool cmd = *in_cmd;
+    uint32_t cut = 0;
+    bool cut_cmd = cmd;
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (buf[i] == KEY_STREAM_ESC) {
+            cmd = !cmd;
+        }
+        bool boundary = i + 1 == n ? last : (buf[i + 1] & 0xC0) != 0x80;
+        if (cmd || !boundary) continue;
+        if (cut > 0 && i + 1 > SPOOL_CHUNK) break;
+        cut = i + 1;
+        cut_cmd = cmd;
+        if (cut >= SPOOL_CHUNK) break;
+    }
+    if (cut == 0) {
+        /* A command still arriving: wait for its end while typing has
+         * something else to do, otherwise let the encoder deal with it */
+        if (last && can_wait) return 0;
+        cut = n;
+        cut_cmd = cmd;
+    }
+    *in_cmd = cut_cmd;
+    return cut;
+}
+
+/* Hand spooled text to the typing engine while it has room */
+static void feed(void)
+{
+    uint8_t buf[READ_WINDOW];
+    uint32_t head = s_written;
+
+    /* A discard may have moved s_read past text still being staged */
+    while ((int32_t)(head - s_read) > 0 && s_inflight_count < INFLIGHT_CHUNKS) {
+        uint32_t n = head - s_read;
+        bool last = n <= READ_WINDOW;
+        if (!last) {
+            n = READ_WINDOW;
+        }
+        uint32_t ring_left = s_data_size - s_read % s_data_size;
+        uint32_t first = n < ring_left ? n : ring_left;
+        if (esp_partition_read(s_part, data_addr(s_read), buf, first) != ESP_OK ||
+            (first < n && esp_partition_read(s_part, data_addr(s_read + first),
+                                             buf + first, n - first) != ESP_OK)) {
+            ESP_LOGE(TAG, "Read at %lu failed", (unsigned long)s_read);
+            return;
+        }
+
+        bool in_cmd = s_read_in_cmd;
+        uint32_t cut = choose_cut(buf, n, last, s_inflight_count > 0, &in_cmd);
+        if (cut == 0) return;
+
+        if (s_job == TYPING_JOB_NONE) {
+            s_job = typing_engine_job_open(TYPING_LANE_BULK);
+            if (s_job == TYPING_JOB_NONE) return;
+            s_job_keys = 0;
+        }
+
+        typing_write_t w;
+        typing_engine_enqueue_begin(&w, s_job);
+        typing_engine_enqueue_measure(&w, (const char *)buf, cut);
+        esp_err_t err = typing_engine_enqueue_reserve(&w);
+        if (err == ESP_ERR_NO_MEM) return;  /* Lane full: typing will drain it */
+        if (err != ESP_OK) {
+            discard_to(head);               /* Job cancelled */
+            return;
+        }
+        typing_engine_enqueue_segment(&w, (const char *)buf, cut);
+        typing_engine_enqueue_commit(&w);
+
+        s_read += cut;
+        s_read_in_cmd = in_cmd;
+        s_job_keys += w.size.keystrokes;
+        inflight_t *chunk = &s_inflight[(s_inflight_first + s_inflight_count) % INFLIGHT_CHUNKS];
+        chunk->end = s_read;
+        chunk->keys = s_job_keys;
+        s_inflight_count++;
+    }
+}
+
+/* Move the cursor past chunks that have been typed */
+static void settle(void)
+{
+    typing_progress_t progress;
+
+    if (s_job == TYPING_JOB_NONE) return;
+    if (typing_engine_job_progress(s_job, &progress) != ESP_OK || progress.cancelled) {
+        portENTER_CRITICAL(&s_state_lock);
+        uint32_t head = s_head;
+        portEXIT_CRITICAL(&s_state_lock);
+        discard_to(head);
+        return;
+    }
+
+    uint32_t cursor = 0;
+    bool moved = false;
+    while (s_inflight_count > 0 && s_inflight[s_inflight_first].keys <= progress.typed) {
+        cursor = s_inflight[s_inflight_first].end;
+        s_inflight_first = (s_inflight_first + 1) % INFLIGHT_CHUNKS;
+        s_inflight_count--;
+        moved = true;
+    }
+    if (moved) {
+        portENTER_CRITICAL(&s_state_lock);
+        s_cursor = cursor;
+        portEXIT_CRITICAL(&s_state_lock);
+        s_save_pending = true;
+    }
+
+    portENTER_CRITICAL(&s_state_lock);
+    bool drained = s_inflight_count == 0 && s_read == s_head;
+    portEXIT_CRITICAL(&s_state_lock);
+    if (drained) {
+        typing_engine_job_close(s_job);
+        s_job = TYPING_JOB_NONE;
+    }
+}
+
+/* After dirty flash past head (a reset or failed write during an append),
+ * nothing more can be appended until the spool is empty; then both ends
+ * move to the next clean sector */
+static void restart_if_drained(void)
+{
+    portENTER_CRITICAL(&s_state_lock);
+    bool restart = s_dirty && s_cursor == s_head && s_read == s_head;
+    if (restart) {
+        s_head = s_cursor = s_erased_end = s_skip_to;
+        s_read = s_written = s_skip_to;
+        s_dirty = false;
+    }
+    portEXIT_CRITICAL(&s_state_lock);
+
+    if (restart) {
+        s_read_in_cmd = false;
+        s_save_pending = true;
+    }
+}
+
+/* Write staged text to flash. If a write fails, the flash after it is no
+ * longer clean: the rest of the staged text is dropped with it, and so is
+ * an append still being staged (its epoch no longer matches). */
+static void write_staged(void)
+{
+    uint8_t buf[STAGE_WRITE];
+    uint32_t n;
+
+    while ((n = spsc_ring_peek(&s_stage, 0, buf, sizeof(buf))) > 0) {
+        esp_err_t err = ESP_OK;
+        uint32_t done = 0;
+        while (done < n && err == ESP_OK) {
+            uint32_t ring_left = s_data_size - (s_written + done) % s_data_size;
+            uint32_t len = n - done < ring_left ? n - done : ring_left;
+            err = esp_partition_write(s_part, data_addr(s_written + done), buf + done, len);
+            done += len;
+        }
+
+        if (err != ESP_OK) {
+            portENTER_CRITICAL(&s_state_lock);
+            uint32_t dropped = s_head - s_written;
+            spsc_ring_consume(&s_stage, spsc_ring_used(&s_stage));
+            s_head = s_written;
+            s_erased_end = s_written;
+            s_dirty = true;
+            s_skip_to = round_up(s_written + n);
+            s_epoch++;
+            portEXIT_CRITICAL(&s_state_lock);
+            ESP_LOGE(TAG, "Write at %lu failed: %s, %lu staged bytes dropped",
+                     (unsigned long)s_written, esp_err_to_name(err), (unsigned long)dropped);
+            return;
+        }
+        spsc_ring_consume(&s_stage, n);
+        s_written += n;
+        s_head_save_pending = true;
+    }
+}
+
+/* One state record per pass; head alone waits out SPOOL_HEAD_SAVE_MS so a
+ * stream of small appends does not wear the metadata sectors. Returns the
+ * ticks until a deferred record is due. */
+static TickType_t save_if_due(void)
+{
+    TickType_t wait = pdMS_TO_TICKS(POLL_MS);
+
+    if (s_head_save_pending && !s_save_pending) {
+        TickType_t since = xTaskGetTickCount() - s_saved_at;
+        if (since < pdMS_TO_TICKS(SPOOL_HEAD_SAVE_MS)) {
+            TickType_t left = pdMS_TO_TICKS(SPOOL_HEAD_SAVE_MS) - since;
+            return left < wait ? left : wait;
+        }
+    }
+    if (s_save_pending || s_head_save_pending) {
+        save_state();
+    }
+    return wait;
+}
+
+static void spool_task(void *arg)
+{
+    while (1) {
+        portENTER_CRITICAL(&s_state_lock);
+        bool discard = s_discard_req;
+        uint32_t to = s_discard_to;
+        s_discard_req = false;
+        portEXIT_CRITICAL(&s_state_lock);
+        if (discard) {
+            discard_to(to);
+        }
+
+        write_staged();
+        restart_if_drained();
+        bool more = erase_ahead();
+        feed();
+        settle();
+        TickType_t wait = save_if_due();
+        ulTaskNotifyTake(pdTRUE, more ? 0 : wait);
+    }
+}
+
+esp_err_t spool_init(void)
+{
+    s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                      SPOOL_PARTITION_SUBTYPE, "spool");
+    if (s_part == NULL) {
+        ESP_LOGW(TAG, "No spool partition, bulk text goes straight to the typing queue");
+        return ESP_OK;
+    }
+    s_data_size = round_down(s_part->size) - META_SECTORS * SECTOR_SIZE;
+    if (round_down(s_part->size) < (META_SECTORS + MIN_DATA_SECTORS) * SECTOR_SIZE) {
+        ESP_LOGW(TAG, "Spool partition too small (%lu bytes)", (unsigned long)s_part->size);
+        s_part = NULL;
+        return ESP_OK;
+    }
+
+    s_meta_lock = xSemaphoreCreateMutex();
+    if (s_meta_lock == NULL) return ESP_ERR_NO_MEM;
+    spsc_ring_init(&s_stage, s_stage_buf, sizeof(s_stage_buf));
+
+    spool_record_t rec;
+    uint8_t sector = 1;
+    if (load_state(&rec, &sector)) {
+        s_seq = rec.seq;
+        s_head = rec.head;
+        s_cursor = rec.cursor;
+    }
+    s_read = s_cursor;
+    s_written = s_head;
+
+    /* Text after head may belong to an append cut short by the reset */
+    if (tail_erased(s_head)) {
+        s_erased_end = round_up(s_head);
+    } else {
+        s_erased_end = s_head;
+        s_dirty = true;
+        s_skip_to = round_up(s_head + 1);
+    }
+
+    /* Continue in a freshly erased metadata sector, so a torn record never
+     * sits in front of the next one */
+    s_meta_sector = sector;
+    s_meta_slot = RECORDS_PER_SECTOR;
+    save_state();
+
+    if (xTaskCreate(spool_task, "spool", TASK_STACK, NULL, TASK_PRIORITY,
+                    &s_task_handle) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Spool: %lu KB, %lu bytes to type",
+             (unsigned long)(s_data_size / 1024), (unsigned long)(s_head - s_cursor));
+    return ESP_OK;
+}
+
+bool spool_available(void)
+{
+    return s_part != NULL;
+}
+
+void spool_set_enabled(bool enabled)
+{
+    s_enabled = enabled;
+    ESP_LOGI(TAG, "Spooling %s", enabled ? "enabled" : "disabled");
+}
+
+bool spool_is_enabled(void)
+{
+    return s_enabled;
+}
+
+bool spool_accepting(void)
+{
+    return s_part != NULL && s_enabled;
+}
+
+esp_err_t spool_append_begin(spool_write_t *w, size_t len)
+{
+    memset(w, 0, sizeof(*w));
+    if (s_part == NULL) return ESP_ERR_INVALID_STATE;
+
+    portENTER_CRITICAL(&s_state_lock);
+    uint32_t head = s_head;
+    uint32_t room = s_erased_end - s_head;
+    w->epoch = s_epoch;
+    portEXIT_CRITICAL(&s_state_lock);
+    uint32_t stage_room = spsc_ring_free(&s_stage);
+
+    if (len > room || len > stage_room) {
+        ESP_LOGW(TAG, "Spool full: need %u, have %lu (%lu staged)", (unsigned)len,
+                 (unsigned long)(room < stage_room ? room : stage_room),
+                 (unsigned long)spsc_ring_used(&s_stage));
+        return ESP_ERR_NO_MEM;
+    }
+    w->start = head;
+    w->pos = head;
+    w->end = head + len;
+    return ESP_OK;
+}
+
+void spool_append_data(spool_write_t *w, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+
+    if (w->err != ESP_OK) return;
+    if (len > w->end - w->pos) {
+        w->err = ESP_ERR_INVALID_SIZE;
+        return;
+    }
+    spsc_ring_stage(&s_stage, w->pos - w->start, p, len);
+    w->pos += len;
+}
+
+esp_err_t spool_append_commit(spool_write_t *w)
+{
+    if (w->err != ESP_OK) {
+        ESP_LOGE(TAG, "Append failed: %s", esp_err_to_name(w->err));
+        return w->err;
+    }
+
+    portENTER_CRITICAL(&s_state_lock);
+    bool current = w->epoch == s_epoch;
+    if (current) {
+        s_head = w->pos;
+        spsc_ring_commit(&s_stage, w->pos - w->start);
+    }
+    portEXIT_CRITICAL(&s_state_lock);
+    if (!current) {
+        ESP_LOGW(TAG, "Append dropped after a failed flash write");
+        return ESP_FAIL;
+    }
+    notify_task();
+    return ESP_OK;
+}
+
+esp_err_t spool_append(const void *data, size_t len)
+{
+    spool_write_t w;
+
+    esp_err_t err = spool_append_begin(&w, len);
+    if (err != ESP_OK) return err;
+    spool_append_data(&w, data, len);
+    return spool_append_commit(&w);
+}
+
+void spool_discard(void)
+{
+    if (s_part == NULL) return;
+    portENTER_CRITICAL(&s_state_lock);
+    s_discard_to = s_head;
+    s_discard_req = true;
+    portEXIT_CRITICAL(&s_state_lock);
+    notify_task();
+}
+
+uint32_t spool_free(void)
+{
+    if (s_part == NULL) return 0;
+    portENTER_CRITICAL(&s_state_lock);
+    uint32_t room = s_erased_end - s_head;
+    portEXIT_CRITICAL(&s_state_lock);
+    uint32_t stage_room = spsc_ring_free(&s_stage);
+    return room < stage_room ? room : stage_room;
+}
+
+uint32_t spool_pending(void)
+{
+    if (s_part == NULL) return 0;
+    portENTER_CRITICAL(&s_state_lock);
+    uint32_t pending = s_head - s_cursor;
+    portEXIT_CRITICAL(&s_state_lock);
+    return pending;
+}
+
+uint16_t spool_job(void)
+{
+    return s_job;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Flash spool: bulk text is appended to a log in the "spool" partition
+ * and drained into the typing engine by its own task, so an upload can run
+ * far ahead of typing and survive a reset.
+ *
+ * The partition starts with two metadata sectors holding 16-byte state
+ * records {seq, head, cursor, crc}; the newest valid one wins at boot. The
+ * rest is a ring of text addressed by free-running log offsets. head is the
+ * end of the committed text; cursor is where typing resumes: it only moves
+ * past text whose keystrokes have all been sent, in steps of at most
+ * SPOOL_CHUNK bytes, so a reset retypes at most that much. Sectors are
+ * erased ahead of head by the drain task once typing has passed them, and
+ * appends only go into erased space, so free space doubles as the upload
+ * window.
+ *
+ * Appends are copied into a RAM staging ring and written to flash by the
+ * drain task, so the caller (the BLE host task) never waits on flash. The
+ * state record is written at most once per pass of that task, and for
+ * head alone at most every SPOOL_HEAD_SAVE_MS: a reset loses at most that
+ * much of the upload. */
+#define SPOOL_PARTITION_SUBTYPE 0x40
+#define SPOOL_CHUNK             64
+#define SPOOL_STAGE_SIZE        4096    /* Power of two */
+#define SPOOL_HEAD_SAVE_MS      250
+
+esp_err_t spool_init(void);
+/* The partition exists and is usable */
+bool spool_available(void);
+void spool_set_enabled(bool enabled);
+bool spool_is_enabled(void);
+/* Available and enabled: new bulk text should be appended here */
+bool spool_accepting(void);
+
+/* One append, staged from several pieces. Usage: begin with the total
+ * length, add every piece, commit. One appender at a time. begin returns
+ * ESP_ERR_NO_MEM when there is not enough erased space or staging room and
+ * ESP_ERR_INVALID_STATE when the spool is unavailable; commit fails if a
+ * flash write failed since begin. */
+typedef struct {
+    uint32_t start;
+    uint32_t pos;
+    uint32_t end;
+    uint32_t epoch;
+    esp_err_t err;
+} spool_write_t;
+
+esp_err_t spool_append_begin(spool_write_t *w, size_t len);
+void spool_append_data(spool_write_t *w, const void *data, size_t len);
+esp_err_t spool_append_commit(spool_write_t *w);
+esp_err_t spool_append(const void *data, size_t len);
+
+/* Drop everything spooled so far and cancel the typing job draining it */
+void spool_discard(void);
+
+/* Bytes that can be appended right now: erased space, bounded by staging */
+uint32_t spool_free(void);
+/* Bytes appended but not yet typed */
+uint32_t spool_pending(void);
+/* Typing job currently draining the spool, TYPING_JOB_NONE if idle */
+uint16_t spool_job(void);
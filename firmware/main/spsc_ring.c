@@ -0,0 +1,88 @@
+#include "spsc_ring.h"
+#include <string.h>
+
+void spsc_ring_init(spsc_ring_t *ring, uint8_t *buf, uint32_t size)
+{
+    ring->buf = buf;
+    ring->mask = size - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+}
+
+uint32_t spsc_ring_used(spsc_ring_t *ring)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    return tail - head;
+}
+
+uint32_t spsc_ring_free(spsc_ring_t *ring)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    return ring->mask + 1 - (tail - head);
+}
+
+/* Copy between linear memory and the ring at a free-running position, in at
+ * most two spans */
+static void copy_in(spsc_ring_t *ring, uint32_t pos, const uint8_t *src, uint32_t len)
+{
+    uint32_t start = pos & ring->mask;
+    uint32_t first = ring->mask + 1 - start;
+    if (first > len) first = len;
+    memcpy(ring->buf + start, src, first);
+    memcpy(ring->buf, src + first, len - first);
+}
+
+static void copy_out(spsc_ring_t *ring, uint32_t pos, uint8_t *dst, uint32_t len)
+{
+    uint32_t start = pos & ring->mask;
+    uint32_t first = ring->mask + 1 - start;
+    if (first > len) first = len;
+    memcpy(dst, ring->buf + start, first);
+    memcpy(dst + first, ring->buf, len - first);
+}
+
+void spsc_ring_stage(spsc_ring_t *ring, uint32_t offset, const void *data, uint32_t len)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    copy_in(ring, tail + offset, data, len);
+}
+
+void spsc_ring_commit(spsc_ring_t *ring, uint32_t len)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + len, memory_order_release);
+}
+
+bool spsc_ring_write(spsc_ring_t *ring, const void *data, uint32_t len)
+{
+    if (len > spsc_ring_free(ring)) {
+        return false;
+    }
+    spsc_ring_stage(ring, 0, data, len);
+    spsc_ring_commit(ring, len);
+    return true;
+}
+
+uint32_t spsc_ring_peek(spsc_ring_t *ring, uint32_t offset, void *dst, uint32_t len)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    uint32_t avail = tail - head;
+
+    if (offset >= avail) {
+        return 0;
+    }
+    if (len > avail - offset) {
+        len = avail - offset;
+    }
+    copy_out(ring, head + offset, dst, len);
+    return len;
+}
+
+void spsc_ring_consume(spsc_ring_t *ring, uint32_t len)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + len, memory_order_release);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/* Lock-free single-producer/single-consumer byte ring.
+ *
+ * head and tail are free-running counters; the size must be a power of two
+ * so they can be masked instead of reduced with '%'. Only the producer
+ * advances tail (release) and only the consumer advances head (release);
+ * each side reads the other's index with acquire ordering, so the bytes
+ * behind an index are visible before the index itself. */
+typedef struct {
+    uint8_t *buf;
+    uint32_t mask;
+    atomic_uint_least32_t head;
+    atomic_uint_least32_t tail;
+} spsc_ring_t;
+
+void spsc_ring_init(spsc_ring_t *ring, uint8_t *buf, uint32_t size);
+
+/* Either side */
+uint32_t spsc_ring_used(spsc_ring_t *ring);
+
+/* Producer side. spsc_ring_stage() copies into free space 'offset' bytes past
+ * the tail without publishing it; spsc_ring_commit() publishes 'len' staged
+ * bytes at once, so the consumer never sees a partial write. */
+uint32_t spsc_ring_free(spsc_ring_t *ring);
+void spsc_ring_stage(spsc_ring_t *ring, uint32_t offset, const void *data, uint32_t len);
+void spsc_ring_commit(spsc_ring_t *ring, uint32_t len);
+bool spsc_ring_write(spsc_ring_t *ring, const void *data, uint32_t len);
+
+/* Consumer side. spsc_ring_peek() copies up to 'len' bytes starting 'offset'
+ * bytes past the head and returns how many were available. */
+uint32_t spsc_ring_peek(spsc_ring_t *ring, uint32_t offset, void *dst, uint32_t len);
+void spsc_ring_consume(spsc_ring_t *ring, uint32_t len);
@@ -0,0 +1,76 @@
+#include "status_bin.h"
+#include <string.h>
+
+typedef struct {
+    uint8_t offset;
+    uint8_t size;
+} status_bin_field_t;
+
+#define FIELD(name) { offsetof(status_bin_t, name), sizeof(((status_bin_t *)0)->name) }
+
+/* Indexed by STATUS_BIN_FIELD_* */
+static const status_bin_field_t FIELDS[STATUS_BIN_FIELD_COUNT] = {
+    FIELD(flags), FIELD(auth_error), FIELD(queue), FIELD(eta_ms),
+    FIELD(retry_delay_ms), FIELD(rx), FIELD(credit), FIELD(mtu), FIELD(phy),
+    FIELD(dle), FIELD(link), FIELD(itvl_us), FIELD(latency), FIELD(usb_poll_ms),
+    FIELD(jitter_avg_us), FIELD(jitter_max_us), FIELD(cmdq), FIELD(live_gaps),
+    FIELD(job), FIELD(next), FIELD(current), FIELD(total), FIELD(tid),
+    FIELD(spool), FIELD(rate_cpm), FIELD(gap_us), FIELD(tokens),
+};
+
+static uint32_t field_value(const status_bin_t *st, int field)
+{
+    const uint8_t *p = (const uint8_t *)st + FIELDS[field].offset;
+
+    switch (FIELDS[field].size) {
+    case 1:
+        return *p;
+    case 2: {
+        uint16_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    default: {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    }
+}
+
+static void put_le(uint8_t *out, uint32_t value, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+uint32_t status_bin_diff(const status_bin_t *prev, const status_bin_t *cur)
+{
+    uint32_t mask = 0;
+
+    for (int i = 0; i < STATUS_BIN_FIELD_COUNT; i++) {
+        if (field_value(prev, i) != field_value(cur, i)) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+size_t status_bin_encode(const status_bin_t *st, uint32_t mask, uint8_t *out, size_t size)
+{
+    size_t pos = STATUS_BIN_HEADER_LEN;
+
+    if (size < STATUS_BIN_HEADER_LEN) return 0;
+    mask &= STATUS_BIN_ALL_FIELDS;
+    out[0] = STATUS_BIN_VERSION;
+    put_le(out + 1, mask, 4);
+
+    for (int i = 0; i < STATUS_BIN_FIELD_COUNT; i++) {
+        if (!(mask & (1u << i))) continue;
+        if (pos + FIELDS[i].size > size) return 0;
+        put_le(out + pos, field_value(st, i), FIELDS[i].size);
+        pos += FIELDS[i].size;
+    }
+    return pos;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Compact binary status record.
+ *
+ * Every record, read or notified, is
+ *   [version u8][mask u32][field...]
+ * with the fields whose bit is set in mask following in field-index order,
+ * each little-endian at its fixed width (see STATUS_BIN_FIELD_*). A read
+ * carries every field; a notification only the ones that changed since
+ * the last record sent, so the client merges it into what it has. A new
+ * field is only ever appended with a new bit; anything else bumps the
+ * version. */
+#define STATUS_BIN_VERSION      1
+
+#define STATUS_BIN_FIELD_FLAGS          0   /* u8, STATUS_BIN_FLAG_* */
+#define STATUS_BIN_FIELD_AUTH_ERROR     1   /* u8: 0 none, 1 invalid_pin, 2 rate_limited, 3 locked_out */
+#define STATUS_BIN_FIELD_QUEUE          2   /* u32 */
+#define STATUS_BIN_FIELD_ETA_MS         3   /* u32 */
+#define STATUS_BIN_FIELD_RETRY_DELAY_MS 4   /* u32 */
+#define STATUS_BIN_FIELD_RX             5   /* u32 */
+#define STATUS_BIN_FIELD_CREDIT         6   /* u32 */
+#define STATUS_BIN_FIELD_MTU            7   /* u16 */
+#define STATUS_BIN_FIELD_PHY            8   /* u8 */
+#define STATUS_BIN_FIELD_DLE            9   /* u16 */
+#define STATUS_BIN_FIELD_LINK           10  /* u8: 0 none, 1 fast, 2 idle */
+#define STATUS_BIN_FIELD_ITVL_US        11  /* u32 */
+#define STATUS_BIN_FIELD_LATENCY        12  /* u16 */
+#define STATUS_BIN_FIELD_USB_POLL_MS    13  /* u8 */
+#define STATUS_BIN_FIELD_JITTER_AVG_US  14  /* u32 */
+#define STATUS_BIN_FIELD_JITTER_MAX_US  15  /* u32 */
+#define STATUS_BIN_FIELD_CMDQ           16  /* u8 */
+#define STATUS_BIN_FIELD_LIVE_GAPS      17  /* u32 */
+#define STATUS_BIN_FIELD_JOB            18  /* u16 */
+#define STATUS_BIN_FIELD_NEXT           19  /* u16 */
+#define STATUS_BIN_FIELD_CURRENT        20  /* u32: keys typed of typing job tid */
+#define STATUS_BIN_FIELD_TOTAL          21  /* u32: keys queued to typing job tid */
+#define STATUS_BIN_FIELD_TID            22  /* u16: typing job last reported */
+#define STATUS_BIN_FIELD_SPOOL          23  /* u32: spooled bytes not yet typed */
+#define STATUS_BIN_FIELD_RATE_CPM       24  /* u32: keystrokes per minute at the current pacing */
+#define STATUS_BIN_FIELD_GAP_US         25  /* u32: inter-key gap in effect */
+#define STATUS_BIN_FIELD_TOKENS         26  /* u32: keystrokes left in the rate limiter's bucket */
+#define STATUS_BIN_FIELD_COUNT          27
+
+#define STATUS_BIN_ALL_FIELDS   ((1u << STATUS_BIN_FIELD_COUNT) - 1)
+#define STATUS_BIN_HEADER_LEN   5
+#define STATUS_BIN_MAX_LEN      (STATUS_BIN_HEADER_LEN + 80)
+
+#define STATUS_BIN_FLAG_TYPING              0x01
+#define STATUS_BIN_FLAG_AUTHENTICATED       0x02
+#define STATUS_BIN_FLAG_KEYBOARD_CONNECTED  0x04
+#define STATUS_BIN_FLAG_LOCKED_OUT          0x08
+#define STATUS_BIN_FLAG_SPOOLING            0x10
+
+typedef struct {
+    uint8_t flags;
+    uint8_t auth_error;
+    uint32_t queue;
+    uint32_t eta_ms;
+    uint32_t retry_delay_ms;
+    uint32_t rx;
+    uint32_t credit;
+    uint16_t mtu;
+    uint8_t phy;
+    uint16_t dle;
+    uint8_t link;
+    uint32_t itvl_us;
+    uint16_t latency;
+    uint8_t usb_poll_ms;
+    uint32_t jitter_avg_us;
+    uint32_t jitter_max_us;
+    uint8_t cmdq;
+    uint32_t live_gaps;
+    uint16_t job;
+    uint16_t next;
+    uint32_t current;
+    uint32_t total;
+    uint16_t tid;
+    uint32_t spool;
+    uint32_t rate_cpm;
+    uint32_t gap_us;
+    uint32_t tokens;
+} status_bin_t;
+
+/* Mask of the fields that differ between two snapshots */
+uint32_t status_bin_diff(const status_bin_t *prev, const status_bin_t *cur);
+
+/* Encode the fields in mask. Returns the record length, or 0 if it does
+ * not fit in size. */
+size_t status_bin_encode(const status_bin_t *st, uint32_t mask, uint8_t *out, size_t size);
@@ -1,11 +1,16 @@
 #include "typing_engine.h"
 #include "usb_hid.h"
-#include "keymap_us.h"
+#include "key_stream.h"
+#include "keymap.h"
+#include "spsc_ring.h"
+#include "pacing.h"
 #include "neopixel.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include <stdatomic.h>
 #include <string.h>
 
 static const char *TAG = "typing_engine";
@@ -13,45 +18,371 @@ static const char *TAG = "typing_engine";
 #define DEFAULT_DELAY_MS    10
 #define MIN_DELAY_MS        5
 #define MAX_DELAY_MS        100
-#define KEY_PRESS_HOLD_MS   4
+#define MAX_HOLD_MS         50
+#define DEFAULT_RATE_LIMIT  0       /* Characters per minute, 0 = unlimited (the
+                                     * 1000/min policy cap is opt-in) */
+#define DEFAULT_RATE_BURST  500
+#define MAX_RATE_BURST      TYPING_QUEUE_MAX_SIZE
+#define TOKEN_UNITS         60000000LL  /* One character, in chars/min x us */
 #define KEY_RETRY_DELAY_MS  4
-#define KEY_RELEASE_GAP_MS  4
-
-static char s_queue[TYPING_QUEUE_MAX_SIZE];
-static volatile uint32_t s_queue_head;
-static volatile uint32_t s_queue_tail;
-static volatile uint32_t s_queue_total;
-static volatile uint32_t s_queue_typed;
-static volatile bool s_abort;
+/* pdMS_TO_TICKS() rounds short delays down to zero ticks (a bare yield)
+ * when the tick period is longer than the delay */
+#define KEY_RETRY_TICKS     (pdMS_TO_TICKS(KEY_RETRY_DELAY_MS) > 0 ? \
+                             pdMS_TO_TICKS(KEY_RETRY_DELAY_MS) : 1)
+#define RELEASE_ACK_TIMEOUT_MS  100
+#define DEFAULT_BATCH_KEYS  1
+#define MAX_BATCH_KEYS      6
+#define MODIFIER_USAGE_MIN  0xE0    /* Left Control; 0xE0..0xE7 map to modifier bits */
+#define MODIFIER_USAGE_MAX  0xE7
+#define BATCH_WINDOW        32      /* Stream bytes examined per batch */
+#define JOB_MARKER_LEN      3       /* OP_JOB and the job id, ahead of every write */
+#define SEGMENT_CHUNK       32      /* Input bytes encoded per staging copy */
+
+/* Next action taken from the stream: either a run of taps that is sent as
+ * one report, or a single non-tap opcode */
+typedef struct {
+    uint8_t op;             /* 0 for taps, otherwise a KEY_STREAM_OP_* code */
+    uint8_t arg;            /* Usage for OP_DOWN/OP_UP */
+    uint16_t delay_ms;      /* OP_DELAY */
+    uint16_t job;           /* OP_JOB */
+    uint8_t modifier;
+    uint8_t keycodes[MAX_BATCH_KEYS];
+    uint8_t count;          /* Keys placed in the report */
+    uint8_t skipped;        /* Taps of keys already held */
+    uint32_t consumed;      /* Stream bytes covered */
+} key_batch_t;
+
+typedef enum {
+    JOB_FREE = 0,
+    JOB_OPEN,
+    JOB_CLOSED,             /* No more writes */
+    JOB_CANCELLED,
+} job_state_t;
+
+/* A job's counters are updated by the producer on commit and by the
+ * consumer as it types, both under s_jobs_lock. A slot is freed by the
+ * consumer once every byte committed to it has been consumed, so a job
+ * marker in a lane always names a live slot. */
+typedef struct {
+    uint16_t id;
+    uint8_t lane;
+    uint8_t state;
+    bool auto_close;                /* Automatic job: finishes when drained */
+    bool writing;                   /* A producer is between begin and commit */
+    uint32_t queued_bytes;          /* Stream bytes committed, markers included */
+    uint32_t consumed_bytes;
+    uint32_t queued_keys;
+    uint32_t typed_keys;
+    uint32_t queued_chars;
+    uint32_t queued_delay_ms;
+    uint32_t done_delay_ms;
+    key_stream_escape_t escape;     /* Producer: command split across writes */
+    key_stream_utf8_t utf8;         /* Producer: character split across writes */
+} job_t;
+
+/* Each lane is a single-producer/single-consumer ring: enqueue (serialised
+ * by s_mutex) produces, the typing task consumes. Every committed write
+ * starts with an OP_JOB marker, so the consumer knows which job owns the
+ * bytes at the head of each lane. Abort and cancel only mark jobs; the
+ * consumer discards their bytes when it reaches them, so neither side ever
+ * resets the other's state. */
+typedef struct {
+    spsc_ring_t ring;
+    uint8_t modifier;               /* Consumer: tap modifier at the stream head */
+    int8_t slot;                    /* Consumer: job owning the stream head */
+    uint32_t key_cost;              /* Consumer: token units per keystroke of that job */
+} lane_t;
+
+static uint8_t s_bulk_buf[TYPING_QUEUE_MAX_SIZE];
+static uint8_t s_interactive_buf[TYPING_INTERACTIVE_QUEUE_SIZE];
+static lane_t s_lanes[TYPING_LANE_COUNT];
+static job_t s_jobs[TYPING_MAX_JOBS];
+static portMUX_TYPE s_jobs_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint16_t s_next_job_id = 1;
+static int s_auto_slot = -1;                /* Automatic job, under s_jobs_lock */
+static atomic_uint s_abort_epoch;
+static uint32_t s_seen_epoch;               /* Consumer: last abort handled */
 static volatile bool s_typing;
 static uint16_t s_delay_ms = DEFAULT_DELAY_MS;
+static uint8_t s_hold_ms;
+static bool s_adaptive;
+static volatile bool s_pacing_reset = true;  /* Restart the controller from s_delay_ms */
+static pacing_t s_pacing;                   /* Typing task only */
+/* Token bucket: s_bucket gains s_rate_limit units per microsecond up to
+ * s_rate_burst characters, and every character typed takes TOKEN_UNITS.
+ * The stream carries keystrokes, so each one is charged its job's share:
+ * a Unicode entry sequence costs one character, not one per digit. */
+static volatile uint16_t s_rate_limit = DEFAULT_RATE_LIMIT;
+static volatile uint16_t s_rate_burst = DEFAULT_RATE_BURST;
+static int64_t s_bucket;                    /* Typing task only */
+static int64_t s_bucket_us;
+static volatile uint32_t s_tokens;          /* Whole characters in the bucket */
+static volatile uint32_t s_key_cost = TOKEN_UNITS;  /* Of the last keystroke charged */
+static uint32_t s_send_retries;             /* Typing task: sends the FIFO refused */
+static uint32_t s_seen_retries;
+static uint32_t s_seen_acked;
+static uint32_t s_seen_stalls;
+static uint8_t s_batch_keys = DEFAULT_BATCH_KEYS;
+static typing_hid_mode_t s_hid_mode = TYPING_HID_BOOT;
+static const keymap_layout_t *s_layout;     /* Written under s_mutex */
+static key_stream_unicode_t s_unicode;      /* Written under s_mutex */
+static uint8_t s_held[MAX_BATCH_KEYS];      /* Keys held by OP_DOWN */
+static uint8_t s_held_count;
+static uint8_t s_held_modifier;
+static uint8_t s_held_lane;                 /* Lane whose OP_DOWN holds them */
+static uint8_t s_cur_lane;                  /* Lane of the batch being applied */
+static uint32_t s_gap_us;                   /* Spacing before the next report */
+static uint8_t s_nkro_key;          /* Key left pressed on the NKRO interface */
+static uint8_t s_nkro_modifier;
+static bool s_nkro_dirty;           /* Host may still see NKRO keys down */
 static typing_progress_cb_t s_progress_cb;
-static SemaphoreHandle_t s_mutex;
+static SemaphoreHandle_t s_mutex;          /* Serialises producers only */
 static TaskHandle_t s_task_handle;
 static led_state_t s_prev_led_state;
 
-static uint32_t queue_used(void)
+static bool abort_pending(void)
+{
+    return atomic_load(&s_abort_epoch) != s_seen_epoch;
+}
+
+static bool slot_live(int slot)
+{
+    return slot >= 0 && s_jobs[slot].state != JOB_FREE;
+}
+
+/* Keystrokes and explicit delays still to come, cancelled jobs excluded */
+static void pending_work(uint32_t *keys, uint32_t *delay_ms)
 {
-    if (s_queue_tail >= s_queue_head) {
-        return s_queue_tail - s_queue_head;
+    uint32_t k = 0;
+    uint32_t d = 0;
+
+    portENTER_CRITICAL(&s_jobs_lock);
+    for (int i = 0; i < TYPING_MAX_JOBS; i++) {
+        const job_t *job = &s_jobs[i];
+        if (job->state == JOB_FREE || job->state == JOB_CANCELLED) continue;
+        k += job->queued_keys - job->typed_keys;
+        d += job->queued_delay_ms - job->done_delay_ms;
     }
-    return TYPING_QUEUE_MAX_SIZE - s_queue_head + s_queue_tail;
+    portEXIT_CRITICAL(&s_jobs_lock);
+    *keys = k;
+    *delay_ms = d;
 }
 
-static bool queue_pop(char *ch)
+static uint32_t pending_keys(void)
 {
-    if (s_queue_head == s_queue_tail) return false;
-    *ch = s_queue[s_queue_head];
-    s_queue_head = (s_queue_head + 1) % TYPING_QUEUE_MAX_SIZE;
-    return true;
+    uint32_t keys;
+    uint32_t delay_ms;
+    pending_work(&keys, &delay_ms);
+    return keys;
+}
+
+/* Caller holds s_jobs_lock */
+static int open_job_locked(typing_lane_t lane, bool auto_close)
+{
+    for (int i = 0; i < TYPING_MAX_JOBS; i++) {
+        if (s_jobs[i].state != JOB_FREE) continue;
+        memset(&s_jobs[i], 0, sizeof(s_jobs[i]));
+        s_jobs[i].id = s_next_job_id++;
+        if (s_next_job_id == TYPING_JOB_NONE) {
+            s_next_job_id++;
+        }
+        s_jobs[i].lane = lane;
+        s_jobs[i].state = JOB_OPEN;
+        s_jobs[i].auto_close = auto_close;
+        return i;
+    }
+    return -1;
+}
+
+/* Caller holds s_jobs_lock */
+static int find_job_locked(uint16_t id)
+{
+    for (int i = 0; i < TYPING_MAX_JOBS; i++) {
+        if (s_jobs[i].state != JOB_FREE && s_jobs[i].id == id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void fill_progress(const job_t *job, typing_progress_t *progress)
+{
+    progress->job = job->id;
+    progress->lane = (typing_lane_t)job->lane;
+    progress->typed = job->typed_keys;
+    progress->total = job->queued_keys;
+    progress->done = false;
+    progress->cancelled = job->state == JOB_CANCELLED;
+}
+
+static void report_progress(int slot)
+{
+    typing_progress_t progress;
+
+    if (s_progress_cb == NULL || !slot_live(slot)) return;
+    portENTER_CRITICAL(&s_jobs_lock);
+    fill_progress(&s_jobs[slot], &progress);
+    portEXIT_CRITICAL(&s_jobs_lock);
+    s_progress_cb(&progress);
+}
+
+/* Free jobs that have nothing left in their lane and will get no more
+ * writes, and report them as done */
+static void reap_jobs(void)
+{
+    for (int i = 0; i < TYPING_MAX_JOBS; i++) {
+        typing_progress_t progress;
+        bool finished = false;
+        bool report = false;
+
+        portENTER_CRITICAL(&s_jobs_lock);
+        job_t *job = &s_jobs[i];
+        if (job->state != JOB_FREE && !job->writing &&
+            job->consumed_bytes == job->queued_bytes &&
+            (job->state != JOB_OPEN || job->auto_close)) {
+            fill_progress(job, &progress);
+            progress.done = true;
+            /* An automatic job that never got a write has nothing to report */
+            report = !job->auto_close || job->queued_bytes > 0;
+            job->state = JOB_FREE;
+            if (s_auto_slot == i) {
+                s_auto_slot = -1;
+            }
+            finished = true;
+        }
+        portEXIT_CRITICAL(&s_jobs_lock);
+
+        if (!finished) continue;
+        for (int l = 0; l < TYPING_LANE_COUNT; l++) {
+            if (s_lanes[l].slot == i) {
+                s_lanes[l].slot = -1;
+            }
+        }
+        if (s_progress_cb && report) {
+            s_progress_cb(&progress);
+        }
+    }
+}
+
+static bool lane_job_cancelled(const lane_t *lane)
+{
+    return slot_live(lane->slot) && s_jobs[lane->slot].state == JOB_CANCELLED;
+}
+
+/* Remove typed or discarded bytes from a lane and charge them to the job
+ * that owns them */
+static void consume(lane_t *lane, uint32_t bytes, uint32_t keys, uint32_t delay_ms)
+{
+    spsc_ring_consume(&lane->ring, bytes);
+    if (!slot_live(lane->slot)) return;
+
+    portENTER_CRITICAL(&s_jobs_lock);
+    job_t *job = &s_jobs[lane->slot];
+    job->consumed_bytes += bytes;
+    job->typed_keys += keys;
+    job->done_delay_ms += delay_ms;
+    portEXIT_CRITICAL(&s_jobs_lock);
+}
+
+/* Take the next action from the stream. Taps are grouped into a run that can
+ * share a single report: same modifier and no repeated keycode (a repeat
+ * needs a release in between). Hosts turn newly pressed usages into key-down
+ * events in array order, so filling the slots in stream order types the run
+ * in the original sequence. Returns false if the queue is empty. */
+static bool collect_batch(lane_t *lane, key_batch_t *batch, uint8_t max_keys)
+{
+    uint8_t window[BATCH_WINDOW];
+    uint32_t avail = spsc_ring_peek(&lane->ring, 0, window, sizeof(window));
+
+    memset(batch, 0, sizeof(*batch));
+    batch->modifier = lane->modifier;
+    while (batch->count < max_keys && batch->consumed < avail) {
+        uint8_t op = window[batch->consumed];
+        if (op < KEY_STREAM_OP_FIRST) {
+            if (op == 0 || memchr(batch->keycodes, op, batch->count) != NULL ||
+                memchr(s_held, op, s_held_count) != NULL) {
+                if (batch->count > 0) break;
+                batch->skipped++;   /* Tap of a held key: nothing to send */
+                batch->consumed++;
+                continue;
+            }
+            batch->keycodes[batch->count++] = op;
+            batch->consumed++;
+            continue;
+        }
+
+        uint8_t operands[2] = {0};
+        size_t op_len = key_stream_op_len(op);
+        if (batch->consumed + op_len > avail) {
+            break;  /* Operands past the window: take it next time */
+        }
+        memcpy(operands, &window[batch->consumed + 1], op_len - 1);
+
+        if (op == KEY_STREAM_OP_MOD) {
+            if (batch->count > 0 && operands[0] != batch->modifier) {
+                break;
+            }
+            batch->modifier = operands[0];
+            batch->consumed += op_len;
+            continue;
+        }
+
+        /* Other opcodes are handled one at a time; a job marker also starts
+         * its own batch, so bytes before it are charged to the previous job */
+        if (batch->count > 0 || (op == KEY_STREAM_OP_JOB && batch->consumed > 0)) {
+            break;
+        }
+        batch->op = op;
+        batch->arg = operands[0];
+        batch->delay_ms = operands[0] | (operands[1] << 8);
+        batch->job = batch->delay_ms;
+        batch->consumed += op_len;
+        break;
+    }
+    return batch->consumed > 0;
+}
+
+/* Report keys: held keys first, then the new ones */
+static uint8_t build_keys(const uint8_t *keys, uint8_t count, uint8_t out[MAX_BATCH_KEYS])
+{
+    uint8_t n = 0;
+
+    memset(out, 0, MAX_BATCH_KEYS);
+    for (uint8_t i = 0; i < s_held_count && n < MAX_BATCH_KEYS; i++) {
+        out[n++] = s_held[i];
+    }
+    for (uint8_t i = 0; i < count && n < MAX_BATCH_KEYS; i++) {
+        out[n++] = keys[i];
+    }
+    return n;
+}
+
+static esp_err_t release_all_keys(void)
+{
+    if (s_nkro_dirty && usb_hid_nkro_active()) {
+        esp_err_t nkro_err = usb_hid_send_nkro(0, NULL, 0);
+        if (nkro_err != ESP_OK) {
+            return nkro_err;
+        }
+    }
+    esp_err_t err = usb_hid_release_keys();
+    if (err == ESP_OK) {
+        s_nkro_key = 0;
+        s_nkro_modifier = 0;
+        s_nkro_dirty = false;
+        s_held_count = 0;
+        s_held_modifier = 0;
+    }
+    return err;
 }
 
 static bool ensure_keys_released(void)
 {
     /* If a single release report is missed, hosts can keep auto-repeating the
-     * last key. Retry a few times to guarantee key-up reaches the host. */
+     * last key. Retry until the host has actually collected the key-up. */
     for (int i = 0; i < 20; i++) {
-        if (usb_hid_release_keys() == ESP_OK) {
+        if (release_all_keys() == ESP_OK &&
+            usb_hid_wait_idle(RELEASE_ACK_TIMEOUT_MS) == ESP_OK) {
             return true;
         }
         vTaskDelay(pdMS_TO_TICKS(5));
@@ -60,90 +391,435 @@ static bool ensure_keys_released(void)
     return false;
 }
 
-static bool send_key_with_retry(uint8_t modifier, uint8_t keycode, char ch)
+static bool send_report_with_retry(uint8_t modifier, const uint8_t keycodes[MAX_BATCH_KEYS])
 {
-    for (int i = 0; i < 30 && !s_abort; i++) {
-        esp_err_t err = usb_hid_send_key(modifier, keycode);
+    for (int i = 0; i < 30 && !abort_pending(); i++) {
+        esp_err_t err = usb_hid_send_report(modifier, keycodes);
         if (err == ESP_OK) {
             return true;
         }
-        vTaskDelay(pdMS_TO_TICKS(KEY_RETRY_DELAY_MS));
+        s_send_retries++;
+        vTaskDelay(KEY_RETRY_TICKS);
     }
-    ESP_LOGW(TAG, "Key press failed after retries: char=0x%02x", (unsigned char)ch);
+    ESP_LOGW(TAG, "Key report failed after retries: key=0x%02x",
+             keycodes != NULL ? keycodes[0] : 0);
     return false;
 }
 
-static bool type_char(char ch)
+/* Press and release are queued back to back; the report FIFO sends the
+ * release on the poll after the press, which is the shortest hold the host
+ * can observe, or s_hold_ms later for hosts that sample slowly. Once the
+ * press is queued the batch counts as typed: retrying it would repeat the
+ * characters, and a lost release is caught by ensure_keys_released(). */
+static bool type_batch(const key_batch_t *batch)
 {
-    if ((uint8_t)ch >= 128) return true;  /* Skip non-ASCII */
+    uint8_t keys[MAX_BATCH_KEYS];
 
-    const hid_keymap_entry_t *entry = &KEYMAP_US[(uint8_t)ch];
-    if (entry->keycode == 0x00 && ch != 0) return true;  /* Unmapped character */
-
-    if (!send_key_with_retry(entry->modifier, entry->keycode, ch)) {
+    build_keys(batch->keycodes, batch->count, keys);
+    if (!send_report_with_retry(batch->modifier | s_held_modifier, keys)) {
         return false;
     }
+    build_keys(NULL, 0, keys);
+    if (s_hold_ms > 0) {
+        usb_hid_delay_next_us((uint32_t)s_hold_ms * 1000);
+    }
+    (void)send_report_with_retry(s_held_modifier, keys);
+    return true;
+}
 
-    neopixel_set_typing_key_down(true);
-    vTaskDelay(pdMS_TO_TICKS(KEY_PRESS_HOLD_MS));
-    if (!ensure_keys_released()) {
-        neopixel_set_typing_key_down(false);
+static bool send_nkro_with_retry(uint8_t modifier, const uint8_t *keycodes, size_t count)
+{
+    for (int i = 0; i < 30 && !abort_pending(); i++) {
+        if (usb_hid_send_nkro(modifier, keycodes, count) == ESP_OK) {
+            return true;
+        }
+        s_send_retries++;
+        vTaskDelay(KEY_RETRY_TICKS);
+    }
+    ESP_LOGW(TAG, "NKRO report failed after retries: key=0x%02x",
+             count > 0 ? keycodes[0] : 0);
+    return false;
+}
+
+/* Bitmap backend: the report that presses the next key also releases the
+ * previous one, so a character costs one report. An explicit key-up is only
+ * sent before repeating the held key or switching modifiers. The last key
+ * stays down until the next character or until the queue drains. */
+static bool type_nkro(const key_batch_t *batch)
+{
+    uint8_t key = batch->keycodes[0];
+    uint8_t modifier = batch->modifier | s_held_modifier;
+    uint8_t keys[MAX_BATCH_KEYS];
+    uint8_t count;
+
+    if (s_nkro_key != 0 && (s_nkro_key == key || s_nkro_modifier != modifier)) {
+        count = build_keys(NULL, 0, keys);
+        if (!send_nkro_with_retry(s_nkro_modifier, keys, count)) {
+            return false;
+        }
+        s_nkro_key = 0;
+    }
+
+    count = build_keys(&key, 1, keys);
+    if (!send_nkro_with_retry(modifier, keys, count)) {
         return false;
     }
-    neopixel_set_typing_key_down(false);
-    vTaskDelay(pdMS_TO_TICKS(KEY_RELEASE_GAP_MS));
+    s_nkro_key = key;
+    s_nkro_modifier = modifier;
+    s_nkro_dirty = true;
+    return true;
+}
+
+/* Send the held-key state on whichever interface is in use */
+static bool send_held(bool use_nkro)
+{
+    uint8_t keys[MAX_BATCH_KEYS];
+    uint8_t count = build_keys(NULL, 0, keys);
+
+    if (use_nkro) {
+        if (!send_nkro_with_retry(s_held_modifier, keys, count)) {
+            return false;
+        }
+        s_nkro_key = 0;
+        s_nkro_modifier = s_held_modifier;
+        s_nkro_dirty = true;
+        return true;
+    }
+    return send_report_with_retry(s_held_modifier, keys);
+}
+
+static bool key_down(uint8_t usage, bool use_nkro)
+{
+    if (usage >= MODIFIER_USAGE_MIN && usage <= MODIFIER_USAGE_MAX) {
+        s_held_modifier |= 1 << (usage - MODIFIER_USAGE_MIN);
+    } else if (usage != 0 && s_held_count < MAX_BATCH_KEYS &&
+               memchr(s_held, usage, s_held_count) == NULL) {
+        s_held[s_held_count++] = usage;
+    } else {
+        return true;    /* Already down, or no slot left: nothing changes */
+    }
+    s_held_lane = s_cur_lane;
+    return send_held(use_nkro);
+}
+
+static bool key_up(uint8_t usage, bool use_nkro)
+{
+    if (usage >= MODIFIER_USAGE_MIN && usage <= MODIFIER_USAGE_MAX) {
+        s_held_modifier &= ~(1 << (usage - MODIFIER_USAGE_MIN));
+    } else {
+        uint8_t *slot = memchr(s_held, usage, s_held_count);
+        if (slot == NULL) {
+            return true;
+        }
+        memmove(slot, slot + 1, s_held + s_held_count - slot - 1);
+        s_held_count--;
+    }
+    return send_held(use_nkro);
+}
+
+static bool release_held(bool use_nkro)
+{
+    if (s_held_count == 0 && s_held_modifier == 0) {
+        return true;
+    }
+    s_held_count = 0;
+    s_held_modifier = 0;
+    return send_held(use_nkro);
+}
+
+/* Carry out one action. Returns false if it should be retried. */
+static bool apply_batch(const key_batch_t *batch, bool use_nkro)
+{
+    switch (batch->op) {
+    case 0:
+        if (batch->count == 0) {
+            return true;
+        }
+        return use_nkro ? type_nkro(batch) : type_batch(batch);
+    case KEY_STREAM_OP_DOWN:
+        return key_down(batch->arg, use_nkro);
+    case KEY_STREAM_OP_UP:
+        return key_up(batch->arg, use_nkro);
+    case KEY_STREAM_OP_RELEASE:
+        return release_held(use_nkro);
+    default:
+        return true;
+    }
+}
+
+/* Drive the key-timed LED from reports as they reach the endpoint */
+static void on_report_sent(bool keys_down)
+{
+    neopixel_set_typing_key_down(keys_down);
+}
+
+static void log_timing_stats(void)
+{
+    usb_hid_timing_stats_t timing;
+    usb_hid_get_timing_stats(&timing);
+    if (timing.samples == 0) {
+        return;
+    }
+    ESP_LOGI(TAG, "Pacing: %lu keys, requested %lu us, jitter avg %lu us max %lu us",
+             (unsigned long)timing.samples,
+             (unsigned long)timing.last_requested_us,
+             (unsigned long)(timing.total_abs_error_us / timing.samples),
+             (unsigned long)timing.max_abs_error_us);
+}
+
+/* Feed the adaptive controller what the host did since the last keystroke:
+ * a stall or a refused send is congestion, otherwise the latency of the
+ * last report collected is one sample */
+static void sample_pacing(void)
+{
+    usb_hid_stats_t stats;
+    usb_hid_get_stats(&stats);
+
+    if (s_pacing_reset) {
+        s_pacing_reset = false;
+        pacing_init(&s_pacing, (uint32_t)s_delay_ms * 1000,
+                    MIN_DELAY_MS * 1000, MAX_DELAY_MS * 1000);
+    } else if (stats.stalls != s_seen_stalls || s_send_retries != s_seen_retries) {
+        pacing_on_congestion(&s_pacing);
+    } else if (stats.reports_acked != s_seen_acked) {
+        pacing_on_report(&s_pacing, stats.last_latency_us,
+                         (uint32_t)usb_hid_get_poll_interval_ms() * 1000);
+    }
+    s_seen_stalls = stats.stalls;
+    s_seen_retries = s_send_retries;
+    s_seen_acked = stats.reports_acked;
+}
+
+static uint32_t key_gap_us(void)
+{
+    if (s_adaptive && !s_pacing_reset) {
+        return s_pacing.gap_us;
+    }
+    return (uint32_t)s_delay_ms * 1000;
+}
+
+/* Consume a job marker: the bytes after it belong to that job, and their
+ * keystrokes are charged the job's characters per keystroke so far */
+static void enter_job(lane_t *lane, uint16_t id, uint32_t marker_len)
+{
+    uint32_t chars = 0;
+    uint32_t keys = 0;
+
+    portENTER_CRITICAL(&s_jobs_lock);
+    lane->slot = find_job_locked(id);
+    if (lane->slot >= 0) {
+        chars = s_jobs[lane->slot].queued_chars;
+        keys = s_jobs[lane->slot].queued_keys;
+    }
+    portEXIT_CRITICAL(&s_jobs_lock);
+    lane->key_cost = keys > 0 && chars > 0 ? (uint32_t)(TOKEN_UNITS * chars / keys) : TOKEN_UNITS;
+    consume(lane, marker_len, 0, 0);
+}
+
+/* Discard the bytes of a cancelled job at the head of a lane, up to the
+ * next job marker. Returns false if the lane holds nothing else yet. */
+static bool skip_job_bytes(lane_t *lane)
+{
+    uint8_t chunk[64];
+    uint32_t used = spsc_ring_used(&lane->ring);
+    uint32_t offset = 0;
+    bool marker = false;
+
+    while (offset < used && !marker) {
+        uint32_t n = spsc_ring_peek(&lane->ring, offset, chunk, sizeof(chunk));
+        uint32_t i = 0;
+        while (i < n) {
+            uint8_t op = chunk[i];
+            size_t op_len = key_stream_op_len(op);
+            if (op == KEY_STREAM_OP_JOB) {
+                marker = true;
+                break;
+            }
+            if (i + op_len > n && offset + n < used) {
+                break;  /* Opcode straddles the chunk: re-read it */
+            }
+            i += op_len;
+        }
+        offset += i;
+    }
+
+    consume(lane, offset, 0, 0);
+    return marker;
+}
+
+/* Pick the lane to type from: the interactive lane first, unless keys held
+ * by the other lane are still down and it has more to send */
+static lane_t *pick_lane(void)
+{
+    if ((s_held_count > 0 || s_held_modifier != 0) &&
+        spsc_ring_used(&s_lanes[s_held_lane].ring) > 0) {
+        return &s_lanes[s_held_lane];
+    }
+    for (int l = TYPING_LANE_COUNT - 1; l >= 0; l--) {
+        if (spsc_ring_used(&s_lanes[l].ring) > 0) {
+            return &s_lanes[l];
+        }
+    }
+    return NULL;
+}
+
+static void refill_bucket(void)
+{
+    int64_t now = esp_timer_get_time();
+    int64_t cap = (int64_t)s_rate_burst * TOKEN_UNITS;
+
+    s_bucket += (now - s_bucket_us) * s_rate_limit;
+    if (s_bucket > cap) s_bucket = cap;
+    s_bucket_us = now;
+    s_tokens = s_bucket > 0 ? (uint32_t)(s_bucket / TOKEN_UNITS) : 0;
+}
+
+/* Hold the typing task until the bucket covers 'keys' keystrokes for the
+ * batch at the head of 'lane', at the lane's cost per keystroke, then take
+ * them. Short bursts go through at full speed; a long job settles at
+ * s_rate_limit. Returns false, leaving the batch in the lane, if an abort,
+ * a cancel or interactive input arrives while waiting. */
+static bool take_tokens(const lane_t *lane, uint32_t keys)
+{
+    if (s_rate_limit == 0) {
+        return true;
+    }
+
+    int64_t need = (int64_t)keys * lane->key_cost;
+    int64_t cap = (int64_t)s_rate_burst * TOKEN_UNITS;
+    /* A batch larger than the burst waits for a full bucket and overdraws it */
+    int64_t wanted = need < cap ? need : cap;
+
+    refill_bucket();
+    uint16_t limit;
+    while (s_bucket < wanted && (limit = s_rate_limit) != 0) {
+        int64_t wait_us = (wanted - s_bucket + limit - 1) / limit;
+        TickType_t ticks = pdMS_TO_TICKS((uint32_t)((wait_us + 999) / 1000));
+        /* Woken early by new writes and by abort */
+        ulTaskNotifyTake(pdTRUE, ticks > 0 ? ticks : 1);
+        if (abort_pending() || lane_job_cancelled(lane) || pick_lane() != lane) {
+            return false;
+        }
+        refill_bucket();
+    }
+    s_bucket -= need;
+    s_tokens = s_bucket > 0 ? (uint32_t)(s_bucket / TOKEN_UNITS) : 0;
+    s_key_cost = lane->key_cost;
     return true;
 }
 
 static void typing_task(void *arg)
 {
-    char ch;
+    key_batch_t batch;
+    lane_t *lane;
 
     while (1) {
-        /* Wait for data in queue */
-        while (queue_used() == 0 || s_abort) {
+        reap_jobs();
+
+        /* Wait for data in a lane */
+        while ((lane = pick_lane()) == NULL || abort_pending()) {
             if (s_typing) {
                 s_typing = false;
                 (void)ensure_keys_released();
+                log_timing_stats();
                 neopixel_set_typing_indicator(false);
                 neopixel_set_state(s_prev_led_state);
             }
-            if (s_abort) {
-                xSemaphoreTake(s_mutex, portMAX_DELAY);
-                s_queue_head = 0;
-                s_queue_tail = 0;
-                s_queue_total = 0;
-                s_queue_typed = 0;
-                s_abort = false;
-                xSemaphoreGive(s_mutex);
+            if (abort_pending()) {
+                s_seen_epoch = atomic_load(&s_abort_epoch);
+                for (int l = 0; l < TYPING_LANE_COUNT; l++) {
+                    while (lane_job_cancelled(&s_lanes[l]) && skip_job_bytes(&s_lanes[l])) {
+                        lane_t *head = &s_lanes[l];
+                        if (!collect_batch(head, &batch, 1) || batch.op != KEY_STREAM_OP_JOB) {
+                            break;
+                        }
+                        enter_job(head, batch.job, batch.consumed);
+                    }
+                    s_lanes[l].modifier = 0;
+                }
+                s_gap_us = 0;
+                /* Dropped reports may include the NKRO key-up */
+                usb_hid_flush();
+                s_nkro_dirty = true;
                 (void)ensure_keys_released();
+                reap_jobs();
             }
             ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(50));
+            reap_jobs();
+            refill_bucket();
         }
 
         /* Start typing */
         if (!s_typing) {
             s_typing = true;
+            usb_hid_reset_timing_stats();
             s_prev_led_state = neopixel_get_state();
             neopixel_set_typing_key_down(false);
             neopixel_set_typing_indicator(true);
         }
 
-        if (queue_pop(&ch)) {
-            while (!s_abort && !type_char(ch)) {
-                vTaskDelay(pdMS_TO_TICKS(KEY_RETRY_DELAY_MS));
+        /* Bitmap reports carry no key order, so NKRO types one key per report */
+        bool use_nkro = s_hid_mode == TYPING_HID_NKRO && usb_hid_nkro_active();
+        s_cur_lane = (uint8_t)(lane - s_lanes);
+
+        if (lane_job_cancelled(lane)) {
+            skip_job_bytes(lane);
+            if (s_held_lane == s_cur_lane) {
+                (void)release_held(use_nkro);
+            }
+            continue;
+        }
+
+        uint8_t max_keys = use_nkro ? 1 : s_batch_keys;
+        if (max_keys > MAX_BATCH_KEYS - s_held_count) {
+            max_keys = MAX_BATCH_KEYS - s_held_count;
+        }
+        if (!collect_batch(lane, &batch, max_keys > 0 ? max_keys : 1)) {
+            continue;
+        }
+
+        if (batch.op == KEY_STREAM_OP_JOB) {
+            enter_job(lane, batch.job, batch.consumed);
+            continue;
+        }
+
+        if (batch.op == KEY_STREAM_OP_DELAY) {
+            s_gap_us += (uint32_t)batch.delay_ms * 1000;
+        } else {
+            uint32_t typed = batch.op == 0 ? batch.count
+                           : batch.op == KEY_STREAM_OP_DOWN ? 1 : 0;
+            if (typed > 0 && !take_tokens(lane, typed)) {
+                continue;
+            }
+            usb_hid_delay_next_us(s_gap_us);
+            while (!abort_pending() && !apply_batch(&batch, use_nkro)) {
+                vTaskDelay(KEY_RETRY_TICKS);
             }
-            if (s_abort) {
+            if (abort_pending()) {
                 continue;
             }
+        }
 
-            s_queue_typed++;
+        uint32_t keystrokes = batch.op == 0 ? batch.count + batch.skipped
+                            : batch.op == KEY_STREAM_OP_DOWN ? 1 : 0;
+        lane->modifier = batch.modifier;
+        consume(lane, batch.consumed, keystrokes,
+                batch.op == KEY_STREAM_OP_DELAY ? batch.delay_ms : 0);
 
-            if (s_progress_cb) {
-                s_progress_cb(s_queue_typed, s_queue_total);
-            }
+        if (keystrokes > 0) {
+            report_progress(lane->slot);
+        }
 
-            vTaskDelay(pdMS_TO_TICKS(s_delay_ms));
+        /* The inter-key delay is enforced by the report FIFO against an
+         * esp_timer deadline, so it lines up with the host's polling instead
+         * of adding a tick-rounded sleep on top of it */
+        if (keystrokes > 0) {
+            if (s_adaptive) {
+                sample_pacing();
+            }
+            s_gap_us = key_gap_us();
+        } else if (batch.op != KEY_STREAM_OP_DELAY) {
+            s_gap_us = 0;
         }
     }
 }
@@ -152,59 +828,271 @@ esp_err_t typing_engine_init(void)
 {
     s_mutex = xSemaphoreCreateMutex();
     if (s_mutex == NULL) return ESP_ERR_NO_MEM;
+    s_layout = KEYMAP_LAYOUTS[0];
 
-    s_queue_head = 0;
-    s_queue_tail = 0;
-    s_queue_total = 0;
-    s_queue_typed = 0;
-    s_abort = false;
+    spsc_ring_init(&s_lanes[TYPING_LANE_BULK].ring, s_bulk_buf, sizeof(s_bulk_buf));
+    spsc_ring_init(&s_lanes[TYPING_LANE_INTERACTIVE].ring,
+                   s_interactive_buf, sizeof(s_interactive_buf));
+    for (int l = 0; l < TYPING_LANE_COUNT; l++) {
+        s_lanes[l].slot = -1;
+        s_lanes[l].key_cost = TOKEN_UNITS;
+    }
+    atomic_init(&s_abort_epoch, 0);
+    s_seen_epoch = 0;
     s_typing = false;
+    s_bucket = (int64_t)s_rate_burst * TOKEN_UNITS;
+    s_bucket_us = esp_timer_get_time();
+    s_tokens = s_rate_burst;
 
+    usb_hid_set_tx_callback(on_report_sent);
     xTaskCreate(typing_task, "typing", 4096, NULL, 4, &s_task_handle);
     ESP_LOGI(TAG, "Typing engine initialized (delay=%dms)", s_delay_ms);
     return ESP_OK;
 }
 
-esp_err_t typing_engine_enqueue(const char *text, size_t len)
+static void notify_task(void)
 {
-    if (len == 0) return ESP_OK;
+    if (s_task_handle != NULL) {
+        xTaskNotifyGive(s_task_handle);
+    }
+}
 
-    xSemaphoreTake(s_mutex, portMAX_DELAY);
+uint16_t typing_engine_job_open(typing_lane_t lane)
+{
+    uint16_t id = TYPING_JOB_NONE;
+
+    if (lane >= TYPING_LANE_COUNT) {
+        lane = TYPING_LANE_BULK;
+    }
+    portENTER_CRITICAL(&s_jobs_lock);
+    int slot = open_job_locked(lane, false);
+    if (slot >= 0) {
+        id = s_jobs[slot].id;
+    }
+    portEXIT_CRITICAL(&s_jobs_lock);
 
-    uint32_t free_space = TYPING_QUEUE_MAX_SIZE - queue_used() - 1;
-    if (len > free_space) {
-        xSemaphoreGive(s_mutex);
-        ESP_LOGW(TAG, "Queue full: need %u, have %lu", (unsigned)len, (unsigned long)free_space);
-        return ESP_ERR_NO_MEM;
+    if (id == TYPING_JOB_NONE) {
+        ESP_LOGW(TAG, "Job table full");
     }
+    return id;
+}
+
+void typing_engine_job_close(uint16_t job)
+{
+    portENTER_CRITICAL(&s_jobs_lock);
+    int slot = find_job_locked(job);
+    if (slot >= 0 && s_jobs[slot].state == JOB_OPEN) {
+        s_jobs[slot].state = JOB_CLOSED;
+    }
+    portEXIT_CRITICAL(&s_jobs_lock);
+    notify_task();
+}
+
+/* The job's bytes stay in its lane until the typing task reaches them and
+ * discards them; a batch already handed to USB still completes */
+esp_err_t typing_engine_job_cancel(uint16_t job)
+{
+    portENTER_CRITICAL(&s_jobs_lock);
+    int slot = job == TYPING_JOB_NONE ? -1 : find_job_locked(job);
+    if (slot >= 0) {
+        s_jobs[slot].state = JOB_CANCELLED;
+        if (s_auto_slot == slot) {
+            s_auto_slot = -1;
+        }
+    }
+    portEXIT_CRITICAL(&s_jobs_lock);
+
+    if (slot < 0) return ESP_ERR_NOT_FOUND;
+    ESP_LOGI(TAG, "Job %u cancelled", job);
+    notify_task();
+    return ESP_OK;
+}
+
+esp_err_t typing_engine_job_progress(uint16_t job, typing_progress_t *progress)
+{
+    portENTER_CRITICAL(&s_jobs_lock);
+    int slot = job == TYPING_JOB_NONE ? -1 : find_job_locked(job);
+    if (slot >= 0) {
+        fill_progress(&s_jobs[slot], progress);
+    }
+    portEXIT_CRITICAL(&s_jobs_lock);
+    return slot >= 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
 
-    /* Reset progress counters for new batch */
-    if (queue_used() == 0) {
-        s_queue_total = len;
-        s_queue_typed = 0;
+/* Text is translated into HID actions here, outside the typing loop, so
+ * the queue holds exactly what will be sent and its keystroke count is
+ * known before typing starts. Producers hold s_mutex from begin until
+ * commit (or a failed reserve). */
+void typing_engine_enqueue_begin(typing_write_t *w, uint16_t job)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    memset(w, 0, sizeof(*w));
+    key_stream_encoder_reset(&w->measure_enc, s_layout, s_unicode);
+    key_stream_encoder_reset(&w->enc, s_layout, s_unicode);
+    w->staged = JOB_MARKER_LEN;
+
+    portENTER_CRITICAL(&s_jobs_lock);
+    if (job == TYPING_JOB_NONE) {
+        if (s_auto_slot < 0) {
+            s_auto_slot = open_job_locked(TYPING_LANE_BULK, true);
+        }
+        w->slot = s_auto_slot;
+        w->err = w->slot < 0 ? ESP_ERR_NO_MEM : ESP_OK;
     } else {
-        s_queue_total += len;
+        w->slot = find_job_locked(job);
+        w->err = w->slot < 0 ? ESP_ERR_NOT_FOUND
+               : s_jobs[w->slot].state == JOB_CANCELLED ? ESP_ERR_INVALID_STATE
+               : ESP_OK;
+    }
+    if (w->err == ESP_OK) {
+        /* Keeps the slot from being reaped before commit */
+        s_jobs[w->slot].writing = true;
+        w->measure_enc.escape = s_jobs[w->slot].escape;
+        w->enc.escape = s_jobs[w->slot].escape;
+        w->measure_enc.utf8 = s_jobs[w->slot].utf8;
+        w->enc.utf8 = s_jobs[w->slot].utf8;
     }
+    portEXIT_CRITICAL(&s_jobs_lock);
+}
+
+void typing_engine_enqueue_measure(typing_write_t *w, const char *text, size_t len)
+{
+    key_stream_size_t part;
+    key_stream_encode_text(&w->measure_enc, text, len, NULL, &part);
+    w->size.bytes += part.bytes;
+    w->size.keystrokes += part.keystrokes;
+    w->size.chars += part.chars;
+    w->size.delay_ms += part.delay_ms;
+    w->chars += len;
+}
+
+esp_err_t typing_engine_enqueue_reserve(typing_write_t *w)
+{
+    esp_err_t err = w->err;
+    uint32_t free_space = 0;
 
-    for (size_t i = 0; i < len; i++) {
-        s_queue[s_queue_tail] = text[i];
-        s_queue_tail = (s_queue_tail + 1) % TYPING_QUEUE_MAX_SIZE;
+    if (err == ESP_OK) {
+        free_space = spsc_ring_free(&s_lanes[s_jobs[w->slot].lane].ring);
+        if (w->size.bytes + JOB_MARKER_LEN > free_space) {
+            err = ESP_ERR_NO_MEM;
+        }
     }
+    if (err == ESP_OK) return ESP_OK;
 
+    if (w->slot >= 0) {
+        portENTER_CRITICAL(&s_jobs_lock);
+        s_jobs[w->slot].writing = false;
+        portEXIT_CRITICAL(&s_jobs_lock);
+    }
     xSemaphoreGive(s_mutex);
-    ESP_LOGI(TAG, "Enqueued %u chars (total in queue: %lu)", (unsigned)len, (unsigned long)queue_used());
-    if (s_task_handle != NULL) {
-        xTaskNotifyGive(s_task_handle);
+    if (err == ESP_ERR_NO_MEM && w->slot < 0) {
+        ESP_LOGW(TAG, "Job table full");
+    } else if (err == ESP_ERR_NO_MEM) {
+        ESP_LOGW(TAG, "Queue full: need %u, have %lu",
+                 (unsigned)w->size.bytes + JOB_MARKER_LEN, (unsigned long)free_space);
+    }
+    notify_task();
+    return err;
+}
+
+/* Encode a segment in chunks and stage each with a two-span copy into the
+ * ring's free space; nothing is visible to the typing task until commit */
+void typing_engine_enqueue_segment(typing_write_t *w, const char *text, size_t len)
+{
+    /* A command or character begun in an earlier chunk is encoded where it
+     * ends: up to three carried UTF-8 bytes are charged to this chunk */
+    uint8_t scratch[KEY_STREAM_MAX_CHAR_BYTES * (SEGMENT_CHUNK + 3) + KEY_STREAM_MAX_ESC_BYTES];
+    spsc_ring_t *ring = &s_lanes[s_jobs[w->slot].lane].ring;
+    size_t done = 0;
+
+    while (done < len) {
+        size_t chunk = len - done;
+        if (chunk > SEGMENT_CHUNK) {
+            chunk = SEGMENT_CHUNK;
+        }
+        key_stream_size_t part;
+        key_stream_encode_text(&w->enc, text + done, chunk, scratch, &part);
+        spsc_ring_stage(ring, w->staged, scratch, part.bytes);
+        w->staged += part.bytes;
+        done += chunk;
     }
+}
+
+uint16_t typing_engine_enqueue_commit(typing_write_t *w)
+{
+    job_t *job = &s_jobs[w->slot];
+    spsc_ring_t *ring = &s_lanes[job->lane].ring;
+    uint8_t marker[JOB_MARKER_LEN] = {
+        KEY_STREAM_OP_JOB, (uint8_t)job->id, (uint8_t)(job->id >> 8),
+    };
+
+    spsc_ring_stage(ring, 0, marker, sizeof(marker));
+
+    /* Counted before the bytes are published, so the typing task never
+     * consumes more than a job has queued */
+    portENTER_CRITICAL(&s_jobs_lock);
+    uint16_t id = job->id;
+    job->queued_bytes += w->staged;
+    job->queued_keys += w->size.keystrokes;
+    job->queued_chars += w->size.chars;
+    job->queued_delay_ms += w->size.delay_ms;
+    job->escape = w->enc.escape;
+    job->utf8 = w->enc.utf8;
+    job->writing = false;
+    portEXIT_CRITICAL(&s_jobs_lock);
+    spsc_ring_commit(ring, w->staged);
+
+    xSemaphoreGive(s_mutex);
+    ESP_LOGI(TAG, "Enqueued %u chars as %lu keystrokes to job %u (%lu bytes, %lu in lane)",
+             (unsigned)w->chars, (unsigned long)w->size.keystrokes, id,
+             (unsigned long)w->staged, (unsigned long)spsc_ring_used(ring));
+    notify_task();
+    return id;
+}
+
+esp_err_t typing_engine_enqueue(uint16_t job, const char *text, size_t len)
+{
+    typing_write_t w;
+
+    if (len == 0) return ESP_OK;
+
+    typing_engine_enqueue_begin(&w, job);
+    typing_engine_enqueue_measure(&w, text, len);
+    esp_err_t err = typing_engine_enqueue_reserve(&w);
+    if (err != ESP_OK) {
+        return err;
+    }
+    typing_engine_enqueue_segment(&w, text, len);
+    typing_engine_enqueue_commit(&w);
     return ESP_OK;
 }
 
+void typing_engine_reset_input(void)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    portENTER_CRITICAL(&s_jobs_lock);
+    if (s_auto_slot >= 0) {
+        if (s_jobs[s_auto_slot].state == JOB_OPEN) {
+            s_jobs[s_auto_slot].state = JOB_CLOSED;
+        }
+        s_auto_slot = -1;
+    }
+    portEXIT_CRITICAL(&s_jobs_lock);
+    xSemaphoreGive(s_mutex);
+}
+
 void typing_engine_abort(void)
 {
-    s_abort = true;
-    if (s_task_handle != NULL) {
-        xTaskNotifyGive(s_task_handle);
+    portENTER_CRITICAL(&s_jobs_lock);
+    for (int i = 0; i < TYPING_MAX_JOBS; i++) {
+        if (s_jobs[i].state != JOB_FREE) {
+            s_jobs[i].state = JOB_CANCELLED;
+        }
     }
+    s_auto_slot = -1;
+    portEXIT_CRITICAL(&s_jobs_lock);
+    atomic_fetch_add(&s_abort_epoch, 1);
+    notify_task();
     ESP_LOGI(TAG, "Abort requested");
 }
 
@@ -213,6 +1101,7 @@ void typing_engine_set_delay_ms(uint16_t delay_ms)
     if (delay_ms < MIN_DELAY_MS) delay_ms = MIN_DELAY_MS;
     if (delay_ms > MAX_DELAY_MS) delay_ms = MAX_DELAY_MS;
     s_delay_ms = delay_ms;
+    s_pacing_reset = true;
     ESP_LOGI(TAG, "Typing delay set to %d ms", s_delay_ms);
 }
 
@@ -221,6 +1110,120 @@ uint16_t typing_engine_get_delay_ms(void)
     return s_delay_ms;
 }
 
+void typing_engine_set_adaptive(bool adaptive)
+{
+    s_adaptive = adaptive;
+    s_pacing_reset = true;
+    ESP_LOGI(TAG, "Pacing set to %s", adaptive ? "adaptive" : "fixed");
+}
+
+bool typing_engine_get_adaptive(void)
+{
+    return s_adaptive;
+}
+
+uint32_t typing_engine_get_gap_us(void)
+{
+    return key_gap_us();
+}
+
+void typing_engine_set_rate_limit(uint16_t chars_per_min, uint16_t burst)
+{
+    if (burst < 1) burst = 1;
+    if (burst > MAX_RATE_BURST) burst = MAX_RATE_BURST;
+    s_rate_limit = chars_per_min;
+    s_rate_burst = burst;
+    if (chars_per_min == 0) {
+        ESP_LOGI(TAG, "Rate limit off");
+    } else {
+        ESP_LOGI(TAG, "Rate limit set to %u chars/min, burst %u", chars_per_min, burst);
+    }
+}
+
+uint16_t typing_engine_get_rate_limit(void)
+{
+    return s_rate_limit;
+}
+
+uint16_t typing_engine_get_rate_burst(void)
+{
+    return s_rate_burst;
+}
+
+uint32_t typing_engine_get_rate_tokens(void)
+{
+    return s_rate_limit != 0 ? s_tokens : 0;
+}
+
+void typing_engine_set_hold_ms(uint8_t hold_ms)
+{
+    if (hold_ms > MAX_HOLD_MS) hold_ms = MAX_HOLD_MS;
+    s_hold_ms = hold_ms;
+    ESP_LOGI(TAG, "Key hold set to %d ms", s_hold_ms);
+}
+
+uint8_t typing_engine_get_hold_ms(void)
+{
+    return s_hold_ms;
+}
+
+void typing_engine_set_batch_keys(uint8_t keys)
+{
+    if (keys < 1) keys = 1;
+    if (keys > MAX_BATCH_KEYS) keys = MAX_BATCH_KEYS;
+    s_batch_keys = keys;
+    ESP_LOGI(TAG, "Keys per report set to %d", s_batch_keys);
+}
+
+uint8_t typing_engine_get_batch_keys(void)
+{
+    return s_batch_keys;
+}
+
+void typing_engine_set_hid_mode(typing_hid_mode_t mode)
+{
+    s_hid_mode = (mode == TYPING_HID_NKRO) ? TYPING_HID_NKRO : TYPING_HID_BOOT;
+    ESP_LOGI(TAG, "HID mode set to %s", s_hid_mode == TYPING_HID_NKRO ? "nkro" : "boot");
+}
+
+typing_hid_mode_t typing_engine_get_hid_mode(void)
+{
+    return s_hid_mode;
+}
+
+esp_err_t typing_engine_set_layout(const char *name)
+{
+    const keymap_layout_t *layout = keymap_find(name);
+    if (layout == NULL) {
+        ESP_LOGW(TAG, "Layout %s not built in", name);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    s_layout = layout;
+    xSemaphoreGive(s_mutex);
+    ESP_LOGI(TAG, "Layout set to %s (%s)", layout->name, layout->description);
+    return ESP_OK;
+}
+
+const char *typing_engine_get_layout(void)
+{
+    return s_layout->name;
+}
+
+void typing_engine_set_unicode_method(key_stream_unicode_t unicode)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    s_unicode = unicode;
+    xSemaphoreGive(s_mutex);
+    ESP_LOGI(TAG, "Unicode input method set to %s", key_stream_unicode_name(unicode));
+}
+
+key_stream_unicode_t typing_engine_get_unicode_method(void)
+{
+    return s_unicode;
+}
+
 void typing_engine_set_progress_callback(typing_progress_cb_t cb)
 {
     s_progress_cb = cb;
@@ -233,5 +1236,68 @@ bool typing_engine_is_typing(void)
 
 uint32_t typing_engine_queue_length(void)
 {
-    return queue_used();
+    return pending_keys();
+}
+
+uint32_t typing_engine_lane_free_chars(typing_lane_t lane)
+{
+    uint32_t free_space = spsc_ring_free(&s_lanes[lane].ring);
+    if (free_space <= JOB_MARKER_LEN) return 0;
+    /* A layout or method switch can raise the bound under text already
+     * credited; such a write is refused with ESP_ERR_NO_MEM and retried */
+    return (free_space - JOB_MARKER_LEN) / key_stream_bytes_per_input(s_layout, s_unicode);
+}
+
+uint32_t typing_engine_free_chars(void)
+{
+    return typing_engine_lane_free_chars(TYPING_LANE_BULK);
+}
+
+/* Time per keystroke at the current pacing */
+static uint32_t per_key_us(void)
+{
+    uint32_t poll_us = (uint32_t)usb_hid_get_poll_interval_ms() * 1000;
+    uint32_t gap_us = key_gap_us();
+    uint32_t hold_us = (uint32_t)s_hold_ms * 1000;
+    if (gap_us < poll_us) gap_us = poll_us;
+    if (hold_us < poll_us) hold_us = poll_us;
+
+    /* NKRO: one report per key. Boot: a press and a release per report,
+     * carrying up to s_batch_keys keys. */
+    return (s_hid_mode == TYPING_HID_NKRO && usb_hid_nkro_active())
+           ? gap_us : (hold_us + gap_us) / s_batch_keys;
+}
+
+uint32_t typing_engine_eta_ms(void)
+{
+    uint32_t remaining;
+    uint32_t delay_ms;
+    pending_work(&remaining, &delay_ms);
+    uint64_t key_us = per_key_us();
+    uint64_t total_us = (uint64_t)remaining * key_us;
+
+    /* Past what the bucket holds, keys go no faster than the rate limit */
+    uint32_t cost = s_key_cost;
+    uint32_t tokens = (uint32_t)(s_tokens * TOKEN_UNITS / cost);
+    uint16_t limit = s_rate_limit;
+    if (limit != 0 && remaining > tokens) {
+        uint64_t limit_us = cost / limit;
+        if (limit_us > key_us) {
+            total_us = (uint64_t)tokens * key_us + (uint64_t)(remaining - tokens) * limit_us;
+        }
+    }
+    return (uint32_t)(total_us / 1000) + delay_ms;
+}
+
+uint32_t typing_engine_rate_cpm(void)
+{
+    uint32_t rate = 60u * 1000000u / per_key_us();
+    uint16_t limit = s_rate_limit;
+
+    /* An empty bucket holds typing to the limit, in keystrokes */
+    if (limit != 0 && s_tokens == 0) {
+        uint32_t limit_keys = (uint32_t)(limit * TOKEN_UNITS / s_key_cost);
+        if (rate > limit_keys) rate = limit_keys;
+    }
+    return rate;
 }
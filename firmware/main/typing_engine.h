@@ -1,19 +1,123 @@
 #pragma once
 
 #include "esp_err.h"
+#include "key_stream.h"
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
 
 #define TYPING_QUEUE_MAX_SIZE 8192
+#define TYPING_INTERACTIVE_QUEUE_SIZE 1024
+#define TYPING_MAX_JOBS 8
 
-typedef void (*typing_progress_cb_t)(uint32_t current, uint32_t total);
+typedef enum {
+    TYPING_HID_BOOT = 0,    /* 6-key boot keyboard reports */
+    TYPING_HID_NKRO,        /* Usage bitmap reports on the NKRO interface */
+} typing_hid_mode_t;
+
+/* Jobs: every write belongs to a job, and each job is typed in write order
+ * within its lane. The interactive lane is typed ahead of the bulk lane
+ * (switching between reports, never while keys it holds are down), so a
+ * short command does not wait behind a long paste. A job is cancelled on
+ * its own; abort cancels them all.
+ *
+ * TYPING_JOB_NONE as a write's job selects the automatic bulk job for
+ * plain text, which is started on demand and finishes whenever it drains. */
+#define TYPING_JOB_NONE 0
+
+typedef enum {
+    TYPING_LANE_BULK = 0,
+    TYPING_LANE_INTERACTIVE,
+    TYPING_LANE_COUNT,
+} typing_lane_t;
+
+typedef struct {
+    uint16_t job;
+    typing_lane_t lane;
+    uint32_t typed;         /* Keystrokes typed */
+    uint32_t total;         /* Keystrokes queued so far */
+    bool done;              /* Last report for this job */
+    bool cancelled;
+} typing_progress_t;
+
+/* One enqueued write assembled from several segments (e.g. an mbuf chain).
+ * Usage: begin, measure every segment, reserve, add every segment in the
+ * same order, commit. The write is published atomically on commit. */
+typedef struct {
+    key_stream_encoder_t measure_enc;
+    key_stream_encoder_t enc;
+    key_stream_size_t size;     /* Totals from the measure pass */
+    uint32_t staged;            /* Bytes written so far */
+    size_t chars;
+    int slot;                   /* Job table slot, -1 if none */
+    esp_err_t err;              /* Why the job cannot take the write */
+} typing_write_t;
+
+/* Called from the typing task after each typed batch and once when a job
+ * finishes or its cancellation has been carried out */
+typedef void (*typing_progress_cb_t)(const typing_progress_t *progress);
 
 esp_err_t typing_engine_init(void);
-esp_err_t typing_engine_enqueue(const char *text, size_t len);
+/* Open a job; returns TYPING_JOB_NONE if the job table is full */
+uint16_t typing_engine_job_open(typing_lane_t lane);
+/* No more writes: the job finishes once it has been typed */
+void typing_engine_job_close(uint16_t job);
+esp_err_t typing_engine_job_cancel(uint16_t job);
+/* Snapshot of a live job; ESP_ERR_NOT_FOUND once it has finished */
+esp_err_t typing_engine_job_progress(uint16_t job, typing_progress_t *progress);
+esp_err_t typing_engine_enqueue(uint16_t job, const char *text, size_t len);
+void typing_engine_enqueue_begin(typing_write_t *w, uint16_t job);
+void typing_engine_enqueue_measure(typing_write_t *w, const char *text, size_t len);
+/* ESP_ERR_NO_MEM: no room (retry later); ESP_ERR_NOT_FOUND: unknown job;
+ * ESP_ERR_INVALID_STATE: the job was cancelled */
+esp_err_t typing_engine_enqueue_reserve(typing_write_t *w);
+void typing_engine_enqueue_segment(typing_write_t *w, const char *text, size_t len);
+/* Returns the job the write went to */
+uint16_t typing_engine_enqueue_commit(typing_write_t *w);
+/* End the automatic job: the next plain write starts a new one, without a
+ * partial in-band command left by an interrupted upload */
+void typing_engine_reset_input(void);
 void typing_engine_abort(void);
 void typing_engine_set_delay_ms(uint16_t delay_ms);
 uint16_t typing_engine_get_delay_ms(void);
+/* Adaptive pacing: the inter-key gap starts at the typing delay and
+ * follows the host (see pacing.h), between 5 and 100 ms. Fixed pacing
+ * uses the typing delay as is. */
+void typing_engine_set_adaptive(bool adaptive);
+bool typing_engine_get_adaptive(void);
+/* Inter-key gap in effect */
+uint32_t typing_engine_get_gap_us(void);
+/* Token bucket on typed characters: up to 'burst' go out at full pacing,
+ * after which typing is held to chars_per_min; 0 (the default) turns the
+ * limit off. A character costs one token however many keystrokes it takes;
+ * in-band commands count as one. */
+void typing_engine_set_rate_limit(uint16_t chars_per_min, uint16_t burst);
+uint16_t typing_engine_get_rate_limit(void);
+uint16_t typing_engine_get_rate_burst(void);
+/* Characters the bucket holds, as of the last keystroke typed */
+uint32_t typing_engine_get_rate_tokens(void);
+/* Extra time a boot-report key is held down before its release; 0 releases
+ * on the next poll */
+void typing_engine_set_hold_ms(uint8_t hold_ms);
+uint8_t typing_engine_get_hold_ms(void);
+void typing_engine_set_batch_keys(uint8_t keys);
+uint8_t typing_engine_get_batch_keys(void);
+void typing_engine_set_hid_mode(typing_hid_mode_t mode);
+typing_hid_mode_t typing_engine_get_hid_mode(void);
+/* Keyboard layout the host uses, by keymap name; ESP_ERR_NOT_FOUND if it
+ * was not built in. Applies to writes begun afterwards. */
+esp_err_t typing_engine_set_layout(const char *name);
+const char *typing_engine_get_layout(void);
+/* Entry method for characters the layout cannot type */
+void typing_engine_set_unicode_method(key_stream_unicode_t unicode);
+key_stream_unicode_t typing_engine_get_unicode_method(void);
 void typing_engine_set_progress_callback(typing_progress_cb_t cb);
 bool typing_engine_is_typing(void);
+/* Keystrokes still to be typed, all jobs */
 uint32_t typing_engine_queue_length(void);
+uint32_t typing_engine_eta_ms(void);
+/* Keystrokes per minute at the current pacing */
+uint32_t typing_engine_rate_cpm(void);
+/* Input bytes guaranteed to fit in the lane whatever they translate to */
+uint32_t typing_engine_free_chars(void);
+uint32_t typing_engine_lane_free_chars(typing_lane_t lane);
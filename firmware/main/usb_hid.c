@@ -4,14 +4,101 @@
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "nvs_storage.h"
+#include "sdkconfig.h"
+#include <stdatomic.h>
+#include <string.h>
 
 static const char *TAG = "usb_hid";
 
-/* HID Report Descriptor for a standard keyboard */
+#define HID_INSTANCE_BOOT   0
+#define HID_INSTANCE_NKRO   1
+
+#define REPORT_FIFO_DEPTH   16
+#define LIVE_FIFO_DEPTH     16
+#define BOOT_REPORT_LEN     8
+#define NKRO_REPORT_LEN     (1 + USB_HID_NKRO_KEYS / 8)
+#define TX_STALL_US         100000  /* In-flight report considered lost after this */
+#define MIN_POLL_INTERVAL_MS    1       /* Full-speed interrupt endpoint limits */
+#define MAX_POLL_INTERVAL_MS    255
+#define LIVE_MODIFIER_USAGE_MIN 0xE0    /* Left Control; 0xE0..0xE7 map to modifier bits */
+#define LIVE_MODIFIER_USAGE_MAX 0xE7
+
+/* Queued input report, transmitted in FIFO order across both interfaces */
+typedef struct {
+    uint8_t instance;
+    uint8_t len;
+    bool keys_down;
+    uint32_t gap_us;        /* Minimum time after the previous submission */
+    uint8_t data[NKRO_REPORT_LEN];
+} hid_report_t;
+
+/* Live key state: keys pressed directly by a remote client rather than
+ * typed from the queue. Reported on the boot interface on top of whatever
+ * the queued reports hold. */
+typedef struct {
+    uint8_t modifier;
+    uint8_t keys[6];
+} live_state_t;
+
+static QueueHandle_t s_fifo;
+static QueueHandle_t s_live_fifo;       /* Live states, sent ahead of s_fifo */
+static live_state_t s_live_next;        /* Producer: state after the last queued event */
+static live_state_t s_live_sent;        /* Live part of the reports on the wire */
+static uint8_t s_boot_bulk[BOOT_REPORT_LEN];    /* Last queued boot report sent */
+static SemaphoreHandle_t s_idle_sem;
+static atomic_bool s_tx_busy;
+static volatile uint8_t s_tx_instance;
+static volatile int64_t s_tx_submit_us;
+static volatile int64_t s_last_ack_us;
+static volatile uint32_t s_last_latency_us;
+static volatile uint32_t s_reports_acked;
+static volatile uint32_t s_stalls;
+static uint32_t s_pending_gap_us;
+static esp_timer_handle_t s_pace_timer;
+static portMUX_TYPE s_timing_lock = portMUX_INITIALIZER_UNLOCKED;
+static usb_hid_timing_stats_t s_timing;
+static uint8_t s_poll_interval_ms = CONFIG_HID_TYPER_POLL_INTERVAL_MS;
+static usb_hid_tx_cb_t s_tx_cb;
+
+/* HID Report Descriptor for a boot-compatible keyboard (no report ID, so
+ * BIOS/UEFI hosts using the boot protocol parse it as-is) */
 static const uint8_t s_hid_report_descriptor[] = {
-    TUD_HID_REPORT_DESC_KEYBOARD(HID_REPORT_ID(1)),
+    TUD_HID_REPORT_DESC_KEYBOARD(),
 };
 
+#if CONFIG_HID_TYPER_NKRO
+/* N-key-rollover keyboard: modifier byte followed by one bit per usage in
+ * 0x00..USB_HID_NKRO_KEYS-1 */
+static const uint8_t s_nkro_report_descriptor[] = {
+    HID_USAGE_PAGE(HID_USAGE_PAGE_DESKTOP),
+    HID_USAGE(HID_USAGE_DESKTOP_KEYBOARD),
+    HID_COLLECTION(HID_COLLECTION_APPLICATION),
+        /* 8 bits modifier (left/right ctrl, shift, alt, gui) */
+        HID_USAGE_PAGE(HID_USAGE_PAGE_KEYBOARD),
+        HID_USAGE_MIN(224),
+        HID_USAGE_MAX(231),
+        HID_LOGICAL_MIN(0),
+        HID_LOGICAL_MAX(1),
+        HID_REPORT_COUNT(8),
+        HID_REPORT_SIZE(1),
+        HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+        /* Key bitmap */
+        HID_USAGE_PAGE(HID_USAGE_PAGE_KEYBOARD),
+        HID_USAGE_MIN(0),
+        HID_USAGE_MAX(USB_HID_NKRO_KEYS - 1),
+        HID_LOGICAL_MIN(0),
+        HID_LOGICAL_MAX(1),
+        HID_REPORT_COUNT(USB_HID_NKRO_KEYS),
+        HID_REPORT_SIZE(1),
+        HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+    HID_COLLECTION_END,
+};
+#endif
+
 /* Device descriptor */
 static const tusb_desc_device_t s_device_descriptor = {
     .bLength            = sizeof(tusb_desc_device_t),
@@ -31,13 +118,23 @@ static const tusb_desc_device_t s_device_descriptor = {
 };
 
 /* Configuration descriptor */
-#define TUSB_DESC_TOTAL_LEN (TUD_CONFIG_DESC_LEN + TUD_HID_DESC_LEN)
+#if CONFIG_HID_TYPER_NKRO
+#define HID_ITF_COUNT       2
+#else
+#define HID_ITF_COUNT       1
+#endif
+#define TUSB_DESC_TOTAL_LEN (TUD_CONFIG_DESC_LEN + HID_ITF_COUNT * TUD_HID_DESC_LEN)
 
-static const uint8_t s_config_descriptor[] = {
-    TUD_CONFIG_DESCRIPTOR(1, 1, 0, TUSB_DESC_TOTAL_LEN,
+/* Not const: bInterval of each HID endpoint is patched at runtime */
+static uint8_t s_config_descriptor[] = {
+    TUD_CONFIG_DESCRIPTOR(1, HID_ITF_COUNT, 0, TUSB_DESC_TOTAL_LEN,
                           TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP, 100),
-    TUD_HID_DESCRIPTOR(0, 4, false, sizeof(s_hid_report_descriptor),
-                       0x81, 16, 10),
+    TUD_HID_DESCRIPTOR(0, 4, HID_ITF_PROTOCOL_KEYBOARD, sizeof(s_hid_report_descriptor),
+                       0x81, 16, CONFIG_HID_TYPER_POLL_INTERVAL_MS),
+#if CONFIG_HID_TYPER_NKRO
+    TUD_HID_DESCRIPTOR(1, 5, HID_ITF_PROTOCOL_NONE, sizeof(s_nkro_report_descriptor),
+                       0x82, 32, CONFIG_HID_TYPER_POLL_INTERVAL_MS),
+#endif
 };
 
 /* String descriptors */
@@ -47,12 +144,18 @@ static const char *s_string_descriptor[] = {
     "ESP32-S3 HID Keyboard",   /* 2: Product */
     "",                         /* 3: Serial (use chip ID) */
     "HID Interface",            /* 4: HID Interface */
+    "NKRO Interface",           /* 5: NKRO HID Interface */
 };
 
 /* Required TinyUSB callbacks */
 
 uint8_t const *tud_hid_descriptor_report_cb(uint8_t instance)
 {
+#if CONFIG_HID_TYPER_NKRO
+    if (instance == HID_INSTANCE_NKRO) {
+        return s_nkro_report_descriptor;
+    }
+#endif
     (void)instance;
     return s_hid_report_descriptor;
 }
@@ -74,8 +177,233 @@ void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id,
     (void)buffer; (void)bufsize;
 }
 
+static void apply_poll_interval(void)
+{
+    /* bInterval is the last byte of each HID interface block */
+    for (int i = 0; i < HID_ITF_COUNT; i++) {
+        s_config_descriptor[TUD_CONFIG_DESC_LEN + (i + 1) * TUD_HID_DESC_LEN - 1] =
+            s_poll_interval_ms;
+    }
+}
+
+/* Compare when a paced report actually went out with when it was asked
+ * to. Late submissions come from the previous report still being in
+ * flight or from the pace timer firing late. */
+static void record_timing(uint32_t requested_us, int64_t measured_us)
+{
+    int32_t error_us = (int32_t)(measured_us - requested_us);
+    uint32_t abs_error_us = error_us < 0 ? (uint32_t)-error_us : (uint32_t)error_us;
+
+    portENTER_CRITICAL(&s_timing_lock);
+    s_timing.samples++;
+    s_timing.last_requested_us = requested_us;
+    s_timing.last_measured_us = (uint32_t)measured_us;
+    s_timing.total_abs_error_us += abs_error_us;
+    if (abs_error_us > s_timing.max_abs_error_us) {
+        s_timing.max_abs_error_us = abs_error_us;
+    }
+    portEXIT_CRITICAL(&s_timing_lock);
+}
+
+/* Overlay the live keys on a boot report: modifiers are OR'ed, keys fill
+ * the free slots after the queued ones */
+static void merge_live(uint8_t data[BOOT_REPORT_LEN], const live_state_t *live)
+{
+    data[0] |= live->modifier;
+    for (int i = 0; i < 6; i++) {
+        uint8_t key = live->keys[i];
+        if (key == 0 || memchr(&data[2], key, 6) != NULL) {
+            continue;
+        }
+        uint8_t *slot = memchr(&data[2], 0, 6);
+        if (slot == NULL) {
+            break;
+        }
+        *slot = key;
+    }
+}
+
+static bool reports_waiting(void)
+{
+    return uxQueueMessagesWaiting(s_live_fifo) > 0 || uxQueueMessagesWaiting(s_fifo) > 0;
+}
+
+/* Send the next live state, unpaced, on top of the current queued state */
+static void submit_live(int64_t now)
+{
+    uint8_t data[BOOT_REPORT_LEN];
+
+    memcpy(data, s_boot_bulk, sizeof(data));
+    merge_live(data, &s_live_sent);
+    s_tx_submit_us = now;
+    s_tx_instance = HID_INSTANCE_BOOT;
+    if (!tud_hid_n_report(HID_INSTANCE_BOOT, 0, data, BOOT_REPORT_LEN)) {
+        ESP_LOGW(TAG, "Live report submit failed");
+        atomic_store(&s_tx_busy, false);
+    }
+}
+
+/* Submit the next queued report if nothing is in flight and its gap has
+ * elapsed. Live key reports go first and ignore pacing. Called from the
+ * producer after queueing, from the completion callback, from the pace
+ * timer and at every start-of-frame, so a report is on the endpoint before
+ * the host's next poll slot instead of after it. */
+static void kick_tx(void)
+{
+    hid_report_t report;
+
+    while (reports_waiting()) {
+        bool expected = false;
+        if (!atomic_compare_exchange_strong(&s_tx_busy, &expected, true)) {
+            return;
+        }
+
+        if (xQueueReceive(s_live_fifo, &s_live_sent, 0) == pdTRUE) {
+            submit_live(esp_timer_get_time());
+            if (atomic_load(&s_tx_busy)) {
+                return;
+            }
+            continue;
+        }
+
+        if (xQueuePeek(s_fifo, &report, 0) != pdTRUE) {
+            atomic_store(&s_tx_busy, false);
+            continue;
+        }
+        int64_t now = esp_timer_get_time();
+        int64_t since_last_us = now - s_tx_submit_us;
+        if (report.gap_us > 0 && since_last_us < report.gap_us) {
+            /* Not due yet: wake up exactly when it is */
+            atomic_store(&s_tx_busy, false);
+            esp_timer_stop(s_pace_timer);
+            esp_timer_start_once(s_pace_timer, report.gap_us - since_last_us);
+            return;
+        }
+        (void)xQueueReceive(s_fifo, &report, 0);
+
+        if (report.gap_us > 0) {
+            record_timing(report.gap_us, since_last_us);
+        }
+        s_tx_submit_us = now;
+        s_tx_instance = report.instance;
+        if (report.instance == HID_INSTANCE_BOOT) {
+            memcpy(s_boot_bulk, report.data, BOOT_REPORT_LEN);
+            merge_live(report.data, &s_live_sent);
+        }
+        if (tud_hid_n_report(report.instance, 0, report.data, report.len)) {
+            if (s_tx_cb) {
+                s_tx_cb(report.keys_down);
+            }
+            return;
+        }
+
+        /* Endpoint not available (bus reset or unmount): drop the report */
+        ESP_LOGW(TAG, "Report submit failed on instance %u", report.instance);
+        s_stalls++;
+        atomic_store(&s_tx_busy, false);
+    }
+}
+
+/* Drop queued reports. A report already on the endpoint stays in flight:
+ * busy is left to its completion (or the stall recovery), so the next one
+ * is not submitted over it. */
+static void flush_fifo(void)
+{
+    xQueueReset(s_fifo);
+    xSemaphoreGive(s_idle_sem);
+}
+
+/* Unmounted: nothing in flight will complete */
+static void reset_tx(void)
+{
+    flush_fifo();
+    atomic_store(&s_tx_busy, false);
+}
+
+/* Recover from a completion that never arrived (host stopped polling
+ * mid-transfer, e.g. across a suspend) */
+static void recover_stalled_tx(void)
+{
+    if (atomic_load(&s_tx_busy) &&
+        esp_timer_get_time() - s_tx_submit_us > TX_STALL_US &&
+        tud_hid_n_ready(s_tx_instance)) {
+        atomic_store(&s_tx_busy, false);
+        s_stalls++;
+        kick_tx();
+    }
+}
+
+static esp_err_t queue_report(const hid_report_t *report)
+{
+    if (!tud_mounted()) {
+        reset_tx();
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    recover_stalled_tx();
+
+    if (xQueueSend(s_fifo, report, pdMS_TO_TICKS(USB_HID_QUEUE_TIMEOUT_MS)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    s_pending_gap_us = 0;
+    kick_tx();
+    return ESP_OK;
+}
+
+static void pace_timer_cb(void *arg)
+{
+    (void)arg;
+    kick_tx();
+}
+
+void tud_sof_cb(uint32_t frame_count)
+{
+    (void)frame_count;
+    if (!atomic_load(&s_tx_busy) && reports_waiting()) {
+        kick_tx();
+    }
+}
+
+void tud_hid_report_complete_cb(uint8_t instance, uint8_t const *report, uint16_t len)
+{
+    (void)instance; (void)report; (void)len;
+
+    int64_t now = esp_timer_get_time();
+    s_last_ack_us = now;
+    s_last_latency_us = (uint32_t)(now - s_tx_submit_us);
+    s_reports_acked++;
+
+    atomic_store(&s_tx_busy, false);
+    kick_tx();
+    if (!atomic_load(&s_tx_busy)) {
+        xSemaphoreGive(s_idle_sem);
+    }
+}
+
 esp_err_t usb_hid_init(void)
 {
+    s_fifo = xQueueCreate(REPORT_FIFO_DEPTH, sizeof(hid_report_t));
+    s_live_fifo = xQueueCreate(LIVE_FIFO_DEPTH, sizeof(live_state_t));
+    s_idle_sem = xSemaphoreCreateBinary();
+    if (s_fifo == NULL || s_live_fifo == NULL || s_idle_sem == NULL) return ESP_ERR_NO_MEM;
+    atomic_store(&s_tx_busy, false);
+
+    const esp_timer_create_args_t pace_args = {
+        .callback = pace_timer_cb,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "hid_pace",
+    };
+    esp_err_t err = esp_timer_create(&pace_args, &s_pace_timer);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    uint8_t poll_ms = 0;
+    if (nvs_storage_get_u8("config", "usb_poll_ms", &poll_ms) == ESP_OK && poll_ms > 0) {
+        s_poll_interval_ms = poll_ms;
+    }
+    apply_poll_interval();
+
     const tinyusb_config_t tusb_cfg = {
         .device_descriptor = &s_device_descriptor,
         .string_descriptor = s_string_descriptor,
@@ -84,19 +412,21 @@ esp_err_t usb_hid_init(void)
         .configuration_descriptor = s_config_descriptor,
     };
 
-    esp_err_t err = tinyusb_driver_install(&tusb_cfg);
+    err = tinyusb_driver_install(&tusb_cfg);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "TinyUSB install failed: %s", esp_err_to_name(err));
         return err;
     }
 
-    ESP_LOGI(TAG, "USB HID keyboard initialized");
+    tud_sof_cb_enable(true);
+
+    ESP_LOGI(TAG, "USB HID keyboard initialized (poll=%ums)", s_poll_interval_ms);
     return ESP_OK;
 }
 
 bool usb_hid_ready(void)
 {
-    return tud_mounted() && tud_hid_ready();
+    return tud_mounted() && uxQueueSpacesAvailable(s_fifo) > 0;
 }
 
 bool usb_hid_connected(void)
@@ -106,34 +436,199 @@ bool usb_hid_connected(void)
 
 esp_err_t usb_hid_send_key(uint8_t modifier, uint8_t keycode)
 {
-    if (!tud_mounted()) return ESP_ERR_INVALID_STATE;
+    uint8_t keycodes[6] = {keycode, 0, 0, 0, 0, 0};
+    return usb_hid_send_report(modifier, keycodes);
+}
 
-    /* Wait for HID ready */
-    int retries = 50;
-    while (!tud_hid_ready() && retries-- > 0) {
-        vTaskDelay(pdMS_TO_TICKS(1));
+esp_err_t usb_hid_send_report(uint8_t modifier, const uint8_t keycodes[6])
+{
+    hid_report_t report = {
+        .instance = HID_INSTANCE_BOOT,
+        .len = BOOT_REPORT_LEN,
+    };
+    report.data[0] = modifier;
+    if (keycodes != NULL) {
+        memcpy(&report.data[2], keycodes, 6);
     }
-    if (!tud_hid_ready()) return ESP_ERR_TIMEOUT;
+    report.keys_down = modifier != 0 || report.data[2] != 0;
+    report.gap_us = s_pending_gap_us;
+    return queue_report(&report);
+}
 
-    uint8_t keycodes[6] = {keycode, 0, 0, 0, 0, 0};
-    if (!tud_hid_keyboard_report(1, modifier, keycodes)) {
-        return ESP_FAIL;
+esp_err_t usb_hid_release_keys(void)
+{
+    return usb_hid_send_report(0, NULL);
+}
+
+bool usb_hid_nkro_active(void)
+{
+#if CONFIG_HID_TYPER_NKRO
+    /* Hosts that switched the boot interface to boot protocol (BIOS/UEFI)
+     * do not poll the NKRO endpoint. */
+    return tud_mounted() && tud_hid_n_get_protocol(HID_INSTANCE_BOOT) == HID_PROTOCOL_REPORT;
+#else
+    return false;
+#endif
+}
+
+esp_err_t usb_hid_send_nkro(uint8_t modifier, const uint8_t *keycodes, size_t count)
+{
+#if CONFIG_HID_TYPER_NKRO
+    hid_report_t report = {
+        .instance = HID_INSTANCE_NKRO,
+        .len = NKRO_REPORT_LEN,
+        .keys_down = modifier != 0 || count > 0,
+        .gap_us = s_pending_gap_us,
+    };
+    report.data[0] = modifier;
+    for (size_t i = 0; i < count; i++) {
+        uint8_t key = keycodes[i];
+        if (key != 0 && key < USB_HID_NKRO_KEYS) {
+            report.data[1 + key / 8] |= (uint8_t)(1u << (key % 8));
+        }
+    }
+    return queue_report(&report);
+#else
+    (void)modifier; (void)keycodes; (void)count;
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t usb_hid_wait_idle(uint32_t timeout_ms)
+{
+    int64_t deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+
+    while (uxQueueMessagesWaiting(s_fifo) > 0 || atomic_load(&s_tx_busy)) {
+        if (!tud_mounted()) {
+            reset_tx();
+            return ESP_ERR_INVALID_STATE;
+        }
+        recover_stalled_tx();
+        int64_t remaining_us = deadline - esp_timer_get_time();
+        if (remaining_us <= 0) {
+            return ESP_ERR_TIMEOUT;
+        }
+        if (remaining_us > TX_STALL_US) {
+            remaining_us = TX_STALL_US;     /* Wake up to check for a stall */
+        }
+        xSemaphoreTake(s_idle_sem, pdMS_TO_TICKS(remaining_us / 1000) + 1);
     }
     return ESP_OK;
 }
 
-esp_err_t usb_hid_release_keys(void)
+void usb_hid_flush(void)
+{
+    flush_fifo();
+}
+
+esp_err_t usb_hid_live_key(uint8_t usage, bool down)
 {
-    if (!tud_mounted()) return ESP_ERR_INVALID_STATE;
+    live_state_t next = s_live_next;
 
-    int retries = 50;
-    while (!tud_hid_ready() && retries-- > 0) {
-        vTaskDelay(pdMS_TO_TICKS(1));
+    if (usage >= LIVE_MODIFIER_USAGE_MIN && usage <= LIVE_MODIFIER_USAGE_MAX) {
+        uint8_t bit = 1 << (usage - LIVE_MODIFIER_USAGE_MIN);
+        next.modifier = down ? next.modifier | bit : next.modifier & ~bit;
+    } else if (usage != 0) {
+        uint8_t *slot = memchr(next.keys, usage, sizeof(next.keys));
+        if (down && slot == NULL) {
+            slot = memchr(next.keys, 0, sizeof(next.keys));
+            if (slot == NULL) {
+                return ESP_ERR_NO_MEM;      /* Six live keys already down */
+            }
+            *slot = usage;
+        } else if (!down && slot != NULL) {
+            *slot = 0;
+        }
     }
-    if (!tud_hid_ready()) return ESP_ERR_TIMEOUT;
+    if (memcmp(&next, &s_live_next, sizeof(next)) == 0) {
+        return ESP_OK;
+    }
+    if (!tud_mounted()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (xQueueSend(s_live_fifo, &next, 0) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    s_live_next = next;
+    kick_tx();
+    return ESP_OK;
+}
+
+void usb_hid_live_release(void)
+{
+    static const live_state_t released = { 0 };
+
+    if (memcmp(&s_live_next, &released, sizeof(released)) == 0) {
+        return;
+    }
+    /* Pending intermediate states no longer matter, only that all is up */
+    xQueueReset(s_live_fifo);
+    s_live_next = released;
+    if (tud_mounted()) {
+        (void)xQueueSend(s_live_fifo, &released, 0);
+        kick_tx();
+    } else {
+        s_live_sent = released;
+    }
+}
+
+void usb_hid_set_tx_callback(usb_hid_tx_cb_t cb)
+{
+    s_tx_cb = cb;
+}
+
+void usb_hid_get_stats(usb_hid_stats_t *stats)
+{
+    stats->reports_acked = s_reports_acked;
+    stats->last_ack_us = s_last_ack_us;
+    stats->last_latency_us = s_last_latency_us;
+    stats->queued = uxQueueMessagesWaiting(s_fifo);
+    stats->stalls = s_stalls;
+}
 
-    if (!tud_hid_keyboard_report(1, 0, NULL)) {
-        return ESP_FAIL;
+void usb_hid_delay_next_us(uint32_t delay_us)
+{
+    s_pending_gap_us = delay_us;
+}
+
+void usb_hid_get_timing_stats(usb_hid_timing_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_timing_lock);
+    *stats = s_timing;
+    portEXIT_CRITICAL(&s_timing_lock);
+}
+
+void usb_hid_reset_timing_stats(void)
+{
+    portENTER_CRITICAL(&s_timing_lock);
+    memset(&s_timing, 0, sizeof(s_timing));
+    portEXIT_CRITICAL(&s_timing_lock);
+}
+
+esp_err_t usb_hid_set_poll_interval_ms(uint8_t interval_ms)
+{
+    if (interval_ms < MIN_POLL_INTERVAL_MS || interval_ms > MAX_POLL_INTERVAL_MS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (interval_ms == s_poll_interval_ms) {
+        return ESP_OK;
+    }
+
+    s_poll_interval_ms = interval_ms;
+    apply_poll_interval();
+    ESP_LOGI(TAG, "Poll interval set to %u ms", s_poll_interval_ms);
+
+    /* The host only reads bInterval during enumeration */
+    if (tud_mounted()) {
+        reset_tx();
+        tud_disconnect();
+        vTaskDelay(pdMS_TO_TICKS(50));
+        tud_connect();
     }
     return ESP_OK;
 }
+
+uint8_t usb_hid_get_poll_interval_ms(void)
+{
+    return s_poll_interval_ms;
+}
@@ -3,9 +3,55 @@
 #include "esp_err.h"
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+
+/* Usages covered by the NKRO bitmap (0x00..0xDF, everything but modifiers) */
+#define USB_HID_NKRO_KEYS   224
+
+/* How long a producer blocks for space in the report FIFO */
+#define USB_HID_QUEUE_TIMEOUT_MS    200
+
+typedef struct {
+    uint32_t reports_acked;     /* Reports collected by the host */
+    int64_t last_ack_us;        /* esp_timer time of the last completion */
+    uint32_t last_latency_us;   /* Submit-to-completion time of that report */
+    uint32_t queued;            /* Reports waiting in the FIFO */
+    uint32_t stalls;            /* Completions never seen, or the endpoint
+                                 * refused a report */
+} usb_hid_stats_t;
+
+/* Requested vs measured spacing of paced reports (those queued after
+ * usb_hid_delay_next_us()) */
+typedef struct {
+    uint32_t samples;
+    uint32_t last_requested_us;
+    uint32_t last_measured_us;
+    uint32_t max_abs_error_us;
+    uint64_t total_abs_error_us;
+} usb_hid_timing_stats_t;
+
+/* Called when a queued report is handed to the endpoint */
+typedef void (*usb_hid_tx_cb_t)(bool keys_down);
 
 esp_err_t usb_hid_init(void);
 bool usb_hid_connected(void);
 bool usb_hid_ready(void);
 esp_err_t usb_hid_send_key(uint8_t modifier, uint8_t keycode);
+esp_err_t usb_hid_send_report(uint8_t modifier, const uint8_t keycodes[6]);
 esp_err_t usb_hid_release_keys(void);
+bool usb_hid_nkro_active(void);
+esp_err_t usb_hid_send_nkro(uint8_t modifier, const uint8_t *keycodes, size_t count);
+esp_err_t usb_hid_wait_idle(uint32_t timeout_ms);
+void usb_hid_flush(void);
+void usb_hid_set_tx_callback(usb_hid_tx_cb_t cb);
+void usb_hid_get_stats(usb_hid_stats_t *stats);
+void usb_hid_delay_next_us(uint32_t delay_us);
+void usb_hid_get_timing_stats(usb_hid_timing_stats_t *stats);
+void usb_hid_reset_timing_stats(void);
+/* Live keys, pressed and released directly by a remote client. Each event
+ * is reported on the boot interface ahead of queued reports and merged with
+ * them. Call from one task only. */
+esp_err_t usb_hid_live_key(uint8_t usage, bool down);
+void usb_hid_live_release(void);
+esp_err_t usb_hid_set_poll_interval_ms(uint8_t interval_ms);
+uint8_t usb_hid_get_poll_interval_ms(void);
@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+"""Check that the webapp builds text frames the firmware accepts.
+
+The frame layout and limits are defined twice, in webapp/src/utils/frame.ts
+and ble.ts and in firmware/main/ble_server.c. This compares the constants
+and the largest frame each side allows.
+"""
+
+import os
+import re
+import sys
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..")
+SHARED = ["FRAME_MARKER", "FRAME_FLAG_LAST", "FRAME_FLAG_COMPRESSED",
+          "FRAME_FLAG_INTERACTIVE", "FRAME_HEADER_LEN", "FRAME_CRC_OFFSET",
+          "FRAME_MAX_PLAIN"]
+
+
+def read(*path):
+    with open(os.path.join(ROOT, *path), encoding="utf-8") as f:
+        return f.read()
+
+
+def evaluate(expr, names):
+    expr = re.sub(r"/\*.*?\*/", "", expr).strip()
+    expr = re.sub(r"\b[A-Z_][A-Z0-9_]*\b", lambda m: str(names[m.group(0)]), expr)
+    if not re.fullmatch(r"[0-9xXa-fA-F()+\-* ]+", expr):
+        raise ValueError("cannot evaluate %r" % expr)
+    return eval(expr)  # digits and arithmetic only, checked above
+
+
+def c_defines(text):
+    names = {}
+    for m in re.finditer(r"^#define\s+(FRAME_\w+)\s+(.+)$", text, re.M):
+        names[m.group(1)] = evaluate(m.group(2), names)
+    return names
+
+
+def ts_consts(text):
+    names = {}
+    for m in re.finditer(r"^(?:export\s+)?const\s+([A-Z_][A-Z0-9_]*)\s*=\s*([^;]+);", text, re.M):
+        try:
+            names[m.group(1)] = evaluate(m.group(2), names)
+        except (KeyError, ValueError):
+            pass
+    return names
+
+
+def main():
+    firmware = c_defines(read("firmware", "main", "ble_server.c"))
+    webapp = ts_consts(read("webapp", "src", "utils", "frame.ts"))
+    webapp.update(ts_consts(read("webapp", "src", "utils", "ble.ts")))
+
+    errors = []
+    for name in SHARED:
+        if firmware.get(name) != webapp.get(name):
+            errors.append("%s: firmware %s, webapp %s" % (name, firmware.get(name), webapp.get(name)))
+    firmware_max = firmware["FRAME_HEADER_LEN"] + firmware["FRAME_MAX_PAYLOAD"]
+    if webapp.get("MAX_ATTR_LEN") != firmware_max:
+        errors.append("largest frame: firmware %d bytes, webapp MAX_ATTR_LEN %s"
+                      % (firmware_max, webapp.get("MAX_ATTR_LEN")))
+
+    for error in errors:
+        print("mismatch: " + error)
+    if not errors:
+        print("frame limits match: %d-byte header, %d-byte frames"
+              % (firmware["FRAME_HEADER_LEN"], firmware_max))
+    return 1 if errors else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
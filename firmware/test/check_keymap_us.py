@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""Check the generated US layout against the hand-written keymap_us.h.
+
+gen_keymaps.py is run twice, on the build host's XKB data (when present)
+and with its built-in fallback, and the ASCII page of each "us" table must
+type every character exactly as keymap_us.h does.
+"""
+
+import ast
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+GEN = os.path.join(HERE, "..", "tools", "gen_keymaps.py")
+MODS = {"MOD_NONE": 0x00, "MOD_LCTRL": 0x01, "MOD_LSHIFT": 0x02, "MOD_LALT": 0x04,
+        "MOD_LGUI": 0x08, "MOD_RCTRL": 0x10, "MOD_RSHIFT": 0x20, "MOD_RALT": 0x40,
+        "MOD_RGUI": 0x80}
+
+
+def expected_table():
+    with open(os.path.join(HERE, "keymap_us.h"), encoding="utf-8") as f:
+        text = f.read()
+    table = {}
+    entry = re.compile(r"\[\s*(0x[0-9A-Fa-f]+|'(?:\\.|[^'\\])')\s*\]\s*=\s*"
+                       r"\{\s*(0x[0-9A-Fa-f]+)\s*,\s*([\w |]+?)\s*\}")
+    for m in entry.finditer(text):
+        index = m.group(1)
+        cp = int(index, 16) if index.startswith("0x") else ord(ast.literal_eval(index))
+        mod = 0
+        for name in m.group(3).split("|"):
+            mod |= MODS[name.strip()]
+        if int(m.group(2), 16) != 0:
+            table[cp] = (int(m.group(2), 16), mod)
+    return table
+
+
+def generated_table(extra_args):
+    with tempfile.TemporaryDirectory() as tmp:
+        out = os.path.join(tmp, "keymap_tables.c")
+        subprocess.run([sys.executable, GEN, "--output", out] + extra_args + ["us"],
+                       check=True)
+        with open(out, encoding="utf-8") as f:
+            text = f.read()
+    page = re.search(r"static const keymap_char_t US_000\[KEYMAP_PAGE_SIZE\] = \{(.*?)\n\};",
+                     text, re.S)
+    table = {}
+    entry = re.compile(r"\[(0x[0-9A-F]+)\] = \{ \{ (0x[0-9A-F]+), 0x[0-9A-F]+ \}, "
+                       r"\{ (0x[0-9A-F]+), (0x[0-9A-F]+) \} \}")
+    for m in entry.finditer(page.group(1)):
+        if int(m.group(2), 16) != 0:
+            continue    # Dead-key sequences have no hand-written counterpart
+        table[int(m.group(1), 16)] = (int(m.group(3), 16), int(m.group(4), 16))
+    return table
+
+
+def describe(entry):
+    return "0x%02X+0x%02X" % entry if entry else "unmapped"
+
+
+def main():
+    expected = expected_table()
+    failures = 0
+    for label, args in (("XKB data", []), ("built-in fallback", ["--xkb-root", os.devnull])):
+        table = generated_table(args)
+        diffs = [cp for cp in sorted(set(expected) | set(table)) if expected.get(cp) != table.get(cp)]
+        for cp in diffs:
+            print("%s: %r is %s, keymap_us.h has %s"
+                  % (label, chr(cp), describe(table.get(cp)), describe(expected.get(cp))))
+        print("%s %s: %d characters" % ("FAIL" if diffs else "ok  ", label, len(table)))
+        failures += bool(diffs)
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
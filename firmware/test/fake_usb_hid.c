@@ -0,0 +1,108 @@
+#include "fake_usb_hid.h"
+#include "usb_hid.h"
+#include "neopixel.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include <string.h>
+
+static fake_report_t s_reports[FAKE_USB_HID_MAX_REPORTS];
+static size_t s_count;
+static int64_t s_last_us;
+static led_state_t s_led_state;
+
+size_t fake_usb_hid_reports(fake_report_t *out, size_t max)
+{
+    portENTER_CRITICAL(NULL);
+    size_t n = s_count < max ? s_count : max;
+    memcpy(out, s_reports, n * sizeof(*out));
+    portEXIT_CRITICAL(NULL);
+    return n;
+}
+
+void fake_usb_hid_clear(void)
+{
+    portENTER_CRITICAL(NULL);
+    s_count = 0;
+    portEXIT_CRITICAL(NULL);
+}
+
+static esp_err_t record(uint8_t modifier, const uint8_t keys[6])
+{
+    esp_err_t err = ESP_OK;
+
+    portENTER_CRITICAL(NULL);
+    if (s_count < FAKE_USB_HID_MAX_REPORTS) {
+        s_reports[s_count].modifier = modifier;
+        memset(s_reports[s_count].keys, 0, sizeof(s_reports[s_count].keys));
+        if (keys != NULL) {
+            memcpy(s_reports[s_count].keys, keys, sizeof(s_reports[s_count].keys));
+        }
+        s_count++;
+        s_last_us = esp_timer_get_time();
+    } else {
+        err = ESP_ERR_NO_MEM;
+    }
+    portEXIT_CRITICAL(NULL);
+    return err;
+}
+
+esp_err_t usb_hid_init(void) { return ESP_OK; }
+bool usb_hid_connected(void) { return true; }
+bool usb_hid_ready(void) { return true; }
+
+esp_err_t usb_hid_send_key(uint8_t modifier, uint8_t keycode)
+{
+    uint8_t keys[6] = { keycode };
+    return record(modifier, keys);
+}
+
+esp_err_t usb_hid_send_report(uint8_t modifier, const uint8_t keycodes[6])
+{
+    return record(modifier, keycodes);
+}
+
+esp_err_t usb_hid_release_keys(void)
+{
+    return record(0, NULL);
+}
+
+bool usb_hid_nkro_active(void) { return false; }
+
+esp_err_t usb_hid_send_nkro(uint8_t modifier, const uint8_t *keycodes, size_t count)
+{
+    return ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t usb_hid_wait_idle(uint32_t timeout_ms) { return ESP_OK; }
+void usb_hid_flush(void) {}
+void usb_hid_set_tx_callback(usb_hid_tx_cb_t cb) {}
+
+void usb_hid_get_stats(usb_hid_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    portENTER_CRITICAL(NULL);
+    stats->reports_acked = (uint32_t)s_count;
+    stats->last_ack_us = s_last_us;
+    portEXIT_CRITICAL(NULL);
+}
+
+void usb_hid_delay_next_us(uint32_t delay_us) {}
+
+void usb_hid_get_timing_stats(usb_hid_timing_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+void usb_hid_reset_timing_stats(void) {}
+esp_err_t usb_hid_live_key(uint8_t usage, bool down) { return ESP_OK; }
+void usb_hid_live_release(void) {}
+esp_err_t usb_hid_set_poll_interval_ms(uint8_t interval_ms) { return ESP_OK; }
+uint8_t usb_hid_get_poll_interval_ms(void) { return 1; }
+
+esp_err_t neopixel_init(void) { return ESP_OK; }
+void neopixel_set_state(led_state_t state) { s_led_state = state; }
+void neopixel_set_brightness(uint8_t percent) {}
+uint8_t neopixel_get_brightness(void) { return 0; }
+led_state_t neopixel_get_state(void) { return s_led_state; }
+void neopixel_set_typing_indicator(bool enabled) {}
+void neopixel_set_typing_key_down(bool key_down) {}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Host build of usb_hid.c: boot reports are recorded instead of sent, and
+ * the host "collects" each one at once */
+typedef struct {
+    uint8_t modifier;
+    uint8_t keys[6];
+} fake_report_t;
+
+#define FAKE_USB_HID_MAX_REPORTS    8192
+
+/* Copies out the reports recorded so far; returns how many there were */
+size_t fake_usb_hid_reports(fake_report_t *out, size_t max);
+void fake_usb_hid_clear(void);
@@ -0,0 +1,154 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* Host build of the FreeRTOS calls the firmware uses: tasks are threads,
+ * a task notification is a counter under a condition variable */
+
+struct host_task {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notified;
+    TaskFunction_t fn;
+    void *arg;
+};
+
+struct host_mutex {
+    pthread_mutex_t lock;
+};
+
+static pthread_mutex_t s_critical;
+static pthread_once_t s_critical_once = PTHREAD_ONCE_INIT;
+static _Thread_local struct host_task *s_self;
+
+static void init_critical(void)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&s_critical, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void host_rtos_enter_critical(void)
+{
+    pthread_once(&s_critical_once, init_critical);
+    pthread_mutex_lock(&s_critical);
+}
+
+void host_rtos_exit_critical(void)
+{
+    pthread_mutex_unlock(&s_critical);
+}
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void *task_entry(void *arg)
+{
+    s_self = arg;
+    s_self->fn(s_self->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack,
+                       void *arg, UBaseType_t priority, TaskHandle_t *handle)
+{
+    struct host_task *task = calloc(1, sizeof(*task));
+    if (task == NULL) return pdFALSE;
+    pthread_mutex_init(&task->lock, NULL);
+    pthread_cond_init(&task->cond, NULL);
+    task->fn = fn;
+    task->arg = arg;
+    if (handle != NULL) {
+        *handle = task;
+    }
+    if (pthread_create(&task->thread, NULL, task_entry, task) != 0) {
+        return pdFALSE;
+    }
+    pthread_detach(task->thread);
+    return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts = { ticks / 1000, (long)(ticks % 1000) * 1000000 };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+    struct host_task *task = s_self;
+    struct timespec deadline;
+    uint32_t value;
+
+    if (task == NULL) {
+        vTaskDelay(ticks);
+        return 0;
+    }
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ticks / 1000;
+    deadline.tv_nsec += (long)(ticks % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&task->lock);
+    while (task->notified == 0 && ticks != 0) {
+        if (ticks == portMAX_DELAY) {
+            pthread_cond_wait(&task->cond, &task->lock);
+        } else if (pthread_cond_timedwait(&task->cond, &task->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    value = task->notified;
+    if (clear) {
+        task->notified = 0;
+    } else if (value > 0) {
+        task->notified--;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+void xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notified++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    struct host_mutex *sem = calloc(1, sizeof(*sem));
+    if (sem != NULL) {
+        pthread_mutex_init(&sem->lock, NULL);
+    }
+    return sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    (void)ticks;    /* The firmware only waits forever */
+    pthread_mutex_lock(&sem->lock);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    pthread_mutex_unlock(&sem->lock);
+    return pdTRUE;
+}
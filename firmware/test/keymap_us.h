@@ -1,5 +1,9 @@
 #pragma once
 
+/* The hand-written US table the firmware used before layouts were generated
+ * by tools/gen_keymaps.py. check_keymap_us.py holds the generated "us"
+ * layout to it; it is not compiled. */
+
 #include <stdint.h>
 
 #define MOD_NONE    0x00
@@ -0,0 +1,53 @@
+// Compress files with the webapp's LZSS encoder (webapp/src/utils/lzss.ts)
+// for test_lzss: node lzss_encode.mjs <out-dir> <file>...
+// Each <file> is written to <out-dir>/<basename>.lzss. Exits 77 (skipped)
+// if this node can neither run TypeScript nor find the webapp's compiler.
+
+import { readFileSync, writeFileSync } from "node:fs";
+import { createRequire } from "node:module";
+import { basename, join } from "node:path";
+
+const SKIP = 77;
+const source = new URL("../../webapp/src/utils/lzss.ts", import.meta.url);
+
+async function loadEncoder() {
+  try {
+    return await import(source.href);
+  } catch {
+    // No type stripping in this node: transpile with the webapp's compiler
+  }
+  try {
+    const require = createRequire(new URL("../../webapp/package.json", import.meta.url));
+    const ts = require("typescript");
+    const { outputText } = ts.transpileModule(readFileSync(source, "utf8"), {
+      compilerOptions: { module: ts.ModuleKind.ESNext, target: ts.ScriptTarget.ES2022 },
+    });
+    return await import("data:text/javascript," + encodeURIComponent(outputText));
+  } catch {
+    return null;
+  }
+}
+
+const [outDir, ...files] = process.argv.slice(2);
+if (!outDir || files.length === 0) {
+  console.error("usage: node lzss_encode.mjs <out-dir> <file>...");
+  process.exit(2);
+}
+
+const encoder = await loadEncoder();
+if (!encoder) {
+  console.log("lzss_encode: cannot load lzss.ts (needs node >= 23.6 or webapp/node_modules)");
+  process.exit(SKIP);
+}
+
+for (const file of files) {
+  const input = new Uint8Array(readFileSync(file));
+  const start = performance.now();
+  const { data } = encoder.lzssCompress(input);
+  const ms = performance.now() - start;
+  writeFileSync(join(outDir, basename(file) + ".lzss"), data);
+  console.log(
+    `encoded ${basename(file)}: ${input.length} -> ${data.length} bytes, ` +
+      `${(input.length / 1e3 / Math.max(ms, 0.001)).toFixed(1)} MB/s`
+  );
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Host build: just enough FreeRTOS for the typing engine, on pthreads
+ * (see host_rtos.c). The tick is one millisecond, and every critical
+ * section shares one recursive mutex. */
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdFALSE         0
+#define pdTRUE          1
+#define pdPASS          pdTRUE
+#define portMAX_DELAY   UINT32_MAX
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(ms))
+
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+
+void host_rtos_enter_critical(void);
+void host_rtos_exit_critical(void);
+#define portENTER_CRITICAL(mux) do { (void)(mux); host_rtos_enter_critical(); } while (0)
+#define portEXIT_CRITICAL(mux)  do { (void)(mux); host_rtos_exit_critical(); } while (0)
@@ -0,0 +1,163 @@
+/* Types text through the real typing engine and key stream encoder against
+ * a recording usb_hid, then decodes the boot reports the host would see
+ * back into text. A key counts as typed in the report where it first
+ * appears, in array order, which is how hosts turn reports into key-down
+ * events. */
+#include "typing_engine.h"
+#include "keymap.h"
+#include "fake_usb_hid.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#define WAIT_TIMEOUT_US     10000000
+
+static fake_report_t s_reports[FAKE_USB_HID_MAX_REPORTS];
+static atomic_uint s_jobs_done;
+static int s_failures;
+
+static void on_progress(const typing_progress_t *progress)
+{
+    if (progress->done) {
+        atomic_fetch_add(&s_jobs_done, 1);
+    }
+}
+
+static int decode_key(const keymap_layout_t *layout, uint8_t keycode, uint8_t modifier)
+{
+    for (uint32_t cp = 0; cp < KEYMAP_PAGE_SIZE; cp++) {
+        const keymap_char_t *entry = keymap_lookup(layout, cp);
+        if (entry != NULL && entry->dead.keycode == 0 &&
+            entry->key.keycode == keycode && entry->key.modifier == modifier) {
+            return (int)cp;
+        }
+    }
+    return -1;
+}
+
+/* Returns the number of reports; 'text' gets the decoded characters and
+ * 'max_new' the most keys pressed by one report */
+static size_t decode(char *text, size_t size, int *max_new)
+{
+    const keymap_layout_t *layout = keymap_find("us");
+    size_t count = fake_usb_hid_reports(s_reports, FAKE_USB_HID_MAX_REPORTS);
+    uint8_t prev[6] = {0};
+    size_t len = 0;
+
+    *max_new = 0;
+    for (size_t i = 0; i < count; i++) {
+        const fake_report_t *r = &s_reports[i];
+        int pressed = 0;
+        for (int k = 0; k < 6 && r->keys[k] != 0; k++) {
+            if (memchr(prev, r->keys[k], sizeof(prev)) != NULL) continue;
+            int ch = decode_key(layout, r->keys[k], r->modifier);
+            if (len + 1 < size) {
+                text[len++] = ch >= 0 ? (char)ch : '?';
+            }
+            pressed++;
+        }
+        if (pressed > *max_new) {
+            *max_new = pressed;
+        }
+        memcpy(prev, r->keys, sizeof(prev));
+    }
+    text[len] = '\0';
+    return count;
+}
+
+static void type_and_wait(const char *text)
+{
+    unsigned done = atomic_load(&s_jobs_done);
+    int64_t start = esp_timer_get_time();
+
+    fake_usb_hid_clear();
+    if (typing_engine_enqueue(TYPING_JOB_NONE, text, strlen(text)) != ESP_OK) {
+        printf("FAIL enqueue\n");
+        s_failures++;
+        return;
+    }
+    typing_engine_reset_input();
+    while (atomic_load(&s_jobs_done) == done || typing_engine_is_typing()) {
+        if (esp_timer_get_time() - start > WAIT_TIMEOUT_US) {
+            printf("FAIL timed out typing \"%s\"\n", text);
+            s_failures++;
+            return;
+        }
+        vTaskDelay(1);
+    }
+}
+
+static void check(const char *name, const char *text, uint8_t batch_keys,
+                  int want_max_new, size_t max_reports)
+{
+    char decoded[1024];
+    int max_new;
+
+    typing_engine_set_batch_keys(batch_keys);
+    type_and_wait(text);
+    size_t reports = decode(decoded, sizeof(decoded), &max_new);
+
+    bool ok = strcmp(decoded, text) == 0 && max_new == want_max_new && reports <= max_reports;
+    printf("%s %s: %zu chars, %zu reports, up to %d keys per report\n",
+           ok ? "ok  " : "FAIL", name, strlen(text), reports, max_new);
+    if (strcmp(decoded, text) != 0) {
+        printf("     typed   \"%s\"\n     decoded \"%s\"\n", text, decoded);
+    }
+    if (!ok) {
+        s_failures++;
+    }
+}
+
+/* Types 'text' under a rate limit and checks how long it took */
+static void check_rate(const char *name, const char *text, uint16_t chars_per_min,
+                       uint16_t burst, int64_t min_us, int64_t max_us)
+{
+    typing_engine_set_batch_keys(1);
+    typing_engine_set_rate_limit(chars_per_min, burst);
+    /* Let the bucket fill */
+    vTaskDelay(pdMS_TO_TICKS((uint32_t)burst * 60000 / chars_per_min + 10));
+
+    int64_t start = esp_timer_get_time();
+    type_and_wait(text);
+    int64_t took = esp_timer_get_time() - start;
+    typing_engine_set_rate_limit(0, 0);
+
+    bool ok = took >= min_us && took <= max_us;
+    printf("%s %s: %zu bytes in %lld ms at %u chars/min\n", ok ? "ok  " : "FAIL", name,
+           strlen(text), (long long)(took / 1000), chars_per_min);
+    if (!ok) {
+        s_failures++;
+    }
+}
+
+int main(void)
+{
+    static const char pangram[] = "sphinx of black quartz, judge my vow";
+    static const char mixed[] =
+        "Hello, World! aabbcc ABab\tx=1; y=\"2\"\n{[(<>)]} ~`|\\ 0123456789";
+
+    typing_engine_init();
+    typing_engine_set_progress_callback(on_progress);
+    typing_engine_set_delay_ms(5);
+    typing_engine_set_rate_limit(0, 0);
+
+    /* One key per report: a press and a release for every character */
+    check("single", pangram, 1, 1, 2 * sizeof(pangram));
+    /* Six keys per report: lowercase runs without repeats share reports */
+    check("batched", pangram, 6, 6, sizeof(pangram) / 2);
+    /* Repeats, modifier changes and control keys split the runs */
+    check("mixed", mixed, 6, 6, 2 * sizeof(mixed));
+
+    /* The limiter counts characters: 8 Unicode entries of 4 keystrokes
+     * each fit a burst of 8, where charging keystrokes would take 2.4 s */
+    typing_engine_set_unicode_method(KEY_STREAM_UNICODE_LINUX);
+    check_rate("rate unicode", "éééééééé", 600, 8, 0, 1000000);
+    typing_engine_set_unicode_method(KEY_STREAM_UNICODE_NONE);
+    /* Past the burst, 40 characters at 10/s take at least 3.2 s */
+    check_rate("rate limited", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa", 600, 8, 3000000, 6000000);
+
+    return s_failures == 0 ? 0 : 1;
+}
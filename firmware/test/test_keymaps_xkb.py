@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+"""Round trip of gen_keymaps.py output through libxkbcommon.
+
+Generates the tables for a set of layouts, then replays every entry on the
+same XKB keymap: each HID usage becomes its evdev keycode, Shift and AltGr
+are pressed as Left Shift and Right Alt, and a dead key goes through the
+Compose table. The character XKB produces must be the one the entry is for.
+Exits 77 (skipped) when libxkbcommon is not installed.
+"""
+
+import ctypes
+import ctypes.util
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+GEN = os.path.join(HERE, "..", "tools", "gen_keymaps.py")
+LAYOUTS = ["us", "de", "fr", "nl", "us(intl)"]
+SKIP = 77
+
+MOD_LSHIFT = 0x02
+MOD_RALT = 0x40
+EVDEV_OFFSET = 8            # XKB keycode = evdev code + 8
+EVDEV_LEFTSHIFT = 42
+EVDEV_RIGHTALT = 100
+
+# HID usages (keyboard page) to evdev codes, for the keys gen_keymaps.py uses
+HID_TO_EVDEV = {
+    0x28: 28, 0x29: 1, 0x2A: 14, 0x2B: 15, 0x2C: 57, 0x2D: 12, 0x2E: 13, 0x2F: 26,
+    0x30: 27, 0x31: 43, 0x33: 39, 0x34: 40, 0x35: 41, 0x36: 51, 0x37: 52, 0x38: 53,
+    0x4C: 111, 0x64: 86,
+}
+for _i, _code in enumerate([30, 48, 46, 32, 18, 33, 34, 35, 23, 36, 37, 38, 50, 49, 24, 25,
+                            16, 19, 31, 20, 22, 47, 17, 45, 21, 44]):
+    HID_TO_EVDEV[0x04 + _i] = _code         # a..z
+for _i, _code in enumerate(range(2, 12)):
+    HID_TO_EVDEV[0x1E + _i] = _code         # 1..0
+
+XKB_KEY_UP = 0
+XKB_KEY_DOWN = 1
+XKB_COMPOSE_COMPOSED = 2
+
+
+class RuleNames(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_char_p) for name in ("rules", "model", "layout", "variant", "options")]
+
+
+class Xkb:
+    def __init__(self, lib):
+        self.lib = lib
+        for name, restype, argtypes in (
+            ("xkb_context_new", ctypes.c_void_p, [ctypes.c_int]),
+            ("xkb_keymap_new_from_names", ctypes.c_void_p,
+             [ctypes.c_void_p, ctypes.POINTER(RuleNames), ctypes.c_int]),
+            ("xkb_state_new", ctypes.c_void_p, [ctypes.c_void_p]),
+            ("xkb_state_unref", None, [ctypes.c_void_p]),
+            ("xkb_state_update_key", ctypes.c_int, [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_int]),
+            ("xkb_state_key_get_one_sym", ctypes.c_uint32, [ctypes.c_void_p, ctypes.c_uint32]),
+            ("xkb_state_key_get_utf32", ctypes.c_uint32, [ctypes.c_void_p, ctypes.c_uint32]),
+            ("xkb_compose_table_new_from_locale", ctypes.c_void_p,
+             [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_int]),
+            ("xkb_compose_state_new", ctypes.c_void_p, [ctypes.c_void_p, ctypes.c_int]),
+            ("xkb_compose_state_unref", None, [ctypes.c_void_p]),
+            ("xkb_compose_state_feed", ctypes.c_int, [ctypes.c_void_p, ctypes.c_uint32]),
+            ("xkb_compose_state_get_status", ctypes.c_int, [ctypes.c_void_p]),
+            ("xkb_compose_state_get_utf8", ctypes.c_int,
+             [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t]),
+        ):
+            fn = getattr(lib, name)
+            fn.restype = restype
+            fn.argtypes = argtypes
+            setattr(self, name[4:], fn)
+        self.context = self.context_new(0)
+        self.compose = self.compose_table_new_from_locale(self.context, b"en_US.UTF-8", 0)
+
+    def keymap(self, layout, variant):
+        names = RuleNames(b"evdev", b"pc105", layout.encode(), variant.encode(), b"")
+        return self.keymap_new_from_names(self.context, ctypes.byref(names), 0)
+
+    def press(self, state, usage, mod):
+        """Type one key under mod; returns the XKB keycode, still held"""
+        if mod & MOD_LSHIFT:
+            self.state_update_key(state, EVDEV_LEFTSHIFT + EVDEV_OFFSET, XKB_KEY_DOWN)
+        if mod & MOD_RALT:
+            self.state_update_key(state, EVDEV_RIGHTALT + EVDEV_OFFSET, XKB_KEY_DOWN)
+        return HID_TO_EVDEV[usage] + EVDEV_OFFSET
+
+    def type_char(self, keymap, dead, key):
+        """Codepoint XKB produces for an entry, or None"""
+        state = self.state_new(keymap)
+        try:
+            if dead is None:
+                return self.state_key_get_utf32(state, self.press(state, *key)) or None
+            if not self.compose:
+                return None
+            compose = self.compose_state_new(self.compose, 0)
+            try:
+                for usage, mod in (dead, key):
+                    self.state_unref(state)
+                    state = self.state_new(keymap)
+                    code = self.press(state, usage, mod)
+                    self.compose_state_feed(compose, self.state_key_get_one_sym(state, code))
+                if self.compose_state_get_status(compose) != XKB_COMPOSE_COMPOSED:
+                    return None
+                buf = ctypes.create_string_buffer(16)
+                self.compose_state_get_utf8(compose, buf, len(buf))
+                text = buf.value.decode("utf-8")
+                return ord(text) if len(text) == 1 else None
+            finally:
+                self.compose_state_unref(compose)
+        finally:
+            self.state_unref(state)
+
+
+def generated_layouts():
+    """Layout name -> [(codepoint, dead, key)] from a fresh gen_keymaps.py run"""
+    with tempfile.TemporaryDirectory() as tmp:
+        out = os.path.join(tmp, "keymap_tables.c")
+        subprocess.run([sys.executable, GEN, "--output", out] + LAYOUTS, check=True)
+        with open(out, encoding="utf-8") as f:
+            text = f.read()
+
+    entries = {}
+    names = dict(re.findall(r"static const keymap_layout_t (\w+) = \{\n\s+\.name = \"([^\"]+)\"", text))
+    page_re = re.compile(r"static const keymap_char_t (\w+)_([0-9A-F]{3})\[KEYMAP_PAGE_SIZE\] = \{(.*?)\n\};", re.S)
+    entry_re = re.compile(r"\[0x([0-9A-F]{2})\] = \{ \{ 0x([0-9A-F]{2}), 0x([0-9A-F]{2}) \}, "
+                          r"\{ 0x([0-9A-F]{2}), 0x([0-9A-F]{2}) \} \}")
+    for ident, page, body in page_re.findall(text):
+        for low, dk, dm, k, m in entry_re.findall(body):
+            cp = (int(page, 16) << 7) | int(low, 16)
+            dead = (int(dk, 16), int(dm, 16)) if int(dk, 16) else None
+            entries.setdefault(names[ident], []).append((cp, dead, (int(k, 16), int(m, 16))))
+    return entries
+
+
+def main():
+    path = ctypes.util.find_library("xkbcommon")
+    if path is None:
+        print("libxkbcommon not found, skipping")
+        return SKIP
+    xkb = Xkb(ctypes.CDLL(path))
+    if not xkb.compose:
+        print("no Compose table for en_US.UTF-8: dead-key entries are not checked")
+
+    failures = 0
+    for name, entries in generated_layouts().items():
+        layout, _, variant = name.partition("-")
+        keymap = xkb.keymap(layout, variant)
+        if not keymap:
+            print("FAIL %s: libxkbcommon cannot compile the layout" % name)
+            failures += 1
+            continue
+        checked = wrong = 0
+        for cp, dead, key in entries:
+            if cp < 0x20 or cp == 0x7F:
+                continue    # Enter, Tab, Backspace... are keys, not characters
+            if dead is not None and not xkb.compose:
+                continue
+            got = xkb.type_char(keymap, dead, key)
+            checked += 1
+            if got != cp:
+                wrong += 1
+                if wrong <= 10:
+                    print("  %s: U+%04X %s via %s%s gives %s"
+                          % (name, cp, chr(cp), "dead 0x%02X+0x%02X then " % dead if dead else "",
+                             "0x%02X+0x%02X" % key, "U+%04X" % got if got else "nothing"))
+        print("%s %s: %d characters, %d wrong" % ("FAIL" if wrong else "ok  ", name, checked, wrong))
+        failures += bool(wrong)
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
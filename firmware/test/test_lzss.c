@@ -0,0 +1,213 @@
+/* Round trip of the webapp's LZSS encoder (lzss.ts, run under node by
+ * lzss_encode.mjs) through the firmware decoder. Each corpus file is
+ * decoded whole and then fed in pieces split at random points, as BLE
+ * frames split it, and must come back byte for byte. Also reports the
+ * decoder's throughput.
+ *
+ *   test_lzss <node> <lzss_encode.mjs> <work-dir> <corpus file>... */
+#include "lzss.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#define SKIP_RETURN_CODE    77
+#define SPLIT_ROUNDS        20
+#define MAX_PIECE           96
+#define MAX_FILES           16
+#define BENCH_MIN_NS        200000000LL
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+} buffer_t;
+
+typedef struct {
+    const char *name;
+    char path[512];
+    buffer_t plain;
+    buffer_t encoded;
+} corpus_t;
+
+static uint32_t s_rng = 0x2545F491;
+
+static uint32_t next_random(void)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void append(void *ctx, const uint8_t *data, size_t len)
+{
+    buffer_t *buf = ctx;
+    if (buf->len + len > buf->cap) {
+        buf->cap = (buf->len + len) * 2;
+        buf->data = realloc(buf->data, buf->cap);
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+static void discard(void *ctx, const uint8_t *data, size_t len)
+{
+    *(size_t *)ctx += len;
+}
+
+static bool read_file(const char *path, buffer_t *buf)
+{
+    FILE *f = fopen(path, "rb");
+    uint8_t chunk[4096];
+    size_t n;
+
+    if (f == NULL) return false;
+    buf->len = 0;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        append(buf, chunk, n);
+    }
+    fclose(f);
+    return true;
+}
+
+static bool write_file(const char *path, const uint8_t *data, size_t len)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) return false;
+    bool ok = fwrite(data, 1, len, f) == len;
+    return fclose(f) == 0 && ok;
+}
+
+/* Inputs the text files do not cover: incompressible bytes, one long run
+ * (every match at the maximum length) and nothing at all */
+static bool write_synthetic(const char *dir, corpus_t *files, int *count)
+{
+    static const char *names[] = { "random.bin", "run.bin", "empty.bin" };
+    uint8_t data[65536];
+
+    for (int i = 0; i < 3; i++) {
+        size_t len = 0;
+        if (i == 0) {
+            for (len = 0; len < sizeof(data); len++) {
+                data[len] = (uint8_t)next_random();
+            }
+        } else if (i == 1) {
+            len = 20000;
+            memset(data, 'a', len);
+        }
+        corpus_t *c = &files[(*count)++];
+        snprintf(c->path, sizeof(c->path), "%s/%s", dir, names[i]);
+        c->name = names[i];
+        if (!write_file(c->path, data, len)) return false;
+    }
+    return true;
+}
+
+static bool check_split(const corpus_t *c, buffer_t *out)
+{
+    lzss_decoder_t dec;
+
+    for (int round = 0; round < SPLIT_ROUNDS; round++) {
+        size_t pos = 0;
+        out->len = 0;
+        lzss_decoder_reset(&dec);
+        while (pos < c->encoded.len) {
+            /* Mostly short pieces, so every split point inside a group and
+             * inside a back-reference comes up */
+            size_t piece = round == 0 ? 1 : next_random() % (MAX_PIECE + 1);
+            if (piece > c->encoded.len - pos) piece = c->encoded.len - pos;
+            lzss_decode(&dec, c->encoded.data + pos, piece, append, out);
+            pos += piece;
+        }
+        if (out->len != c->plain.len || memcmp(out->data, c->plain.data, out->len) != 0) {
+            printf("FAIL %s: split round %d decoded %zu of %zu bytes\n",
+                   c->name, round, out->len, c->plain.len);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    corpus_t files[MAX_FILES] = {0};
+    int count = 0;
+    char command[4096];
+    int failures = 0;
+
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s <node> <lzss_encode.mjs> <work-dir> <file>...\n", argv[0]);
+        return 2;
+    }
+    if (!write_synthetic(argv[3], files, &count)) {
+        printf("FAIL cannot write to %s\n", argv[3]);
+        return 1;
+    }
+    for (int i = 4; i < argc && count < MAX_FILES; i++) {
+        corpus_t *c = &files[count++];
+        const char *slash = strrchr(argv[i], '/');
+        c->name = slash != NULL ? slash + 1 : argv[i];
+        snprintf(c->path, sizeof(c->path), "%s", argv[i]);
+    }
+
+    int n = snprintf(command, sizeof(command), "'%s' '%s' '%s'", argv[1], argv[2], argv[3]);
+    for (int i = 0; i < count; i++) {
+        n += snprintf(command + n, sizeof(command) - n, " '%s'", files[i].path);
+    }
+    fflush(stdout);
+    int status = system(command);
+    if (WIFEXITED(status) && WEXITSTATUS(status) == SKIP_RETURN_CODE) {
+        return SKIP_RETURN_CODE;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("FAIL encoder exited with status %d\n", status);
+        return 1;
+    }
+
+    buffer_t out = {0};
+    size_t encoded_total = 0;
+    size_t plain_total = 0;
+    for (int i = 0; i < count; i++) {
+        corpus_t *c = &files[i];
+        char path[600];
+        snprintf(path, sizeof(path), "%s/%s.lzss", argv[3], c->name);
+        if (!read_file(c->path, &c->plain) || !read_file(path, &c->encoded)) {
+            printf("FAIL %s: cannot read input or encoded file\n", c->name);
+            failures++;
+            continue;
+        }
+        if (check_split(c, &out)) {
+            printf("ok   %s: %zu -> %zu bytes\n", c->name, c->plain.len, c->encoded.len);
+        } else {
+            failures++;
+        }
+        encoded_total += c->encoded.len;
+        plain_total += c->plain.len;
+    }
+
+    /* Decode the whole corpus until enough time has passed to measure */
+    lzss_decoder_t dec;
+    size_t decoded = 0;
+    int64_t start = now_ns();
+    int64_t elapsed;
+    do {
+        for (int i = 0; i < count; i++) {
+            lzss_decoder_reset(&dec);
+            lzss_decode(&dec, files[i].encoded.data, files[i].encoded.len, discard, &decoded);
+        }
+        elapsed = now_ns() - start;
+    } while (elapsed < BENCH_MIN_NS && plain_total > 0);
+    printf("decoder: %zu -> %zu bytes per pass, %.1f MB/s of output\n",
+           encoded_total, plain_total, elapsed > 0 ? decoded * 1e3 / elapsed : 0.0);
+
+    return failures == 0 ? 0 : 1;
+}
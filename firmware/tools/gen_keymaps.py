@@ -0,0 +1,398 @@
+#!/usr/bin/env python3
+"""Generate the firmware's keyboard layout tables from XKB data.
+
+For every requested layout ("de", "fr", "us(intl)", ...) the XKB symbols
+file is resolved with its includes, each character is assigned the cheapest
+way to type it (plain key, Shift, AltGr, Shift+AltGr, or a dead key followed
+by a key, using the dead-key rules of the Compose table) and the result is
+written as C tables for keymap.h.
+
+Without XKB data on the build host only a built-in US layout is generated.
+"""
+
+import argparse
+import os
+import re
+import sys
+
+PAGE_BITS = 7
+PAGE_SIZE = 1 << PAGE_BITS
+MAX_PAGES = 8       # KEYMAP_MAX_PAGES in keymap.h
+
+MOD_NONE = 0x00
+MOD_LSHIFT = 0x02
+MOD_RALT = 0x40
+LEVEL_MODS = [MOD_NONE, MOD_LSHIFT, MOD_RALT, MOD_RALT | MOD_LSHIFT]
+
+# XKB key names to HID usages (main block only; the keypad depends on NumLock)
+KEYCODES = {
+    "TLDE": 0x35, "AE11": 0x2D, "AE12": 0x2E, "AD11": 0x2F, "AD12": 0x30,
+    "AC10": 0x33, "AC11": 0x34, "BKSL": 0x31, "AC12": 0x31, "AB08": 0x36,
+    "AB09": 0x37, "AB10": 0x38, "LSGT": 0x64, "SPCE": 0x2C,
+}
+for _i, _usage in enumerate([0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27]):
+    KEYCODES["AE%02d" % (_i + 1)] = _usage
+for _row, _letters in (("AD", "qwertyuiop"), ("AC", "asdfghjkl"), ("AB", "zxcvbnm")):
+    for _i, _ch in enumerate(_letters):
+        KEYCODES["%s%02d" % (_row, _i + 1)] = 0x04 + ord(_ch) - ord("a")
+
+# Characters typed the same way on every layout
+FIXED = {
+    0x08: (0x2A, MOD_NONE),     # Backspace
+    0x09: (0x2B, MOD_NONE),     # Tab
+    0x0A: (0x28, MOD_NONE),     # Enter
+    0x0D: (0x28, MOD_NONE),     # Enter
+    0x1B: (0x29, MOD_NONE),     # Escape
+    0x20: (0x2C, MOD_NONE),     # Space
+    0x7F: (0x4C, MOD_NONE),     # Delete
+}
+
+# Fallback when no XKB data is available: US, levels 1 and 2 per key
+US_FALLBACK = {
+    "TLDE": "`~", "AE01": "1!", "AE02": "2@", "AE03": "3#", "AE04": "4$",
+    "AE05": "5%", "AE06": "6^", "AE07": "7&", "AE08": "8*", "AE09": "9(",
+    "AE10": "0)", "AE11": "-_", "AE12": "=+", "AD11": "[{", "AD12": "]}",
+    "BKSL": "\\|", "AC10": ";:", "AC11": "'\"", "AB08": ",<", "AB09": ".>",
+    "AB10": "/?",
+}
+for _name, _usage in list(KEYCODES.items()):
+    if 0x04 <= _usage <= 0x1D and _name not in US_FALLBACK:
+        _ch = chr(ord("a") + _usage - 0x04)
+        US_FALLBACK[_name] = _ch + _ch.upper()
+
+
+class Keysyms:
+    """Keysym names to Unicode codepoints, from X11/keysymdef.h"""
+
+    def __init__(self, path):
+        self.codepoints = {}
+        define = re.compile(r"#define XK_(\w+)\s+0x([0-9a-fA-F]+)\s*/\*.*?U\+([0-9A-Fa-f]{4,6})")
+        with open(path, encoding="utf-8", errors="replace") as f:
+            for line in f:
+                m = define.match(line)
+                if m:
+                    self.codepoints.setdefault(m.group(1), int(m.group(3), 16))
+
+    def codepoint(self, name):
+        if name in self.codepoints:
+            return self.codepoints[name]
+        if re.fullmatch(r"U[0-9A-Fa-f]{4,6}", name):
+            return int(name[1:], 16)
+        if re.fullmatch(r"0x[0-9A-Fa-f]+", name):
+            value = int(name, 16)
+            if value >= 0x1000000:
+                return value - 0x1000000
+            if 0x20 <= value <= 0xFF:
+                return value
+        return None
+
+
+class SymbolsParser:
+    """Resolves an XKB symbols section into key name -> list of keysyms"""
+
+    def __init__(self, root):
+        self.root = root
+        self.cache = {}
+
+    def sections(self, filename):
+        if filename in self.cache:
+            return self.cache[filename]
+        with open(os.path.join(self.root, "symbols", filename), encoding="utf-8") as f:
+            text = re.sub(r"//[^\n]*", "", f.read())
+        sections = {}
+        first = None
+        default = None
+        for m in re.finditer(r'((?:\w+\s+)*)xkb_symbols\s+"([^"]+)"\s*\{', text):
+            body_start = m.end()
+            depth = 1
+            pos = body_start
+            while depth and pos < len(text):
+                depth += {"{": 1, "}": -1}.get(text[pos], 0)
+                pos += 1
+            sections[m.group(2)] = text[body_start:pos - 1]
+            first = first or m.group(2)
+            if default is None and "default" in m.group(1).split():
+                default = m.group(2)
+        self.cache[filename] = (sections, default or first)
+        return self.cache[filename]
+
+    def load(self, spec, keys=None, level3=None):
+        """Merge the section named by spec ("file" or "file(section)") into keys"""
+        keys = {} if keys is None else keys
+        level3 = [False] if level3 is None else level3
+        m = re.fullmatch(r"([\w-]+)(?:\(([\w-]+)\))?(?::\d+)?", spec)
+        if not m:
+            raise ValueError("bad symbols reference '%s'" % spec)
+        filename, section = m.group(1), m.group(2)
+        if filename == "level3" and section and "ralt" in section:
+            level3[0] = True
+        sections, default = self.sections(filename)
+        body = sections.get(section or default)
+        if body is None:
+            raise ValueError("no section '%s' in symbols/%s" % (section, filename))
+
+        for statement in split_statements(body):
+            inc = re.match(r'(include|augment|override|replace)\s+"([^"]+)"', statement)
+            if inc:
+                for mode, part in re.findall(r"([+|]?)([^+|]+)", inc.group(2)):
+                    if part.startswith("%"):
+                        continue
+                    sub, _ = self.load(part, {}, level3)
+                    augment = inc.group(1) == "augment" or mode == "|"
+                    merge_keys(keys, sub, augment)
+                continue
+            key = re.match(r"(?:(augment|override|replace)\s+)?key\s+<(\w+)>\s*\{(.*)\}\s*$",
+                           statement, re.S)
+            if key:
+                levels = parse_key_symbols(key.group(3))
+                if levels is not None:
+                    if key.group(1) == "replace":
+                        keys[key.group(2)] = levels
+                    else:
+                        merge_keys(keys, {key.group(2): levels}, key.group(1) == "augment")
+        return keys, level3[0]
+
+
+def split_statements(body):
+    """Statements end with ';' outside brackets; include lines need none"""
+    statements = []
+    include = re.compile(r'\s*((?:include|augment|override|replace)\s+"[^"]*")\s*;?')
+    pos = 0
+    while pos < len(body):
+        m = include.match(body, pos)
+        if m:
+            statements.append(m.group(1))
+            pos = m.end()
+            continue
+        depth = 0
+        end = pos
+        while end < len(body) and (body[end] != ";" or depth):
+            depth += {"{": 1, "[": 1, "}": -1, "]": -1}.get(body[end], 0)
+            end += 1
+        statements.append(body[pos:end].strip())
+        pos = end + 1
+    return statements
+
+
+def parse_key_symbols(body):
+    """First group's keysyms of a key body, or None if it has none"""
+    m = re.search(r"symbols\s*\[\s*(?:Group)?1\s*\]\s*=\s*\[([^\]]*)\]", body)
+    if not m:
+        stripped = re.sub(r"\w+\s*\[\s*\w+\s*\]\s*=\s*(\[[^\]]*\]|\"[^\"]*\"|\w+)", "", body)
+        stripped = re.sub(r"\w+\s*=\s*(\"[^\"]*\"|[\w+]+)", "", stripped)
+        m = re.search(r"\[([^\]]*)\]", stripped)
+    if not m:
+        return None
+    return [None if s in ("NoSymbol", "VoidSymbol", "") else s
+            for s in (part.strip() for part in m.group(1).split(","))]
+
+
+def merge_keys(keys, new, augment):
+    for name, levels in new.items():
+        old = keys.get(name, [])
+        merged = list(old) + [None] * (len(levels) - len(old))
+        for i, sym in enumerate(levels):
+            if sym is not None and (not augment or merged[i] is None):
+                merged[i] = sym
+        keys[name] = merged
+
+
+def parse_compose(path):
+    """Two-keysym dead-key rules: (dead keysym, keysym) -> codepoint"""
+    rules = {}
+    rule = re.compile(r'<(dead_\w+)>\s*<(\w+)>\s*:\s*"((?:[^"\\]|\\.)*)"')
+    with open(path, encoding="utf-8", errors="replace") as f:
+        for line in f:
+            m = rule.match(line)
+            if not m:
+                continue
+            result = m.group(3).encode("utf-8").decode("unicode_escape").encode(
+                "latin-1").decode("utf-8") if "\\" in m.group(3) else m.group(3)
+            if len(result) == 1:
+                rules.setdefault((m.group(1), m.group(2)), ord(result))
+    return rules
+
+
+class Layout:
+    def __init__(self, name, description):
+        self.name = name
+        self.description = description
+        self.chars = {}         # codepoint -> (cost, dead, key)
+
+    def offer(self, cp, cost, dead, key):
+        if cp not in self.chars or cost < self.chars[cp][0]:
+            self.chars[cp] = (cost, dead, key)
+
+
+def key_cost(mod):
+    return 1 + bin(mod).count("1")
+
+
+def prefer(entry, current):
+    """Whether (usage, mod) entry is a better way to type a keysym than current.
+    The key between Left Shift and Z (LSGT) is missing on ANSI keyboards, so
+    it loses ties and loses to any plain or shifted key. AltGr alternatives
+    do not otherwise beat it: on ISO layouts such as fr they are often XKB
+    additions other systems lack, while LSGT is always there."""
+    lsgt = KEYCODES["LSGT"]
+    if (entry[0] == lsgt) != (current[0] == lsgt):
+        other = current if entry[0] == lsgt else entry
+        if not other[1] & MOD_RALT or key_cost(entry[1]) == key_cost(current[1]):
+            return other is entry
+    return key_cost(entry[1]) < key_cost(current[1])
+
+
+def build_layout(spec, parser, keysyms, compose):
+    # Symbols are "pc+<layout>", as the XKB rules build them
+    keys, _ = parser.load("pc")
+    layout_keys, level3 = parser.load(spec)
+    merge_keys(keys, layout_keys, False)
+    m = re.fullmatch(r"([\w-]+)(?:\(([\w-]+)\))?", spec)
+    name = m.group(1) if m.group(2) in (None, "basic") else "%s-%s" % (m.group(1), m.group(2))
+    sections, default = parser.sections(m.group(1))
+    body = sections[m.group(2) or default]
+    desc = re.search(r'name\[\s*(?:Group)?1\s*\]\s*=\s*"([^"]*)"', body)
+    layout = Layout(name, desc.group(1) if desc else name)
+
+    direct = {}             # keysym name -> cheapest (usage, mod)
+    for key_name, levels in keys.items():
+        usage = KEYCODES.get(key_name)
+        if usage is None:
+            continue
+        for level, sym in enumerate(levels[:4 if level3 else 2]):
+            if sym is None:
+                continue
+            entry = (usage, LEVEL_MODS[level])
+            if sym not in direct or prefer(entry, direct[sym]):
+                direct[sym] = entry
+
+    for sym, key in direct.items():
+        cp = keysyms.codepoint(sym)
+        if cp is not None and not sym.startswith("dead_"):
+            layout.offer(cp, key_cost(key[1]), None, key)
+    for (dead_sym, base_sym), cp in compose.items():
+        if dead_sym in direct and base_sym in direct and not base_sym.startswith("dead_"):
+            dead, key = direct[dead_sym], direct[base_sym]
+            layout.offer(cp, key_cost(dead[1]) + key_cost(key[1]), dead, key)
+    for cp, key in FIXED.items():
+        layout.offer(cp, 0, None, key)
+    return layout
+
+
+def fallback_layout():
+    layout = Layout("us", "English (US)")
+    for key_name, chars in US_FALLBACK.items():
+        for level, ch in enumerate(chars):
+            layout.offer(ord(ch), key_cost(LEVEL_MODS[level]), None,
+                         (KEYCODES[key_name], LEVEL_MODS[level]))
+    for cp, key in FIXED.items():
+        layout.offer(cp, 0, None, key)
+    return layout
+
+
+def utf8_len(cp):
+    return 1 if cp < 0x80 else 2 if cp < 0x800 else 3
+
+
+def select_pages(layout):
+    """Page 0 (ASCII) always, then the fullest pages up to MAX_PAGES"""
+    counts = {}
+    for cp in layout.chars:
+        if cp < 0x10000 and (cp < 0x80 or cp >= 0xA0):
+            counts[cp >> PAGE_BITS] = counts.get(cp >> PAGE_BITS, 0) + 1
+    others = sorted((p for p in counts if p != 0), key=lambda p: (-counts[p], p))
+    return sorted([0] + others[:MAX_PAGES - 1])
+
+
+def c_ident(name):
+    return re.sub(r"\W", "_", name).upper()
+
+
+def emit(layouts, source):
+    out = ["/* Generated by tools/gen_keymaps.py from %s. Do not edit. */" % source,
+           "", '#include "keymap.h"', ""]
+    for layout in layouts:
+        ident = c_ident(layout.name)
+        pages = select_pages(layout)
+        max_bytes = 0
+        for page in pages:
+            out.append("static const keymap_char_t %s_%03X[KEYMAP_PAGE_SIZE] = {" % (ident, page))
+            for cp in range(page << PAGE_BITS, (page + 1) << PAGE_BITS):
+                if cp not in layout.chars or 0x80 <= cp < 0xA0:
+                    continue
+                _, dead, key = layout.chars[cp]
+                dead = dead or (0, 0)
+                comment = chr(cp) if 0x20 < cp != 0x7F and cp not in (0x5C, 0x2A, 0x2F) else \
+                    "U+%04X" % cp
+                out.append("    [0x%02X] = { { 0x%02X, 0x%02X }, { 0x%02X, 0x%02X } },  /* %s */"
+                           % (cp & (PAGE_SIZE - 1), dead[0], dead[1], key[0], key[1], comment))
+                encoded = (3 if dead[0] else 0) + 3
+                max_bytes = max(max_bytes, -(-encoded // utf8_len(cp)))
+            out.append("};")
+            out.append("")
+        out.append("static const keymap_page_t %s_PAGES[] = {" % ident)
+        for page in pages:
+            out.append("    { 0x%03X, %s_%03X }," % (page, ident, page))
+        out.append("};")
+        out.append("")
+        out.append("static const keymap_layout_t %s = {" % ident)
+        out.append('    .name = "%s",' % layout.name)
+        out.append('    .description = "%s",' % layout.description.replace('"', '\\"'))
+        out.append("    .pages = %s_PAGES," % ident)
+        out.append("    .page_count = %d," % len(pages))
+        out.append("    .max_char_bytes = %d," % max_bytes)
+        out.append("};")
+        out.append("")
+    out.append("const keymap_layout_t *const KEYMAP_LAYOUTS[] = {")
+    for layout in layouts:
+        out.append("    &%s," % c_ident(layout.name))
+    out.append("};")
+    out.append("")
+    out.append("const size_t KEYMAP_LAYOUT_COUNT = %d;" % len(layouts))
+    return "\n".join(out) + "\n"
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("layouts", nargs="*", default=["us"],
+                    help='XKB layouts, e.g. us de "fr" "us(intl)"; the first is the default')
+    ap.add_argument("--output", required=True)
+    ap.add_argument("--xkb-root", default=os.environ.get("XKB_CONFIG_ROOT", "/usr/share/X11/xkb"))
+    ap.add_argument("--keysymdef", default="/usr/include/X11/keysymdef.h")
+    ap.add_argument("--compose", default="/usr/share/X11/locale/en_US.UTF-8/Compose")
+    args = ap.parse_args()
+
+    layouts = []
+    source = "the built-in US layout"
+    if os.path.isdir(os.path.join(args.xkb_root, "symbols")) and os.path.isfile(args.keysymdef):
+        keysyms = Keysyms(args.keysymdef)
+        compose = parse_compose(args.compose) if os.path.isfile(args.compose) else {}
+        if not compose:
+            print("gen_keymaps: no Compose table, dead-key sequences skipped", file=sys.stderr)
+        parser = SymbolsParser(args.xkb_root)
+        for spec in args.layouts:
+            try:
+                layouts.append(build_layout(spec, parser, keysyms, compose))
+            except (OSError, ValueError) as e:
+                print("gen_keymaps: skipping layout %s: %s" % (spec, e), file=sys.stderr)
+        source = "XKB data in %s" % args.xkb_root
+    else:
+        print("gen_keymaps: no XKB data in %s, generating US only" % args.xkb_root,
+              file=sys.stderr)
+    if not layouts:
+        layouts.append(fallback_layout())
+
+    text = emit(layouts, source)
+    try:
+        with open(args.output, encoding="utf-8") as f:
+            if f.read() == text:
+                return 0
+    except OSError:
+        pass
+    with open(args.output, "w", encoding="utf-8") as f:
+        f.write(text)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
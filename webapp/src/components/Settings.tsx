@@ -4,15 +4,63 @@ import * as ble from "../utils/ble";
 import * as storage from "../utils/storage";
 import { nav } from "../utils/nav";
 import { PageHeader } from "./PageHeader";
+import type { HostOs, UnicodeMethod } from "../types/protocol";
+
+const POLL_INTERVAL_OPTIONS = [1, 2, 4, 8, 10];
+
+const HOLD_OPTIONS = [0, 5, 10, 20, 50];
+
+const HOST_OS_LABELS: Record<HostOs, string> = {
+  windows: "Windows",
+  linux: "Linux",
+  macos: "macOS",
+  bios: "BIOS/UEFI",
+  unknown: "Unknown OS",
+};
+
+const UNICODE_METHOD_OPTIONS: Array<[UnicodeMethod, string]> = [
+  ["none", "None"],
+  ["linux", "Linux (Ctrl+Shift+U)"],
+  ["windows", "Windows (Alt + numpad +, needs EnableHexNumpad)"],
+  ["macos", "macOS (Unicode Hex Input)"],
+];
+
+/* Characters per second the host can actually receive: a boot report
+ * carries up to batchKeys characters but needs a release report after it,
+ * while an NKRO report releases the previous key itself. */
+function estimateCharsPerSecond(
+  delayMs: number,
+  pollMs: number,
+  batchKeys: number,
+  nkro: boolean
+): number {
+  const gapMs = Math.max(delayMs, pollMs);
+  if (nkro) return 1000 / gapMs;
+  return (batchKeys * 1000) / (pollMs + gapMs);
+}
 
 export function Settings(_props: RoutableProps) {
   const [typingDelay, setTypingDelay] = useState(storage.getTypingDelay());
+  const [batchKeys, setBatchKeys] = useState(storage.getBatchKeys());
+  const [nkroEnabled, setNkroEnabled] = useState(storage.getNkroEnabled());
+  const [pollInterval, setPollInterval] = useState<number | null>(null);
+  const [spoolEnabled, setSpoolEnabled] = useState<boolean | null>(null);
+  const [layout, setLayout] = useState<string | null>(null);
+  const [layouts, setLayouts] = useState<string[]>([]);
+  const [unicodeMethod, setUnicodeMethod] = useState<UnicodeMethod | null>(null);
+  const [holdMs, setHoldMs] = useState<number | null>(null);
+  const [adaptivePacing, setAdaptivePacing] = useState<boolean | null>(null);
+  const [rateLimit, setRateLimit] = useState<number | null>(null);
+  const [rateBurst, setRateBurst] = useState<number | null>(null);
+  const [hostProfiles, setHostProfiles] = useState<boolean | null>(null);
+  const [host, setHost] = useState<{ os: HostOs; id: string } | null>(null);
   const [ledBrightness, setLedBrightness] = useState(storage.getLedBrightness());
   const [sysrqEnabled, setSysrqEnabled] = useState(storage.getSysRqEnabled());
   const [status, setStatus] = useState("");
   const [connected, setConnected] = useState(false);
   const [checkingAccess, setCheckingAccess] = useState(true);
   const appliedTypingDelayRef = useRef(typingDelay);
+  const appliedBatchKeysRef = useRef(batchKeys);
   const appliedLedBrightnessRef = useRef(ledBrightness);
 
   useEffect(() => {
@@ -23,11 +71,34 @@ export function Settings(_props: RoutableProps) {
 
     ble
       .readStatusObject()
-      .then((deviceStatus) => {
+      .then(async (deviceStatus) => {
         if (!deviceStatus.authenticated) {
           nav("/connect");
           return;
         }
+        const config = await ble.readTypingConfig();
+        setPollInterval(deviceStatus.usb_poll_ms ?? null);
+        setLayout(config.layout ?? null);
+        setLayouts(config.layouts ? config.layouts.split(",") : []);
+        setUnicodeMethod(config.unicode ?? null);
+        setHoldMs(config.hold_ms ?? null);
+        setRateLimit(config.rate_limit ?? null);
+        setRateBurst(config.rate_burst ?? null);
+        setAdaptivePacing(
+          config.pacing !== undefined ? config.pacing === "adaptive" : null
+        );
+        setHostProfiles(config.host_profiles ?? null);
+        setHost(
+          config.host && config.host_id ? { os: config.host, id: config.host_id } : null
+        );
+        if (config.typing_delay !== undefined) {
+          /* The host's profile may differ from what this browser last set */
+          appliedTypingDelayRef.current = config.typing_delay;
+          setTypingDelay(config.typing_delay);
+        }
+        setSpoolEnabled(
+          deviceStatus.spool !== undefined ? deviceStatus.spooling === true : null
+        );
         setConnected(true);
         setCheckingAccess(false);
       })
@@ -63,6 +134,217 @@ export function Settings(_props: RoutableProps) {
     }
   };
 
+  const applyBatchKeysChange = async (keys: number) => {
+    if (keys === appliedBatchKeysRef.current) return;
+    if (!connected) {
+      setStatus("Device is not connected");
+      return;
+    }
+
+    try {
+      await ble.sendPinAction({
+        action: "set_config",
+        key: "batch_keys",
+        value: String(keys),
+      });
+      appliedBatchKeysRef.current = keys;
+      storage.setBatchKeys(keys);
+      setStatus("Keys per report updated");
+    } catch {
+      setBatchKeys(appliedBatchKeysRef.current);
+      setStatus("Failed to update keys per report");
+    }
+  };
+
+  const handleNkroToggle = async (enabled: boolean) => {
+    if (!connected) {
+      setStatus("Device is not connected");
+      return;
+    }
+
+    setNkroEnabled(enabled);
+    try {
+      await ble.sendPinAction({
+        action: "set_config",
+        key: "hid_mode",
+        value: enabled ? "nkro" : "boot",
+      });
+      storage.setNkroEnabled(enabled);
+      setStatus("Keyboard report mode updated");
+    } catch {
+      setNkroEnabled(!enabled);
+      setStatus("Failed to update keyboard report mode");
+    }
+  };
+
+  const handleLayoutChange = async (name: string) => {
+    if (!connected) {
+      setStatus("Device is not connected");
+      return;
+    }
+
+    const previous = layout;
+    setLayout(name);
+    try {
+      await ble.sendPinAction({
+        action: "set_config",
+        key: "layout",
+        value: name,
+      });
+      setStatus("Keyboard layout updated");
+    } catch {
+      setLayout(previous);
+      setStatus("Failed to update keyboard layout");
+    }
+  };
+
+  const handleUnicodeMethodChange = async (method: UnicodeMethod) => {
+    if (!connected) {
+      setStatus("Device is not connected");
+      return;
+    }
+
+    const previous = unicodeMethod;
+    setUnicodeMethod(method);
+    try {
+      await ble.sendPinAction({
+        action: "set_config",
+        key: "unicode",
+        value: method,
+      });
+      setStatus("Unicode input method updated");
+    } catch {
+      setUnicodeMethod(previous);
+      setStatus("Failed to update Unicode input method");
+    }
+  };
+
+  const handleAdaptivePacingToggle = async (enabled: boolean) => {
+    if (!connected) {
+      setStatus("Device is not connected");
+      return;
+    }
+
+    setAdaptivePacing(enabled);
+    try {
+      await ble.sendPinAction({
+        action: "set_config",
+        key: "pacing",
+        value: enabled ? "adaptive" : "fixed",
+      });
+      setStatus(enabled ? "Adaptive pacing enabled" : "Fixed pacing enabled");
+    } catch {
+      setAdaptivePacing(!enabled);
+      setStatus("Failed to update pacing");
+    }
+  };
+
+  const applyRateLimitChange = async (key: "rate_limit" | "rate_burst", value: number) => {
+    if (!connected) {
+      setStatus("Device is not connected");
+      return;
+    }
+    if (!Number.isInteger(value) || value < 0 || value > 65535) {
+      setStatus("Enter a whole number between 0 and 65535");
+      return;
+    }
+
+    try {
+      await ble.sendPinAction({
+        action: "set_config",
+        key,
+        value: String(value),
+      });
+      setStatus(key === "rate_limit" ? "Rate limit updated" : "Burst size updated");
+    } catch {
+      setStatus(
+        key === "rate_limit" ? "Failed to update rate limit" : "Failed to update burst size"
+      );
+    }
+  };
+
+  const handleHoldChange = async (ms: number) => {
+    if (!connected) {
+      setStatus("Device is not connected");
+      return;
+    }
+
+    const previous = holdMs;
+    setHoldMs(ms);
+    try {
+      await ble.sendPinAction({
+        action: "set_config",
+        key: "hold_ms",
+        value: String(ms),
+      });
+      setStatus("Key hold time updated");
+    } catch {
+      setHoldMs(previous);
+      setStatus("Failed to update key hold time");
+    }
+  };
+
+  const handleHostProfilesToggle = async (enabled: boolean) => {
+    if (!connected) {
+      setStatus("Device is not connected");
+      return;
+    }
+
+    setHostProfiles(enabled);
+    try {
+      await ble.sendPinAction({
+        action: "set_config",
+        key: "host_profiles",
+        value: enabled ? "1" : "0",
+      });
+      setStatus(enabled ? "Host profiles enabled" : "Host profiles disabled");
+    } catch {
+      setHostProfiles(!enabled);
+      setStatus("Failed to update host profiles");
+    }
+  };
+
+  const handleSpoolToggle = async (enabled: boolean) => {
+    if (!connected) {
+      setStatus("Device is not connected");
+      return;
+    }
+
+    setSpoolEnabled(enabled);
+    try {
+      await ble.sendPinAction({
+        action: "set_config",
+        key: "spool",
+        value: enabled ? "1" : "0",
+      });
+      setStatus("Flash spooling updated");
+    } catch {
+      setSpoolEnabled(!enabled);
+      setStatus("Failed to update flash spooling");
+    }
+  };
+
+  const handlePollIntervalChange = async (ms: number) => {
+    if (!connected) {
+      setStatus("Device is not connected");
+      return;
+    }
+
+    const previous = pollInterval;
+    setPollInterval(ms);
+    try {
+      await ble.sendPinAction({
+        action: "set_config",
+        key: "usb_poll_ms",
+        value: String(ms),
+      });
+      setStatus("USB polling interval updated; keyboard re-enumerating");
+    } catch {
+      setPollInterval(previous);
+      setStatus("Failed to update USB polling interval");
+    }
+  };
+
   const applyBrightnessChange = async (percent: number) => {
     if (percent === appliedLedBrightnessRef.current) return;
     if (!connected) {
@@ -142,6 +424,313 @@ export function Settings(_props: RoutableProps) {
         </div>
       </div>
 
+      {adaptivePacing !== null && (
+        <div style={{ marginBottom: "1.5rem" }}>
+          <label
+            style={{
+              display: "flex",
+              alignItems: "center",
+              gap: "0.5rem",
+              color: "#94a3b8",
+              cursor: "pointer",
+            }}
+          >
+            <input
+              type="checkbox"
+              checked={adaptivePacing}
+              disabled={!connected}
+              onChange={(e) =>
+                void handleAdaptivePacingToggle((e.target as HTMLInputElement).checked)
+              }
+            />
+            Adaptive pacing
+          </label>
+          <p style={{ color: "#64748b", fontSize: "0.75rem", marginTop: "0.5rem" }}>
+            Starts at the typing delay, speeds up while the host keeps up and
+            backs off when it lags. The current rate is shown while typing.
+          </p>
+        </div>
+      )}
+
+      <div style={{ marginBottom: "1.5rem" }}>
+        <label style={{ display: "block", marginBottom: "0.5rem", color: "#94a3b8" }}>
+          Keys per Report: {batchKeys}
+        </label>
+        <input
+          type="range"
+          min={1}
+          max={6}
+          value={batchKeys}
+          disabled={!connected}
+          onInput={(e) =>
+            setBatchKeys(Number((e.target as HTMLInputElement).value))
+          }
+          onMouseUp={() => {
+            void applyBatchKeysChange(batchKeys);
+          }}
+          onTouchEnd={() => {
+            void applyBatchKeysChange(batchKeys);
+          }}
+          onChange={(e) => {
+            const value = Number((e.target as HTMLInputElement).value);
+            setBatchKeys(value);
+            void applyBatchKeysChange(value);
+          }}
+          style={{ width: "100%" }}
+        />
+        <div
+          style={{
+            display: "flex",
+            justifyContent: "space-between",
+            fontSize: "0.75rem",
+            color: "#64748b",
+          }}
+        >
+          <span>1 (compatible)</span>
+          <span>6 (fastest)</span>
+        </div>
+      </div>
+
+      <div style={{ marginBottom: "1.5rem" }}>
+        <label
+          style={{
+            display: "flex",
+            alignItems: "center",
+            gap: "0.5rem",
+            color: "#94a3b8",
+            cursor: "pointer",
+          }}
+        >
+          <input
+            type="checkbox"
+            checked={nkroEnabled}
+            disabled={!connected}
+            onChange={(e) =>
+              void handleNkroToggle((e.target as HTMLInputElement).checked)
+            }
+          />
+          Use N-key-rollover reports
+        </label>
+        <p style={{ color: "#64748b", fontSize: "0.75rem", marginTop: "0.5rem" }}>
+          One report per character on hosts that support it. BIOS/UEFI hosts
+          automatically fall back to boot keyboard reports.
+        </p>
+      </div>
+
+      {layout !== null && layouts.length > 0 && (
+        <div style={{ marginBottom: "1.5rem" }}>
+          <label style={{ display: "block", marginBottom: "0.5rem", color: "#94a3b8" }}>
+            Host Keyboard Layout
+          </label>
+          <select
+            value={layout}
+            disabled={!connected}
+            onChange={(e) =>
+              void handleLayoutChange((e.target as HTMLSelectElement).value)
+            }
+            style={{ width: "100%" }}
+          >
+            {layouts.map((name) => (
+              <option key={name} value={name}>
+                {name}
+              </option>
+            ))}
+          </select>
+          <p style={{ color: "#64748b", fontSize: "0.75rem", marginTop: "0.5rem" }}>
+            Must match the layout selected on the host, or symbols come out
+            as different characters.
+          </p>
+        </div>
+      )}
+
+      {unicodeMethod !== null && (
+        <div style={{ marginBottom: "1.5rem" }}>
+          <label style={{ display: "block", marginBottom: "0.5rem", color: "#94a3b8" }}>
+            Unicode Input Method
+          </label>
+          <select
+            value={unicodeMethod}
+            disabled={!connected}
+            onChange={(e) =>
+              void handleUnicodeMethodChange(
+                (e.target as HTMLSelectElement).value as UnicodeMethod
+              )
+            }
+            style={{ width: "100%" }}
+          >
+            {UNICODE_METHOD_OPTIONS.map(([value, label]) => (
+              <option key={value} value={value}>
+                {label}
+              </option>
+            ))}
+          </select>
+          <p style={{ color: "#64748b", fontSize: "0.75rem", marginTop: "0.5rem" }}>
+            Used for characters the layout has no key for; without it they
+            are skipped.
+          </p>
+        </div>
+      )}
+
+      {rateLimit !== null && rateBurst !== null && (
+        <div style={{ marginBottom: "1.5rem" }}>
+          <label style={{ display: "block", marginBottom: "0.5rem", color: "#94a3b8" }}>
+            Rate Limit
+          </label>
+          <div style={{ display: "flex", gap: "0.5rem" }}>
+            <input
+              type="number"
+              min={0}
+              max={65535}
+              value={rateLimit}
+              disabled={!connected}
+              onChange={(e) => {
+                const value = Number((e.target as HTMLInputElement).value);
+                setRateLimit(value);
+                void applyRateLimitChange("rate_limit", value);
+              }}
+              style={{ flex: 1 }}
+              aria-label="Characters per minute"
+            />
+            <input
+              type="number"
+              min={1}
+              max={8192}
+              value={rateBurst}
+              disabled={!connected}
+              onChange={(e) => {
+                const value = Number((e.target as HTMLInputElement).value);
+                setRateBurst(value);
+                void applyRateLimitChange("rate_burst", value);
+              }}
+              style={{ flex: 1 }}
+              aria-label="Burst size"
+            />
+          </div>
+          <p style={{ color: "#64748b", fontSize: "0.75rem", marginTop: "0.5rem" }}>
+            Characters per minute (0 = unlimited) and burst size. Up to the
+            burst is typed at full speed; longer text settles at the limit.
+            Characters entered as Unicode sequences count once.
+          </p>
+        </div>
+      )}
+
+      {holdMs !== null && (
+        <div style={{ marginBottom: "1.5rem" }}>
+          <label style={{ display: "block", marginBottom: "0.5rem", color: "#94a3b8" }}>
+            Key Hold Time
+          </label>
+          <select
+            value={holdMs}
+            disabled={!connected}
+            onChange={(e) =>
+              void handleHoldChange(Number((e.target as HTMLSelectElement).value))
+            }
+            style={{ width: "100%" }}
+          >
+            {HOLD_OPTIONS.map((ms) => (
+              <option key={ms} value={ms}>
+                {ms === 0 ? "Shortest (one poll)" : `${ms} ms`}
+              </option>
+            ))}
+          </select>
+          <p style={{ color: "#64748b", fontSize: "0.75rem", marginTop: "0.5rem" }}>
+            Longer holds help hosts that drop short key presses, such as
+            remote consoles and firmware setup screens.
+          </p>
+        </div>
+      )}
+
+      {hostProfiles !== null && (
+        <div style={{ marginBottom: "1.5rem" }}>
+          <label
+            style={{
+              display: "flex",
+              alignItems: "center",
+              gap: "0.5rem",
+              color: "#94a3b8",
+              cursor: "pointer",
+            }}
+          >
+            <input
+              type="checkbox"
+              checked={hostProfiles}
+              disabled={!connected}
+              onChange={(e) =>
+                void handleHostProfilesToggle((e.target as HTMLInputElement).checked)
+              }
+            />
+            Remember settings per host
+          </label>
+          <p style={{ color: "#64748b", fontSize: "0.75rem", marginTop: "0.5rem" }}>
+            Typing delay, key hold time and Unicode method are saved for the
+            host the keyboard is plugged into and restored when it returns.
+            {host !== null &&
+              ` Current host: ${HOST_OS_LABELS[host.os]} (${host.id}).`}
+          </p>
+        </div>
+      )}
+
+      {spoolEnabled !== null && (
+        <div style={{ marginBottom: "1.5rem" }}>
+          <label
+            style={{
+              display: "flex",
+              alignItems: "center",
+              gap: "0.5rem",
+              color: "#94a3b8",
+              cursor: "pointer",
+            }}
+          >
+            <input
+              type="checkbox"
+              checked={spoolEnabled}
+              disabled={!connected}
+              onChange={(e) =>
+                void handleSpoolToggle((e.target as HTMLInputElement).checked)
+              }
+            />
+            Spool uploads to flash
+          </label>
+          <p style={{ color: "#64748b", fontSize: "0.75rem", marginTop: "0.5rem" }}>
+            Large documents upload at full speed and keep typing after a
+            reset, resuming close to where they stopped.
+          </p>
+        </div>
+      )}
+
+      {pollInterval !== null && (
+        <div style={{ marginBottom: "1.5rem" }}>
+          <label style={{ display: "block", marginBottom: "0.5rem", color: "#94a3b8" }}>
+            USB Polling Interval
+          </label>
+          <select
+            value={pollInterval}
+            disabled={!connected}
+            onChange={(e) =>
+              void handlePollIntervalChange(
+                Number((e.target as HTMLSelectElement).value)
+              )
+            }
+            style={{ width: "100%" }}
+          >
+            {POLL_INTERVAL_OPTIONS.concat(
+              POLL_INTERVAL_OPTIONS.includes(pollInterval) ? [] : [pollInterval]
+            ).map((ms) => (
+              <option key={ms} value={ms}>
+                {ms}ms
+              </option>
+            ))}
+          </select>
+          <p style={{ color: "#64748b", fontSize: "0.75rem", marginTop: "0.5rem" }}>
+            Estimated speed: ~
+            {Math.round(
+              estimateCharsPerSecond(typingDelay, pollInterval, batchKeys, nkroEnabled) * 60
+            )}{" "}
+            chars/min. Changing the interval briefly disconnects the keyboard.
+          </p>
+        </div>
+      )}
+
       <div style={{ marginBottom: "1.5rem" }}>
         <label style={{ display: "block", marginBottom: "0.5rem", color: "#94a3b8" }}>
           LED Brightness: {ledBrightness}%
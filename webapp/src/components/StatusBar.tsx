@@ -26,41 +26,51 @@ export function StatusBar() {
     const conn = ble.getConnection();
     if (!conn || conn.mode !== "normal") return;
 
-    ble.onStatusChange((value) => {
-      try {
-        applyUpdate(JSON.parse(value) as Partial<DeviceStatus>);
-      } catch {
-        /* ignore parse errors */
-      }
-    }).catch(() => {
-      /* Subscription may fail during security negotiation */
-    });
+    let disposed = false;
+    let stopWatch: (() => void) | null = null;
+    let interval: number | undefined;
 
     ble.onDisconnect(() => {
       setConnected(false);
       setStatus(null);
     });
 
-    /* Initial read — may fail if security is still being established */
-    ble.readStatusObject().then((value) => {
-      try {
-        applyUpdate(value);
-      } catch {
-        /* ignore parse errors */
+    /* Binary status pushes every change; older firmware is polled */
+    ble.watchStatus(applyUpdate).then((stop) => {
+      if (disposed) {
+        stop?.();
+        return;
+      }
+      if (stop) {
+        stopWatch = stop;
+        return;
       }
-    }).catch(() => {
-      /* Read may fail during security negotiation */
-    });
 
-    const interval = window.setInterval(() => {
-      ble.readStatusObject().then((value) => {
-        applyUpdate(value);
+      ble.onStatusChange((value) => {
+        try {
+          applyUpdate(JSON.parse(value) as Partial<DeviceStatus>);
+        } catch {
+          /* ignore parse errors */
+        }
       }).catch(() => {
-        /* Ignore intermittent read failures */
+        /* Subscription may fail during security negotiation */
       });
-    }, 1000);
+
+      /* Initial read — may fail if security is still being established */
+      const poll = () => {
+        ble.readStatusObject().then((value) => {
+          applyUpdate(value);
+        }).catch(() => {
+          /* Ignore intermittent read failures */
+        });
+      };
+      poll();
+      interval = window.setInterval(poll, 1000);
+    });
 
     return () => {
+      disposed = true;
+      stopWatch?.();
       window.clearInterval(interval);
     };
   }, []);
@@ -106,7 +116,9 @@ export function StatusBar() {
           <span style={{ color: "#f97316" }}>Typing...</span>
           {status.queue > 0 && (
             <span style={{ color: "#94a3b8", marginLeft: "0.5rem" }}>
-              ({status.queue} queued)
+              ({status.queue} keys queued
+              {status.eta_ms ? `, ~${Math.ceil(status.eta_ms / 1000)}s left` : ""}
+              {status.rate_cpm ? `, ${status.rate_cpm} keys/min` : ""})
             </span>
           )}
         </>
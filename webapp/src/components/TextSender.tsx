@@ -10,6 +10,7 @@ import {
   type KeyboardLayoutVariant,
 } from "./VirtualKeyboard";
 import { nav } from "../utils/nav";
+import { usageForButton } from "../utils/hidUsage";
 
 const CTRL_ALT_MODIFIER = 0x01 | 0x04;
 const CTRL_MODIFIER = 0x01;
@@ -76,6 +77,7 @@ export function TextSender(_props: RoutableProps) {
   const [keyboardLayoutVariant, setKeyboardLayoutVariant] =
     useState<KeyboardLayoutVariant>("simple");
   const [sysrqEnabled] = useState(storage.getSysRqEnabled());
+  const [liveKeys, setLiveKeys] = useState(false);
 
   useEffect(() => {
     if (!ble.isConnected()) {
@@ -91,43 +93,65 @@ export function TextSender(_props: RoutableProps) {
       setKeyboardConnected(status.keyboard_connected !== false);
       setTypingActive(Boolean(status.typing));
       setCheckingAuth(false);
+      void ble.hasLiveKeys().then(setLiveKeys);
     }).catch(() => {
       nav("/connect");
     });
 
-    ble.onStatusChange((value) => {
-      try {
-        const status = JSON.parse(value) as {
-          keyboard_connected?: boolean;
-          typing?: boolean;
-        };
-        if (typeof status.keyboard_connected === "boolean") {
-          setKeyboardConnected(status.keyboard_connected);
-        }
-        if (typeof status.typing === "boolean") {
-          setTypingActive(status.typing);
-        }
-      } catch {
-        /* ignore parse errors */
+    let disposed = false;
+    let stopWatch: (() => void) | null = null;
+    let interval: number | undefined;
+
+    const applyStatus = (status: {
+      keyboard_connected?: boolean;
+      typing?: boolean;
+    }) => {
+      if (typeof status.keyboard_connected === "boolean") {
+        setKeyboardConnected(status.keyboard_connected);
+      }
+      if (typeof status.typing === "boolean") {
+        setTypingActive(status.typing);
+      }
+    };
+
+    /* Binary status pushes every change; older firmware is polled */
+    ble.watchStatus(applyStatus).then((stop) => {
+      if (disposed) {
+        stop?.();
+        return;
+      }
+      if (stop) {
+        stopWatch = stop;
+        return;
       }
-    }).catch(() => {
-      /* subscription can fail during reconnect transitions */
-    });
 
-    const interval = window.setInterval(() => {
-      ble.readStatusObject().then((status) => {
-        setKeyboardConnected(status.keyboard_connected !== false);
-        setTypingActive(Boolean(status.typing));
+      ble.onStatusChange((value) => {
+        try {
+          applyStatus(JSON.parse(value));
+        } catch {
+          /* ignore parse errors */
+        }
       }).catch(() => {
-        /* ignore transient read failures */
+        /* subscription can fail during reconnect transitions */
       });
-    }, 1000);
+
+      interval = window.setInterval(() => {
+        ble.readStatusObject().then((status) => {
+          setKeyboardConnected(status.keyboard_connected !== false);
+          setTypingActive(Boolean(status.typing));
+        }).catch(() => {
+          /* ignore transient read failures */
+        });
+      }, 1000);
+    });
 
     ble.onDisconnect(() => {
       setConnected(false);
     });
 
     return () => {
+      disposed = true;
+      stopWatch?.();
       window.clearInterval(interval);
     };
   }, []);
@@ -179,7 +203,7 @@ export function TextSender(_props: RoutableProps) {
     if (!(await ensureKeyboardConnected())) return;
     setSendingSpecial(true);
     try {
-      await ble.sendText(payload);
+      await ble.sendText(payload, { interactive: true });
     } catch (e) {
       setError(e instanceof Error ? e.message : "Failed to send special key");
     } finally {
@@ -188,6 +212,15 @@ export function TextSender(_props: RoutableProps) {
   };
 
   const handleShortcut = async (modifier: number, keycode: number) => {
+    if (liveKeys && keyboardConnected) {
+      /* Straight to USB, no status round trip or JSON command */
+      try {
+        await ble.tapLiveKey(keycode, modifier);
+      } catch (e) {
+        setError(e instanceof Error ? e.message : "Failed to send shortcut");
+      }
+      return;
+    }
     if (sendingSpecial || sending) return;
     setError("");
     if (!(await ensureKeyboardConnected())) return;
@@ -201,6 +234,18 @@ export function TextSender(_props: RoutableProps) {
     }
   };
 
+  /* Virtual keyboard with live keys: buttons are held for as long as they
+   * are pressed, so the host sees real holds and auto-repeat */
+  const handleLiveKey = async (button: string, down: boolean) => {
+    const key = usageForButton(button);
+    if (!key) return;
+    try {
+      await ble.sendLiveKeys(ble.liveKeyEvents(key.usage, key.modifier, down));
+    } catch (e) {
+      setError(e instanceof Error ? e.message : "Failed to send key");
+    }
+  };
+
   const handleVirtualSpecialKey = async (key: VirtualSpecialKey) => {
     if (key === "escape") {
       await handleShortcut(0, 0x29);
@@ -692,10 +737,11 @@ export function TextSender(_props: RoutableProps) {
         </div>
         <VirtualKeyboard
           key={keyboardLayoutVariant}
-          disabled={sending || sendingSpecial || !keyboardConnected}
+          disabled={(!liveKeys && (sending || sendingSpecial)) || !keyboardConnected}
           layoutVariant={keyboardLayoutVariant}
           onTextKey={handleSpecialKey}
           onSpecialKey={handleVirtualSpecialKey}
+          onLiveKey={liveKeys ? handleLiveKey : undefined}
         />
       </details>
 
@@ -44,6 +44,9 @@ interface VirtualKeyboardProps {
   layoutVariant?: KeyboardLayoutVariant;
   onTextKey: (text: string) => void | Promise<void>;
   onSpecialKey: (key: VirtualSpecialKey) => void | Promise<void>;
+  /* When set, buttons send key-down on press and key-up on release instead
+   * of onTextKey/onSpecialKey */
+  onLiveKey?: (button: string, down: boolean) => void | Promise<void>;
 }
 
 const SIMPLE_LAYOUT = {
@@ -191,6 +194,7 @@ export function VirtualKeyboard({
   layoutVariant = "simple",
   onTextKey,
   onSpecialKey,
+  onLiveKey,
 }: VirtualKeyboardProps) {
   const mainKeyboardRef = useRef<Keyboard | null>(null);
   const controlKeyboardRef = useRef<Keyboard | null>(null);
@@ -199,6 +203,8 @@ export function VirtualKeyboard({
   const disabledRef = useRef(Boolean(disabled));
   const onTextKeyRef = useRef(onTextKey);
   const onSpecialKeyRef = useRef(onSpecialKey);
+  const onLiveKeyRef = useRef(onLiveKey);
+  const liveDownRef = useRef(new Set<string>());
   const [layoutName, setLayoutName] = useState("default");
   const layoutNameRef = useRef("default");
 
@@ -214,6 +220,10 @@ export function VirtualKeyboard({
     onSpecialKeyRef.current = onSpecialKey;
   }, [onSpecialKey]);
 
+  useEffect(() => {
+    onLiveKeyRef.current = onLiveKey;
+  }, [onLiveKey]);
+
   const handleKeyPress = (button: string) => {
     if (disabledRef.current) return;
 
@@ -228,6 +238,12 @@ export function VirtualKeyboard({
       return;
     }
 
+    if (onLiveKeyRef.current) {
+      liveDownRef.current.add(button);
+      void onLiveKeyRef.current(button, true);
+      return;
+    }
+
     const mappedSpecial = mapTokenToSpecialKey(button);
     if (mappedSpecial) {
       void onSpecialKeyRef.current(mappedSpecial);
@@ -250,6 +266,13 @@ export function VirtualKeyboard({
     }
   };
 
+  /* Always deliver the release of a key that went down, even if the
+   * keyboard was disabled in between */
+  const handleKeyReleased = (button: string) => {
+    if (!liveDownRef.current.delete(button)) return;
+    void onLiveKeyRef.current?.(button, false);
+  };
+
   useEffect(() => {
     let retryFrame: number | null = null;
 
@@ -273,6 +296,7 @@ export function VirtualKeyboard({
           mergeDisplay: true,
           theme: "simple-keyboard hg-theme-default vk-theme vk-simple",
           onKeyPress: handleKeyPress,
+          onKeyReleased: handleKeyReleased,
         });
         mainKeyboardRef.current = main;
         return main !== null;
@@ -285,6 +309,7 @@ export function VirtualKeyboard({
         mergeDisplay: true,
         theme: "simple-keyboard hg-theme-default vk-theme vk-full-main",
         onKeyPress: handleKeyPress,
+        onKeyReleased: handleKeyReleased,
       });
       const control = createKeyboardInstance(".vk-full-control-host", {
         layoutName: "default",
@@ -293,6 +318,7 @@ export function VirtualKeyboard({
         mergeDisplay: true,
         theme: "simple-keyboard hg-theme-default vk-theme vk-full-control",
         onKeyPress: handleKeyPress,
+        onKeyReleased: handleKeyReleased,
       });
       const arrows = createKeyboardInstance(".vk-full-arrows-host", {
         layoutName: "default",
@@ -301,6 +327,7 @@ export function VirtualKeyboard({
         mergeDisplay: true,
         theme: "simple-keyboard hg-theme-default vk-theme vk-full-arrows",
         onKeyPress: handleKeyPress,
+        onKeyReleased: handleKeyReleased,
       });
 
       mainKeyboardRef.current = main;
@@ -17,6 +17,9 @@ export const TEXT_INPUT_UUID = "6e400002-b5a3-f393-e0a9-e50e24dcca9e";
 export const STATUS_UUID = "6e400003-b5a3-f393-e0a9-e50e24dcca9e";
 export const PIN_MANAGEMENT_UUID = "6e400004-b5a3-f393-e0a9-e50e24dcca9e";
 export const CERT_FINGERPRINT_UUID = "6e400006-b5a3-f393-e0a9-e50e24dcca9e";
+export const LIVE_KEYS_UUID = "6e400007-b5a3-f393-e0a9-e50e24dcca9e";
+export const STATUS_BIN_UUID = "6e400008-b5a3-f393-e0a9-e50e24dcca9e";
+export const TYPING_CONFIG_UUID = "6e400009-b5a3-f393-e0a9-e50e24dcca9e";
 
 /* Provisioning status values */
 export enum ProvisioningStatus {
@@ -53,17 +56,69 @@ export interface ProvisioningResponse {
 }
 
 /* Normal mode types */
+export type UnicodeMethod = "none" | "linux" | "windows" | "macos";
+
+export type HostOs = "windows" | "linux" | "macos" | "bios" | "unknown";
+
 export interface DeviceStatus {
   connected: boolean;
   typing: boolean;
   queue: number;
+  eta_ms?: number;
   authenticated: boolean;
   keyboard_connected?: boolean;
   retry_delay_ms: number;
   locked_out: boolean;
+  usb_poll_ms?: number;
+  jitter_avg_us?: number;
+  jitter_max_us?: number;
+  rx?: number;
+  credit?: number;
+  mtu?: number;
+  phy?: number;
+  dle?: number;
+  link?: "fast" | "idle" | "none";
+  itvl_us?: number;
+  latency?: number;
+  cmdq?: number;
+  live_gaps?: number;
+  job?: number;
+  next?: number;
+  /* Typing job whose progress was last reported */
+  tid?: number;
+  /* Bytes in the flash spool not yet typed; absent without a spool partition */
+  spool?: number;
+  spooling?: boolean;
+  /* Binary status only: the inter-key gap in effect, the keystroke rate it
+   * gives and the keystrokes left in the rate limiter's bucket */
+  gap_us?: number;
+  rate_cpm?: number;
+  tokens?: number;
+  compress?: "lzss";
   auth_error?: "invalid_pin" | "rate_limited" | "locked_out";
 }
 
+/* Typing Config characteristic: the settings typing runs with */
+export interface TypingConfig {
+  /* Entry method for characters missing from the layout */
+  unicode?: UnicodeMethod;
+  /* Host keyboard layout, and the comma-separated layouts built in */
+  layout?: string;
+  layouts?: string;
+  /* Pacing in effect, from the host's profile or the saved defaults */
+  typing_delay?: number;
+  hold_ms?: number;
+  host_profiles?: boolean;
+  /* Adaptive pacing follows the host from typing_delay */
+  pacing?: "adaptive" | "fixed";
+  /* Token bucket: sustained characters per minute (0 = off) and burst size */
+  rate_limit?: number;
+  rate_burst?: number;
+  /* Guessed OS and fingerprint of the USB host, once identified */
+  host?: HostOs;
+  host_id?: string;
+}
+
 export interface PinSetAction {
   action: "set";
   old: string;
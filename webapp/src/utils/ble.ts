@@ -13,8 +13,21 @@ import {
   STATUS_UUID,
   PIN_MANAGEMENT_UUID,
   CERT_FINGERPRINT_UUID,
+  LIVE_KEYS_UUID,
+  STATUS_BIN_UUID,
+  TYPING_CONFIG_UUID,
 } from "../types/protocol";
-import type { DeviceStatus } from "../types/protocol";
+import type { DeviceStatus, TypingConfig } from "../types/protocol";
+import {
+  buildFrame,
+  FRAME_FLAG_COMPRESSED,
+  FRAME_FLAG_INTERACTIVE,
+  FRAME_FLAG_LAST,
+  FRAME_HEADER_LEN,
+  FRAME_MAX_PLAIN,
+} from "./frame";
+import { lzssCompress } from "./lzss";
+import { parseStatusRecord, type StatusRecord } from "./statusRecord";
 
 export type BleMode = "provisioning" | "normal";
 
@@ -32,6 +45,154 @@ let currentConnection: BleConnection | null = null;
 let gattOpQueue: Promise<void> = Promise.resolve();
 let characteristicCache = new Map<string, BluetoothRemoteGATTCharacteristic>();
 
+/* Text input flow control: the device advertises how far (in bytes since
+ * connect) the client may write, and NACKs the first write that does not
+ * fit. Updates arrive as status notifications. */
+interface FlowUpdate {
+  rx?: number;
+  nack?: number;
+  credit?: number;
+  job?: number;
+  next?: number;
+  done?: boolean;
+  retx?: number;
+}
+
+/* Framed transfer progress as acknowledged by the device */
+interface JobState {
+  job: number;
+  next: number;
+  done: boolean;
+  resendFrom: number | null;
+}
+
+/* PIN management commands are executed by a worker on the device and
+ * answered with {"cmd","ok"[,"error"]} status notifications. Firmware that
+ * does this reports free command slots as `cmdq` in its status. */
+interface CommandResult {
+  cmd: string;
+  ok: boolean;
+  error?: string;
+}
+
+const FLOW_WAIT_MS = 1000;
+const COMMAND_WAIT_MS = 3000;
+
+let flowLimit = 0;
+let flowNack: number | null = null;
+let flowWaiters: Array<() => void> = [];
+let flowListening = false;
+let jobState: JobState | null = null;
+let commandResults = false;
+let liveSeq = 0;
+let liveKeys: boolean | null = null;
+let commandWaiters: Array<(result: CommandResult) => boolean> = [];
+
+/* Binary status: one subscription per connection, merged into a cached
+ * status shared by every watcher. While it is subscribed the device sends
+ * status changes and typing progress here instead of as JSON, so the flow
+ * window is fed from it as well. */
+let binaryStatus: StatusRecord | null = null;
+let binaryStatusSetup: Promise<boolean> | null = null;
+let statusWatchers: Array<(status: DeviceStatus) => void> = [];
+
+function resetFlowState(): void {
+  flowLimit = 0;
+  flowNack = null;
+  jobState = null;
+  flowListening = false;
+  flowWaiters.forEach((wake) => wake());
+  flowWaiters = [];
+  commandResults = false;
+  commandWaiters = [];
+  liveSeq = 0;
+  liveKeys = null;
+  binaryStatus = null;
+  binaryStatusSetup = null;
+  statusWatchers = [];
+}
+
+function applyFlowUpdate(update: FlowUpdate): void {
+  if (update.credit === undefined) return;
+  if (update.job !== undefined && update.next !== undefined) {
+    /* A framed NACK means frame `next` did not fit: resend from there */
+    const resendFrom =
+      update.retx ?? (update.nack !== undefined ? update.next : null);
+    jobState = {
+      job: update.job,
+      next: update.next,
+      done: update.done === true,
+      resendFrom,
+    };
+  } else if (update.nack !== undefined) {
+    flowNack = update.nack;
+  }
+  if (update.nack !== undefined) {
+    flowLimit = update.nack + update.credit;
+  } else if (update.rx !== undefined) {
+    flowLimit = update.rx + update.credit;
+  } else {
+    return;
+  }
+  const waiters = flowWaiters;
+  flowWaiters = [];
+  waiters.forEach((wake) => wake());
+}
+
+function waitForFlowUpdate(): Promise<boolean> {
+  return new Promise((resolve) => {
+    const timer = setTimeout(() => {
+      flowWaiters = flowWaiters.filter((wake) => wake !== onUpdate);
+      resolve(false);
+    }, FLOW_WAIT_MS);
+    const onUpdate = () => {
+      clearTimeout(timer);
+      resolve(true);
+    };
+    flowWaiters.push(onUpdate);
+  });
+}
+
+/* Resolves with the device's answer to `cmd`, or null if none arrives */
+function waitForCommandResult(cmd: string): Promise<CommandResult | null> {
+  return new Promise((resolve) => {
+    const onResult = (result: CommandResult) => {
+      if (result.cmd !== cmd) return false;
+      clearTimeout(timer);
+      resolve(result);
+      return true;
+    };
+    const timer = setTimeout(() => {
+      commandWaiters = commandWaiters.filter((waiter) => waiter !== onResult);
+      resolve(null);
+    }, COMMAND_WAIT_MS);
+    commandWaiters.push(onResult);
+  });
+}
+
+function applyCommandResult(result: CommandResult): void {
+  /* Commands run in order, so the oldest waiter for this command wins */
+  const index = commandWaiters.findIndex((waiter) => waiter(result));
+  if (index >= 0) commandWaiters.splice(index, 1);
+}
+
+async function ensureFlowListener(): Promise<void> {
+  if (flowListening) return;
+  await startNotifications(STATUS_UUID, (value) => {
+    try {
+      const update = JSON.parse(value) as FlowUpdate & Partial<CommandResult>;
+      if (update.cmd !== undefined && update.ok !== undefined) {
+        applyCommandResult(update as CommandResult);
+        return;
+      }
+      applyFlowUpdate(update);
+    } catch {
+      /* Not a JSON status update (e.g. audit log dump) */
+    }
+  });
+  flowListening = true;
+}
+
 function isGattBusyError(error: unknown): boolean {
   return (
     error instanceof Error &&
@@ -114,11 +275,13 @@ export async function scanAndConnect(mode: BleMode): Promise<BleConnection> {
   currentConnection = { device, server, service, mode };
   gattOpQueue = Promise.resolve();
   characteristicCache = new Map<string, BluetoothRemoteGATTCharacteristic>();
+  resetFlowState();
 
   device.addEventListener("gattserverdisconnected", () => {
     currentConnection = null;
     gattOpQueue = Promise.resolve();
     characteristicCache = new Map<string, BluetoothRemoteGATTCharacteristic>();
+    resetFlowState();
   });
 
   return currentConnection;
@@ -142,6 +305,7 @@ export async function disconnect(): Promise<void> {
   currentConnection = null;
   gattOpQueue = Promise.resolve();
   characteristicCache = new Map<string, BluetoothRemoteGATTCharacteristic>();
+  resetFlowState();
 }
 
 export async function readCharacteristic(uuid: string): Promise<string> {
@@ -152,23 +316,33 @@ export async function readCharacteristic(uuid: string): Promise<string> {
   });
 }
 
+/* Largest attribute value; writes above this are split into several.
+ * Pass the link's MTU - 3 instead to avoid the slower long-write procedure
+ * for data that may be split freely. */
+const MAX_ATTR_LEN = 512;
+
 export async function writeCharacteristic(
   uuid: string,
-  data: string
+  data: string,
+  chunkSize = MAX_ATTR_LEN
 ): Promise<void> {
   await runGattOp(async () => {
     const char = await getCharacteristicCached(uuid);
     const encoded = encoder.encode(data);
 
-    /* Chunk writes for data > 512 bytes */
-    const MTU = 512;
-    for (let offset = 0; offset < encoded.length; offset += MTU) {
-      const chunk = encoded.slice(offset, offset + MTU);
+    for (let offset = 0; offset < encoded.length; offset += chunkSize) {
+      const chunk = encoded.slice(offset, offset + chunkSize);
       await char.writeValueWithResponse(chunk);
     }
   });
 }
 
+/* Payload that fits one ATT write on the negotiated link */
+function linkChunkSize(status: DeviceStatus): number {
+  if (status.mtu === undefined) return MAX_ATTR_LEN;
+  return Math.min(MAX_ATTR_LEN, Math.max(20, status.mtu - 3));
+}
+
 export async function startNotifications(
   uuid: string,
   callback: (value: string) => void
@@ -231,8 +405,189 @@ export async function readProvisioningError(): Promise<number> {
 
 /* Normal mode helpers */
 
-export async function sendText(text: string): Promise<void> {
-  await writeCharacteristic(TEXT_INPUT_UUID, text);
+async function waitForFlowOrPoll(): Promise<void> {
+  if (await waitForFlowUpdate()) return;
+  /* Missed notification: poll the window instead */
+  const latest = await readStatusObject();
+  if (latest.rx !== undefined && latest.credit !== undefined) {
+    flowLimit = latest.rx + latest.credit;
+  }
+}
+
+/* Compress only when it saves at least this fraction of the bytes */
+const COMPRESS_MIN_GAIN = 0.1;
+
+/* One frame payload and the rx range it covers. Compressed frames count
+ * decompressed bytes, which is what the device's credit is measured in. */
+interface PlannedFrame {
+  payload: Uint8Array;
+  flags: number;
+  rxEnd: number;
+}
+
+/* One frame per write of up to MTU - 3 bytes; the device drops frames
+ * longer than the attribute limit whatever the MTU */
+function framePayloadSize(status: DeviceStatus): number {
+  const mtu = status.mtu ?? 23;
+  return Math.max(1, Math.min(MAX_ATTR_LEN, mtu - 3) - FRAME_HEADER_LEN);
+}
+
+/* Split text into frame payloads. Compressed frames carry consecutive
+ * pieces of one LZSS stream, cut so none decompresses to more than
+ * FRAME_MAX_PLAIN bytes. */
+function planFrames(
+  data: Uint8Array,
+  payloadSize: number,
+  compress: boolean
+): PlannedFrame[] {
+  const frames: PlannedFrame[] = [];
+  const stream = compress ? lzssCompress(data) : null;
+
+  if (stream && stream.data.length <= data.length * (1 - COMPRESS_MIN_GAIN)) {
+    let start = 0;
+    let plainStart = 0;
+    while (start < stream.data.length) {
+      let end = Math.min(start + payloadSize, stream.data.length);
+      while (end - 1 > start && stream.plainEnd[end - 1] - plainStart > FRAME_MAX_PLAIN) {
+        end--;
+      }
+      frames.push({
+        payload: stream.data.subarray(start, end),
+        flags: FRAME_FLAG_COMPRESSED,
+        rxEnd: stream.plainEnd[end - 1],
+      });
+      plainStart = stream.plainEnd[end - 1];
+      start = end;
+    }
+  } else {
+    for (let start = 0; start < data.length; start += payloadSize) {
+      const payload = data.subarray(start, start + payloadSize);
+      frames.push({ payload, flags: 0, rxEnd: start + payload.length });
+    }
+  }
+
+  if (frames.length === 0) {
+    frames.push({ payload: data, flags: 0, rxEnd: 0 });
+  }
+  frames[frames.length - 1].flags |= FRAME_FLAG_LAST;
+  return frames;
+}
+
+/* Send text as a framed job (sequence numbers + CRC). The device delivers
+ * each frame exactly once and in order and asks for missing ones; frames
+ * are resent from the first gap, or from the last acknowledged frame when
+ * acknowledgements stop arriving. Text is LZSS-compressed when the device
+ * supports it and it pays off. */
+async function sendFramed(
+  char: BluetoothRemoteGATTCharacteristic,
+  data: Uint8Array,
+  status: DeviceStatus
+): Promise<void> {
+  const job = ((status.job ?? 0) + 1) & 0xffff;
+  const payloadSize = framePayloadSize(status);
+  const frames = planFrames(data, payloadSize, status.compress === "lzss");
+  const base = status.rx ?? 0;
+  flowLimit = base + (status.credit ?? 0);
+  jobState = null;
+
+  let seq = 0;
+  for (;;) {
+    if (!isConnected()) throw new Error("Not connected");
+
+    const state = jobState?.job === job ? jobState : null;
+    if (state?.done) return;
+    if (state && state.resendFrom !== null) {
+      seq = Math.min(seq, state.resendFrom);
+      state.resendFrom = null;
+    }
+
+    if (seq >= frames.length) {
+      if (!(await waitForFlowUpdate())) {
+        seq = jobState?.job === job ? jobState.next : 0;
+      }
+      continue;
+    }
+
+    const planned = frames[seq];
+    if (base + planned.rxEnd > flowLimit) {
+      await waitForFlowOrPoll();
+      continue;
+    }
+
+    const frame = buildFrame(job, seq, planned.payload, planned.flags);
+    await runGattOp(() => char.writeValueWithoutResponse(frame));
+    seq++;
+  }
+}
+
+export interface SendTextOptions {
+  /* Short key sequence typed ahead of text already queued on the device */
+  interactive?: boolean;
+}
+
+/* Stream text with write-without-response, pipelining chunks up to the
+ * device's advertised window. Falls back to one acknowledged write per
+ * chunk on firmware without flow control. Interactive text that fits in
+ * one frame goes as a single acknowledged frame on the device's
+ * interactive lane, leaving any framed job in progress alone. */
+export async function sendText(
+  text: string,
+  options: SendTextOptions = {}
+): Promise<void> {
+  const char = await runGattOp(() => getCharacteristicCached(TEXT_INPUT_UUID));
+  const status = await readStatusObject();
+  const data = encoder.encode(text);
+  if (
+    options.interactive &&
+    status.tid !== undefined &&
+    data.length <= framePayloadSize(status)
+  ) {
+    const frame = buildFrame(0, 0, data, FRAME_FLAG_LAST | FRAME_FLAG_INTERACTIVE);
+    await runGattOp(() => char.writeValueWithResponse(frame));
+    return;
+  }
+
+  if (
+    !char.properties.writeWithoutResponse ||
+    status.rx === undefined ||
+    status.credit === undefined
+  ) {
+    await writeCharacteristic(TEXT_INPUT_UUID, text, linkChunkSize(status));
+    return;
+  }
+
+  await ensureFlowListener();
+  if (status.job !== undefined) {
+    await sendFramed(char, data, status);
+    return;
+  }
+
+  const base = status.rx;
+  const chunkSize = linkChunkSize(status);
+  flowLimit = status.rx + status.credit;
+  flowNack = null;
+
+  let offset = 0;
+  while (offset < data.length) {
+    if (!isConnected()) throw new Error("Not connected");
+
+    if (flowNack !== null) {
+      /* Everything from the refused write on was dropped: resend it */
+      offset = Math.max(0, flowNack - base);
+      flowNack = null;
+      await sendPinAction({ action: "text_resume" });
+      continue;
+    }
+
+    const chunk = data.subarray(offset, offset + chunkSize);
+    if (base + offset + chunk.length > flowLimit) {
+      await waitForFlowOrPoll();
+      continue;
+    }
+
+    await runGattOp(() => char.writeValueWithoutResponse(chunk));
+    offset += chunk.length;
+  }
 }
 
 export async function readStatus(): Promise<string> {
@@ -241,14 +596,50 @@ export async function readStatus(): Promise<string> {
 
 export async function readStatusObject(): Promise<DeviceStatus> {
   const payload = await readStatus();
-  return JSON.parse(payload) as DeviceStatus;
+  const status = JSON.parse(payload) as DeviceStatus;
+  commandResults = status.cmdq !== undefined;
+  return status;
+}
+
+/* Settings typing runs with; empty on firmware without Typing Config */
+export async function readTypingConfig(): Promise<TypingConfig> {
+  try {
+    return JSON.parse(await readCharacteristic(TYPING_CONFIG_UUID)) as TypingConfig;
+  } catch {
+    return {};
+  }
 }
 
-export async function sendPinAction(action: object): Promise<void> {
+/* Actions the device answers inline, without a result notification */
+const INLINE_ACTIONS = new Set(["logout", "abort", "text_resume", "cancel"]);
+
+export async function sendPinAction(action: { action: string }): Promise<void> {
+  if (!commandResults || INLINE_ACTIONS.has(action.action)) {
+    await writeCharacteristic(PIN_MANAGEMENT_UUID, JSON.stringify(action));
+    return;
+  }
+
+  await ensureFlowListener();
+  const result = waitForCommandResult(action.action);
   await writeCharacteristic(PIN_MANAGEMENT_UUID, JSON.stringify(action));
+  const answer = await result;
+  if (answer && !answer.ok) {
+    throw new Error(`${action.action} failed: ${answer.error ?? "unknown"}`);
+  }
+}
+
+/* Cancel one typing job, by the tid reported in status and progress */
+export async function cancelJob(tid: number): Promise<void> {
+  const action = { action: "cancel", tid };
+  await sendPinAction(action);
 }
 
 export async function authenticate(pin: string): Promise<DeviceStatus> {
+  /* Learn whether the firmware answers with a result notification */
+  await readStatusObject();
+  if (commandResults) await ensureFlowListener();
+  const result = commandResults ? waitForCommandResult("auth") : null;
+
   return runGattOp(async () => {
     const pinChar = await getCharacteristicCached(PIN_MANAGEMENT_UUID);
     const statusChar = await getCharacteristicCached(STATUS_UUID);
@@ -256,8 +647,13 @@ export async function authenticate(pin: string): Promise<DeviceStatus> {
 
     await pinChar.writeValueWithResponse(payload);
 
-    /* Give firmware a short window to process auth and update status. */
-    await delay(120);
+    if (result) {
+      /* The device verifies the PIN on its command worker */
+      await result;
+    } else {
+      /* Give firmware a short window to process auth and update status. */
+      await delay(120);
+    }
 
     const value = await statusChar.readValue();
     return JSON.parse(decoder.decode(value)) as DeviceStatus;
@@ -278,6 +674,59 @@ export async function onStatusChange(
   await startNotifications(STATUS_UUID, callback);
 }
 
+function applyStatusRecord(view: DataView): void {
+  const update = parseStatusRecord(view);
+  if (!update || !binaryStatus) return;
+  binaryStatus = { ...binaryStatus, ...update };
+  if (update.rx !== undefined || update.credit !== undefined) {
+    applyFlowUpdate({ rx: binaryStatus.rx, credit: binaryStatus.credit });
+  }
+  const status = binaryStatus;
+  statusWatchers.forEach((watch) => watch(status));
+}
+
+async function startBinaryStatus(): Promise<boolean> {
+  try {
+    return await runGattOp(async () => {
+      const char = await getCharacteristicCached(STATUS_BIN_UUID);
+      const initial = parseStatusRecord(await char.readValue());
+      if (!initial) return false;
+      binaryStatus = { connected: true, ...initial } as StatusRecord;
+      char.addEventListener("characteristicvaluechanged", (event) => {
+        const target = event.target as BluetoothRemoteGATTCharacteristic;
+        applyStatusRecord(target.value!);
+      });
+      /* The first notification after subscribing carries every field */
+      await char.startNotifications();
+      return true;
+    });
+  } catch {
+    /* Older firmware, or security still being established */
+    return false;
+  }
+}
+
+/* Call `callback` with the full status whenever the device reports a
+ * change. Resolves to an unsubscribe function, or null on firmware without
+ * binary status, where readStatusObject() has to be polled instead. */
+export async function watchStatus(
+  callback: (status: DeviceStatus) => void
+): Promise<(() => void) | null> {
+  if (!binaryStatusSetup) binaryStatusSetup = startBinaryStatus();
+  const setup = binaryStatusSetup;
+  if (!(await setup)) {
+    if (binaryStatusSetup === setup) binaryStatusSetup = null;
+    return null;
+  }
+  if (!binaryStatus) return null;
+
+  statusWatchers.push(callback);
+  callback(binaryStatus);
+  return () => {
+    statusWatchers = statusWatchers.filter((watch) => watch !== callback);
+  };
+}
+
 export function onDisconnect(callback: () => void): void {
   if (currentConnection?.device) {
     currentConnection.device.addEventListener(
@@ -286,3 +735,70 @@ export function onDisconnect(callback: () => void): void {
     );
   }
 }
+
+/* Live keys: raw key-down/up events on a write-without-response
+ * characteristic, sent to USB ahead of queued text. Each write is
+ * [seq][event, usage]...; the device releases everything if a write goes
+ * missing. */
+export interface LiveKeyEvent {
+  usage: number;
+  down: boolean;
+}
+
+const LIVE_EVENT_UP = 0x00;
+const LIVE_EVENT_DOWN = 0x01;
+const LIVE_MAX_EVENTS = 16;
+const MODIFIER_USAGE_BASE = 0xe0;
+
+export async function hasLiveKeys(): Promise<boolean> {
+  if (liveKeys === null) {
+    try {
+      await runGattOp(() => getCharacteristicCached(LIVE_KEYS_UUID));
+      liveKeys = true;
+    } catch {
+      liveKeys = false;
+    }
+  }
+  return liveKeys;
+}
+
+export async function sendLiveKeys(events: LiveKeyEvent[]): Promise<void> {
+  const char = await runGattOp(() => getCharacteristicCached(LIVE_KEYS_UUID));
+  for (let offset = 0; offset < events.length; offset += LIVE_MAX_EVENTS) {
+    const batch = events.slice(offset, offset + LIVE_MAX_EVENTS);
+    const payload = new Uint8Array(1 + batch.length * 2);
+    payload[0] = liveSeq;
+    liveSeq = (liveSeq + 1) & 0xff;
+    batch.forEach((event, i) => {
+      payload[1 + i * 2] = event.down ? LIVE_EVENT_DOWN : LIVE_EVENT_UP;
+      payload[2 + i * 2] = event.usage;
+    });
+    await runGattOp(() => char.writeValueWithoutResponse(payload));
+  }
+}
+
+function modifierUsages(modifier: number): number[] {
+  const usages: number[] = [];
+  for (let bit = 0; bit < 8; bit++) {
+    if (modifier & (1 << bit)) usages.push(MODIFIER_USAGE_BASE + bit);
+  }
+  return usages;
+}
+
+/* Press (modifiers first) or release (key first) a key with modifiers */
+export function liveKeyEvents(
+  usage: number,
+  modifier: number,
+  down: boolean
+): LiveKeyEvent[] {
+  const mods = modifierUsages(modifier).map((u) => ({ usage: u, down }));
+  const key = usage !== 0 ? [{ usage, down }] : [];
+  return down ? [...mods, ...key] : [...key, ...mods.reverse()];
+}
+
+export async function tapLiveKey(usage: number, modifier: number): Promise<void> {
+  await sendLiveKeys([
+    ...liveKeyEvents(usage, modifier, true),
+    ...liveKeyEvents(usage, modifier, false),
+  ]);
+}
@@ -0,0 +1,52 @@
+/* Framed text input: [0x01][flags][job u16][seq u16][crc32 u32][payload] */
+
+export const FRAME_MARKER = 0x01;
+export const FRAME_FLAG_LAST = 0x01;
+/* Payload continues the job's LZSS stream (see lzss.ts) */
+export const FRAME_FLAG_COMPRESSED = 0x02;
+/* A one-frame job typed ahead of queued bulk text */
+export const FRAME_FLAG_INTERACTIVE = 0x04;
+/* Most bytes one compressed frame may decompress to */
+export const FRAME_MAX_PLAIN = 1024;
+export const FRAME_HEADER_LEN = 10;
+const FRAME_CRC_OFFSET = 6;
+
+const CRC_TABLE = (() => {
+  const table = new Uint32Array(256);
+  for (let n = 0; n < 256; n++) {
+    let c = n;
+    for (let k = 0; k < 8; k++) {
+      c = c & 1 ? 0xedb88320 ^ (c >>> 1) : c >>> 1;
+    }
+    table[n] = c >>> 0;
+  }
+  return table;
+})();
+
+/* Standard CRC-32 (zlib), continuable like esp_rom_crc32_le() */
+export function crc32(data: Uint8Array, crc = 0): number {
+  let c = ~crc >>> 0;
+  for (let i = 0; i < data.length; i++) {
+    c = CRC_TABLE[(c ^ data[i]) & 0xff] ^ (c >>> 8);
+  }
+  return ~c >>> 0;
+}
+
+export function buildFrame(
+  job: number,
+  seq: number,
+  payload: Uint8Array,
+  flags: number
+): Uint8Array {
+  const frame = new Uint8Array(FRAME_HEADER_LEN + payload.length);
+  const view = new DataView(frame.buffer);
+  frame[0] = FRAME_MARKER;
+  frame[1] = flags;
+  view.setUint16(2, job, true);
+  view.setUint16(4, seq, true);
+  frame.set(payload, FRAME_HEADER_LEN);
+
+  const crc = crc32(payload, crc32(frame.subarray(0, FRAME_CRC_OFFSET)));
+  view.setUint32(FRAME_CRC_OFFSET, crc, true);
+  return frame;
+}
@@ -0,0 +1,87 @@
+/* HID keyboard usages for virtual keyboard buttons (US layout) */
+
+export interface KeyUsage {
+  usage: number;
+  modifier: number;
+}
+
+const SHIFT = 0x02;
+
+const SPECIAL_USAGES: Record<string, number> = {
+  "{enter}": 0x28,
+  "{escape}": 0x29,
+  "{backspace}": 0x2a,
+  "{tab}": 0x2b,
+  "{space}": 0x2c,
+  "{prtscr}": 0x46,
+  "{scrolllock}": 0x47,
+  "{pause}": 0x48,
+  "{insert}": 0x49,
+  "{home}": 0x4a,
+  "{pageup}": 0x4b,
+  "{delete}": 0x4c,
+  "{end}": 0x4d,
+  "{pagedown}": 0x4e,
+  "{arrowright}": 0x4f,
+  "{arrowleft}": 0x50,
+  "{arrowdown}": 0x51,
+  "{arrowup}": 0x52,
+  "{controlleft}": 0xe0,
+  "{altleft}": 0xe2,
+  "{metaleft}": 0xe3,
+  "{controlright}": 0xe4,
+  "{altright}": 0xe6,
+  "{metaright}": 0xe7,
+};
+
+/* Punctuation keys: unshifted and shifted character per usage */
+const PUNCTUATION: Array<[string, string, number]> = [
+  ["-", "_", 0x2d],
+  ["=", "+", 0x2e],
+  ["[", "{", 0x2f],
+  ["]", "}", 0x30],
+  ["\\", "|", 0x31],
+  [";", ":", 0x33],
+  ["'", '"', 0x34],
+  ["`", "~", 0x35],
+  [",", "<", 0x36],
+  [".", ">", 0x37],
+  ["/", "?", 0x38],
+];
+
+const SHIFTED_DIGITS = "!@#$%^&*()";
+
+function charUsage(ch: string): KeyUsage | null {
+  const lower = ch.toLowerCase();
+  if (lower >= "a" && lower <= "z") {
+    return {
+      usage: 0x04 + lower.charCodeAt(0) - 97,
+      modifier: ch !== lower ? SHIFT : 0,
+    };
+  }
+  if (ch >= "1" && ch <= "9") return { usage: 0x1e + Number(ch) - 1, modifier: 0 };
+  if (ch === "0") return { usage: 0x27, modifier: 0 };
+
+  const digit = SHIFTED_DIGITS.indexOf(ch);
+  if (digit >= 0) return { usage: 0x1e + digit, modifier: SHIFT };
+
+  for (const [plain, shifted, usage] of PUNCTUATION) {
+    if (ch === plain) return { usage, modifier: 0 };
+    if (ch === shifted) return { usage, modifier: SHIFT };
+  }
+  return null;
+}
+
+/* Usage for a simple-keyboard button token ("a", "{enter}", "{f5}") */
+export function usageForButton(button: string): KeyUsage | null {
+  const special = SPECIAL_USAGES[button];
+  if (special !== undefined) return { usage: special, modifier: 0 };
+
+  const functionMatch = button.match(/^\{f(1[0-2]|[1-9])\}$/);
+  if (functionMatch) {
+    return { usage: 0x3a + Number(functionMatch[1]) - 1, modifier: 0 };
+  }
+
+  if (button.length === 1) return charUsage(button);
+  return null;
+}
@@ -0,0 +1,96 @@
+/* LZSS encoder matching the firmware decoder (firmware/main/lzss.h).
+ *
+ * Groups of a flag byte plus up to eight tokens, flag bits LSB first: a set
+ * bit is a literal byte, a clear bit a back-reference
+ * [d & 0xff][(d >> 8) | ((len - 3) << 2)] copying len (3-66) bytes from
+ * d + 1 (1-1024) bytes back. */
+
+const WINDOW_SIZE = 1024;
+const MIN_MATCH = 3;
+const MAX_MATCH = MIN_MATCH + 63;
+const HASH_BITS = 12;
+const MAX_CHAIN = 32;
+
+export interface LzssStream {
+  data: Uint8Array;
+  /* plainEnd[i]: input bytes fully decoded once data[0..i] is consumed */
+  plainEnd: Uint32Array;
+}
+
+function hash3(input: Uint8Array, pos: number): number {
+  const v = (input[pos] << 16) | (input[pos + 1] << 8) | input[pos + 2];
+  return Math.imul(v, 2654435761) >>> (32 - HASH_BITS);
+}
+
+export function lzssCompress(input: Uint8Array): LzssStream {
+  /* Worst case: every token a literal, plus one flag byte per eight */
+  const capacity = input.length + Math.ceil(input.length / 8) + 1;
+  const data = new Uint8Array(capacity);
+  const plainEnd = new Uint32Array(capacity);
+  const head = new Int32Array(1 << HASH_BITS).fill(-1);
+  const prev = new Int32Array(input.length);
+
+  let out = 0;
+  let flagPos = -1;
+  let tokens = 8;
+  let pos = 0;
+
+  const insert = (at: number) => {
+    if (at + MIN_MATCH > input.length) return;
+    const h = hash3(input, at);
+    prev[at] = head[h];
+    head[h] = at;
+  };
+
+  const startToken = (literal: boolean) => {
+    if (tokens === 8) {
+      flagPos = out;
+      data[out] = 0;
+      plainEnd[out++] = pos;
+      tokens = 0;
+    }
+    if (literal) data[flagPos] |= 1 << tokens;
+    tokens++;
+  };
+
+  while (pos < input.length) {
+    let bestLen = 0;
+    let bestDist = 0;
+
+    if (pos + MIN_MATCH <= input.length) {
+      const limit = Math.min(MAX_MATCH, input.length - pos);
+      let candidate = head[hash3(input, pos)];
+      for (let chain = 0; candidate >= 0 && chain < MAX_CHAIN; chain++) {
+        const dist = pos - candidate;
+        if (dist > WINDOW_SIZE) break;
+        let len = 0;
+        while (len < limit && input[candidate + len] === input[pos + len]) len++;
+        if (len > bestLen) {
+          bestLen = len;
+          bestDist = dist;
+          if (len === limit) break;
+        }
+        candidate = prev[candidate];
+      }
+    }
+
+    if (bestLen >= MIN_MATCH) {
+      startToken(false);
+      const d = bestDist - 1;
+      data[out] = d & 0xff;
+      plainEnd[out++] = pos;
+      data[out] = (d >> 8) | ((bestLen - MIN_MATCH) << 2);
+      plainEnd[out++] = pos + bestLen;
+      for (let i = 0; i < bestLen; i++) insert(pos + i);
+      pos += bestLen;
+    } else {
+      startToken(true);
+      data[out] = input[pos];
+      plainEnd[out++] = pos + 1;
+      insert(pos);
+      pos++;
+    }
+  }
+
+  return { data: data.subarray(0, out), plainEnd: plainEnd.subarray(0, out) };
+}
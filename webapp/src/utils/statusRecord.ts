@@ -0,0 +1,95 @@
+/* Binary status record: [version u8][mask u32][field...], little-endian.
+ * Only the fields whose bit is set follow, in field order; a read carries
+ * all of them, a notification only those that changed. */
+
+import type { DeviceStatus } from "../types/protocol";
+
+export const STATUS_RECORD_VERSION = 1;
+const HEADER_LEN = 5;
+
+const FLAG_TYPING = 0x01;
+const FLAG_AUTHENTICATED = 0x02;
+const FLAG_KEYBOARD_CONNECTED = 0x04;
+const FLAG_LOCKED_OUT = 0x08;
+const FLAG_SPOOLING = 0x10;
+
+const AUTH_ERRORS = [undefined, "invalid_pin", "rate_limited", "locked_out"] as const;
+const LINK_MODES = ["none", "fast", "idle"] as const;
+
+/* Status plus the typing progress carried by the record (of job tid) */
+export interface StatusRecord extends DeviceStatus {
+  current?: number;
+  total?: number;
+}
+
+type FieldName = keyof StatusRecord | "flags";
+
+/* Field order and width, indexed by mask bit (see firmware status_bin.h) */
+const FIELDS: Array<[FieldName, 1 | 2 | 4]> = [
+  ["flags", 1],
+  ["auth_error", 1],
+  ["queue", 4],
+  ["eta_ms", 4],
+  ["retry_delay_ms", 4],
+  ["rx", 4],
+  ["credit", 4],
+  ["mtu", 2],
+  ["phy", 1],
+  ["dle", 2],
+  ["link", 1],
+  ["itvl_us", 4],
+  ["latency", 2],
+  ["usb_poll_ms", 1],
+  ["jitter_avg_us", 4],
+  ["jitter_max_us", 4],
+  ["cmdq", 1],
+  ["live_gaps", 4],
+  ["job", 2],
+  ["next", 2],
+  ["current", 4],
+  ["total", 4],
+  ["tid", 2],
+  ["spool", 4],
+  ["rate_cpm", 4],
+  ["gap_us", 4],
+  ["tokens", 4],
+];
+
+/* Decode a record into the fields it carries; null for an unknown version */
+export function parseStatusRecord(view: DataView): Partial<StatusRecord> | null {
+  if (view.byteLength < HEADER_LEN) return null;
+  if (view.getUint8(0) !== STATUS_RECORD_VERSION) return null;
+
+  const mask = view.getUint32(1, true);
+  const update: Partial<StatusRecord> = {};
+  const values = update as Record<string, unknown>;
+  let offset = HEADER_LEN;
+
+  for (let bit = 0; bit < FIELDS.length; bit++) {
+    if (!(mask & (1 << bit))) continue;
+    const [name, size] = FIELDS[bit];
+    if (offset + size > view.byteLength) return null;
+    const value =
+      size === 1
+        ? view.getUint8(offset)
+        : size === 2
+          ? view.getUint16(offset, true)
+          : view.getUint32(offset, true);
+    offset += size;
+
+    if (name === "flags") {
+      update.typing = (value & FLAG_TYPING) !== 0;
+      update.authenticated = (value & FLAG_AUTHENTICATED) !== 0;
+      update.keyboard_connected = (value & FLAG_KEYBOARD_CONNECTED) !== 0;
+      update.locked_out = (value & FLAG_LOCKED_OUT) !== 0;
+      update.spooling = (value & FLAG_SPOOLING) !== 0;
+    } else if (name === "auth_error") {
+      update.auth_error = AUTH_ERRORS[value];
+    } else if (name === "link") {
+      update.link = LINK_MODES[value] ?? "none";
+    } else {
+      values[name] = value;
+    }
+  }
+  return update;
+}
@@ -35,6 +35,23 @@ export function setTypingDelay(ms: number): void {
   setItem("typing-delay", String(ms));
 }
 
+export function getBatchKeys(): number {
+  const val = getItem("batch-keys");
+  return val ? Number(val) : 1;
+}
+
+export function setBatchKeys(keys: number): void {
+  setItem("batch-keys", String(keys));
+}
+
+export function getNkroEnabled(): boolean {
+  return getItem("nkro-enabled") === "true";
+}
+
+export function setNkroEnabled(enabled: boolean): void {
+  setItem("nkro-enabled", String(enabled));
+}
+
 export function getLedBrightness(): number {
   const val = getItem("led-brightness");
   return val ? Number(val) : 5;